@@ -4,6 +4,7 @@
 #include "EpSettings.h"
 #include "EpDma.h"
 #include "EpProfiler.h"
+#include "EpFloat.h"
 
 
 #include <stdio.h>
@@ -28,6 +29,7 @@ struct EpIeeeFloat {
 
  float g_epNAN;
  bool s_epIsInit = false;
+unsigned g_epLogCategories = ~0u;
 static const char* s_epInitFile = "(null)"; // For trapping code running before EpMain.
 static unsigned s_epInitLine = 0;
 
@@ -64,6 +66,8 @@ void EpInitAt(const char* file, unsigned line) {
 }
 
 void EpShutdown() {
+  EpLogStopFlushThread();
+  EpLogFlush();
   EpDmaShutDown();
   EpProfilerShutdown();
 
@@ -105,10 +109,15 @@ void EpLogHandler(EpLogLevel level, const char* format, ...) {
   va_end(args);
 }
 
+bool EpLogDeferV(EpLogLevel level, const char* format, va_list args); // EpLog.cpp
+
 void EpLogHandlerV(EpLogLevel level, const char* format, va_list args) {
   if (!g_epSettings.platform_isLogging) {
     return;
   }
+  if (g_epSettings.platform_isLogDeferred && EpLogDeferV(level, format, args)) {
+    return;
+  }
 
   char buf[EP_LOG_MAX*2];
   int sz = ::vsprintf(buf, format, args);
@@ -136,7 +145,7 @@ void EpHexDump(const void *p, unsigned bytes, const char* label) {
   unsigned char* ptr = (unsigned char*)p; (void)ptr;
   EpLog(" ========= %s (%u bytes) =========\n", label, bytes);
   for (unsigned i = 0; i < bytes;) {
-    EpLog(" %08x  ", (uintptr_t)(ptr + i));
+    EpLog(" %p  ", (const void*)(ptr + i));
     for (int max=4; i < bytes && max--; i += 4) {
       EpLog("%08x ", *(unsigned*)(ptr + i));
     }
@@ -145,9 +154,11 @@ void EpHexDump(const void *p, unsigned bytes, const char* label) {
 }
 
 void EpFloatDump(const float *ptr, unsigned count, const char* label) {
+  EpFloatStatsResult stats = EpFloatStats(ptr, count);
   EpLog(" ========= %s (%u values) =========\n", label, count);
+  EpLog(" min %f max %f mean %f nan %u inf %u\n", stats.min, stats.max, stats.mean, stats.nanCount, stats.infCount);
   for (unsigned i = 0; i < count;) {
-    EpLog(" %08x  ", (uintptr_t)(ptr + i));
+    EpLog(" %p  ", (const void*)(ptr + i));
     for (int max=4; i < count && max--; i++) {
       EpLog("%8f ", ptr[i]);
     }
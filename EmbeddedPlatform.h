@@ -19,6 +19,12 @@
 #define EP_LOGGING 1
 #endif
 
+// EpLogAt() messages more verbose than this are compiled out.  Override per
+// category with EP_LOG_VERBOSITY_<category>.  See EpLogVerbosity.
+#ifndef EP_LOG_VERBOSITY
+#define EP_LOG_VERBOSITY 1
+#endif
+
 // ----------------------------------------------------------------------------
 // C++98 polyfill.
 
@@ -37,6 +43,8 @@
 #define EP_RESTRICT restrict
 #define EP_FORCEINLINE
 #define EP_LINK_SCRATCHPAD __attribute__(TODO)
+#define EP_PRINTF_FORMAT(formatIndex, argIndex)
+#define EP_THREAD_LOCAL
 
 #else
 #define EP_BUILD_SOFTWARE
@@ -50,6 +58,14 @@
 #define EP_RESTRICT __restrict
 #define EP_FORCEINLINE // __forceinline conflicts with inline.
 #define EP_LINK_SCRATCHPAD
+#define EP_THREAD_LOCAL thread_local
+
+// Has the compiler check arguments against a printf format string.
+#if defined(__GNUC__) || defined(__clang__)
+#define EP_PRINTF_FORMAT(formatIndex, argIndex) __attribute__((format(printf, formatIndex, argIndex)))
+#else
+#define EP_PRINTF_FORMAT(formatIndex, argIndex)
+#endif
 
 #endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
 
@@ -69,6 +85,19 @@ template<class T> inline T EpMax(T x, T y) { return (x > y) ? x : y; }
 template<class T> inline T EpMin(T x, T y) { return (x < y) ? x : y; }
 template<class T> inline T EpClamp(T x, T min_, T max_) { return (x <= min_) ? min_ : ((x >= max_) ? max_ : x); }
 
+// std::move and std::forward without <utility>.  C++98 falls back to copying.
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+template<class T> struct EpRemoveReference { typedef T type; };
+template<class T> struct EpRemoveReference<T&> { typedef T type; };
+template<class T> struct EpRemoveReference<T&&> { typedef T type; };
+template<class T> inline typename EpRemoveReference<T>::type&& EpMove(T&& t) EP_NOEXCEPT { return static_cast<typename EpRemoveReference<T>::type&&>(t); }
+template<class T> inline T&& EpForward(typename EpRemoveReference<T>::type& t) EP_NOEXCEPT { return static_cast<T&&>(t); }
+#else
+template<class T> inline T& EpMove(T& t) { return t; }
+#endif
+
+template<class T> inline void EpSwap(T& x, T& y) { T t(EpMove(x)); x = EpMove(y); y = EpMove(t); }
+
 // Use a union to cast pointers.  Helps with compilers that observe the C rules for that.
 template<class T, class U> T& EpAliasingCast(U& u) { union { T* t; U* u; } x; x.u = &u; return *x.t; }
 template<class T, class U> T* EpAliasingCast(U* u) { union { T* t; U* u; } x; x.u = u; return  x.t; }
@@ -101,10 +130,57 @@ enum EpLogLevel {
 #define EpInit() (void)(s_epIsInit || (EpInitAt(0, 0), 0))
 #endif
 
+// Categories and verbosities for EpLogAt().  Each category is a bit in
+// g_epLogCategories.
+enum EpLogCategory {
+  EpLogCategory_Platform,
+  EpLogCategory_Memory,
+  EpLogCategory_Dma,
+  EpLogCategory_Profiler,
+  EpLogCategory_Test,
+  EpLogCategory_Replay,
+  EpLogCategory_App
+};
+
+enum EpLogVerbosity {
+  EpLogVerbosity_Info = 1,
+  EpLogVerbosity_Verbose = 2,
+  EpLogVerbosity_Trace = 3
+};
+
+#ifndef EP_LOG_VERBOSITY_Platform
+#define EP_LOG_VERBOSITY_Platform EP_LOG_VERBOSITY
+#endif
+#ifndef EP_LOG_VERBOSITY_Memory
+#define EP_LOG_VERBOSITY_Memory EP_LOG_VERBOSITY
+#endif
+#ifndef EP_LOG_VERBOSITY_Dma
+#define EP_LOG_VERBOSITY_Dma EP_LOG_VERBOSITY
+#endif
+#ifndef EP_LOG_VERBOSITY_Profiler
+#define EP_LOG_VERBOSITY_Profiler EP_LOG_VERBOSITY
+#endif
+#ifndef EP_LOG_VERBOSITY_Test
+#define EP_LOG_VERBOSITY_Test EP_LOG_VERBOSITY
+#endif
+#ifndef EP_LOG_VERBOSITY_Replay
+#define EP_LOG_VERBOSITY_Replay EP_LOG_VERBOSITY
+#endif
+#ifndef EP_LOG_VERBOSITY_App
+#define EP_LOG_VERBOSITY_App EP_LOG_VERBOSITY
+#endif
+
 #if (EP_LOGGING==1)
 #define EpLog(...) EpLogHandler(EpLogLevel_Log, __VA_ARGS__)
+
+// EpLogAt(Memory, Verbose, "format", ...) logs when Verbose is enabled for
+// Memory at compile time and the Memory bit is set in g_epLogCategories.  The
+// arguments are not evaluated otherwise.
+#define EpLogAt(category, verbosity, ...) (void)((EP_LOG_VERBOSITY_##category >= EpLogVerbosity_##verbosity) \
+  && (g_epLogCategories & (1u << EpLogCategory_##category)) && (EpLogHandler(EpLogLevel_Log, __VA_ARGS__), 0))
 #else
 #define EpLog(...) ((void)0)
+#define EpLogAt(category, verbosity, ...) ((void)0)
 #endif
 
 #define EP_ALIGNMENT ((uintptr_t)0x4)
@@ -114,17 +190,22 @@ enum EpLogLevel {
 
 extern bool s_epIsInit;
 extern float g_epNAN;
+extern unsigned g_epLogCategories; // Bits for enabled EpLogCategory values.  All by default.
 
 void EpInitAt(const char* file=0, unsigned line=0);
 void EpShutdown(); // Expects all non-debug allocations to be released.
 void EpExit(const char* msg = 0);
 void EpAssertHandler(const char* file, unsigned line);
-void EpLogHandler(EpLogLevel level, const char* format, ...);
-void EpLogHandlerV(EpLogLevel level, const char* format, va_list args);
+void EpLogHandler(EpLogLevel level, const char* format, ...) EP_PRINTF_FORMAT(2, 3);
+void EpLogHandlerV(EpLogLevel level, const char* format, va_list args) EP_PRINTF_FORMAT(2, 0);
 void EpLogStatus();
+void EpLogFlush(int fd=2); // Writes deferred EpLog() messages.  See EpLog.cpp.
+void EpLogStartFlushThread(unsigned periodMicroseconds=1000u);
+void EpLogStopFlushThread();
 void* EpMalloc(size_t size);
 void* EpMallocExtended(size_t size, uintptr_t alignmentMask, int memoryAllocatorId=-1); // -1 is EpMemoryAllocatorId_UNSPECIFIED
 void EpFree(void *ptr);
+void EpFreeExtended(void *ptr, int memoryAllocatorId); // Skips searching for the owning allocator.
 void EpHexDump(const void *p, unsigned bytes, const char* label);
 void EpFloatDump(const float *ptr, unsigned count, const char* label);
 bool EpIsFinite(float f);
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "EpArray.h"
+#include "EpJobSystem.h"
+
+// ----------------------------------------------------------------------------
+// EpParallelForEach, EpTransform, EpReduce, EpInclusiveScan, EpSort
+//
+// Data parallel algorithms over pointer ranges and EpArrays that run on an
+// EpJobSystem, or on the calling thread when it is not started.  Ranges are
+// at least grainSize elements and a multiple of EP_ALGORITHM_LANES, so each
+// inner loop is a plain loop over contiguous elements that vectorizes like a
+// serial one.  EpReduce, EpInclusiveScan and EpSort use at most
+// EP_ALGORITHM_MAX_BLOCKS blocks whose size depends only on the element count
+// and grainSize.  Floating point results therefore do not depend on the number
+// of workers.  Intermediate buffers come from the calling thread's temporary
+// stack.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+#include <string.h>
+
+#define EP_ALGORITHM_GRAIN 4096u // Default elements per range.
+#define EP_ALGORITHM_LANES 8u // Independent accumulators in EpReduce().
+#define EP_ALGORITHM_MAX_BLOCKS 16u
+
+// Internal.
+inline unsigned EpAlgorithmRangeSize(unsigned grainSize) {
+  return (EpMax(grainSize, 1u) + EP_ALGORITHM_LANES - 1u) & ~(EP_ALGORITHM_LANES - 1u);
+}
+
+inline unsigned EpAlgorithmBlockSize(unsigned count, unsigned grainSize) {
+  return EpAlgorithmRangeSize(EpMax(grainSize, (count + EP_ALGORITHM_MAX_BLOCKS - 1u) / EP_ALGORITHM_MAX_BLOCKS));
+}
+
+// ----------------------------------------------------------------------------
+// EpParallelForEach: Calls f(T&) for each element.
+
+template<class T, class Function>
+void EpParallelForEach(EpJobSystem& jobs, T* begin, T* end, const Function& f, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  jobs.ParallelFor(0u, (unsigned)(end - begin), EpAlgorithmRangeSize(grainSize), [&](unsigned i, unsigned j) {
+    for (T* it = begin + i, *itEnd = begin + j; it != itEnd; ++it) {
+      f(*it);
+    }
+  });
+}
+
+template<class T, unsigned MaxDim, class Function>
+void EpParallelForEach(EpJobSystem& jobs, EpArray<T, MaxDim>& a, const Function& f, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  EpParallelForEach(jobs, a.data(), a.data() + a.size(), f, grainSize);
+}
+
+// ----------------------------------------------------------------------------
+// EpTransform: out[i] = f(begin[i]).  out may be begin.
+
+template<class T, class U, class Function>
+void EpTransform(EpJobSystem& jobs, const T* begin, const T* end, U* out, const Function& f, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  jobs.ParallelFor(0u, (unsigned)(end - begin), EpAlgorithmRangeSize(grainSize), [&](unsigned i, unsigned j) {
+    for (unsigned k = i; k < j; ++k) {
+      out[k] = f(begin[k]);
+    }
+  });
+}
+
+// Resizes out.
+template<class T, unsigned MaxDim, class U, unsigned OutMaxDim, class Function>
+void EpTransform(EpJobSystem& jobs, const EpArray<T, MaxDim>& a, EpArray<U, OutMaxDim>& out, const Function& f, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  out.resize(a.size());
+  EpTransform(jobs, a.data(), a.data() + a.size(), out.data(), f, grainSize);
+}
+
+// ----------------------------------------------------------------------------
+// EpReduce: Combines init and the elements with op, which must be associative
+// and commutative.  Each block is summed in EP_ALGORITHM_LANES interleaved
+// accumulators so that the compiler may vectorize float reductions without
+// reassociating.
+
+template<class T, class Function>
+T EpReduceBlock(const T* it, unsigned count, const Function& op) {
+  unsigned i = 1u;
+  T sum = it[0];
+  if (count >= 2u * EP_ALGORITHM_LANES) {
+    T lanes[EP_ALGORITHM_LANES];
+    for (unsigned k = 0u; k < EP_ALGORITHM_LANES; ++k) {
+      lanes[k] = it[k];
+    }
+    for (i = EP_ALGORITHM_LANES; i + EP_ALGORITHM_LANES <= count; i += EP_ALGORITHM_LANES) {
+      for (unsigned k = 0u; k < EP_ALGORITHM_LANES; ++k) {
+        lanes[k] = op(lanes[k], it[i + k]);
+      }
+    }
+    sum = lanes[0];
+    for (unsigned k = 1u; k < EP_ALGORITHM_LANES; ++k) {
+      sum = op(sum, lanes[k]);
+    }
+  }
+  for (; i < count; ++i) {
+    sum = op(sum, it[i]);
+  }
+  return sum;
+}
+
+template<class T, class Function>
+T EpReduce(EpJobSystem& jobs, const T* begin, const T* end, T init, const Function& op, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  const unsigned count = (unsigned)(end - begin);
+  if (count == 0u) {
+    return init;
+  }
+  const unsigned blockSize = EpAlgorithmBlockSize(count, grainSize);
+  const unsigned blockCount = (count - 1u) / blockSize + 1u;
+  T partials[EP_ALGORITHM_MAX_BLOCKS];
+  jobs.ParallelFor(0u, blockCount, 1u, [&](unsigned first, unsigned last) {
+    for (unsigned b = first; b < last; ++b) {
+      unsigned i = b * blockSize;
+      partials[b] = EpReduceBlock(begin + i, EpMin(blockSize, count - i), op);
+    }
+  });
+
+  T sum = init;
+  for (unsigned b = 0u; b < blockCount; ++b) {
+    sum = op(sum, partials[b]);
+  }
+  return sum;
+}
+
+template<class T, unsigned MaxDim, class Function>
+T EpReduce(EpJobSystem& jobs, const EpArray<T, MaxDim>& a, T init, const Function& op, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  return EpReduce(jobs, a.data(), a.data() + a.size(), init, op, grainSize);
+}
+
+// ----------------------------------------------------------------------------
+// EpInclusiveScan: out[i] = begin[0] op ... op begin[i].  op must be
+// associative.  out may be begin.  Blocks are reduced, the block totals are
+// scanned on the calling thread and then each block is scanned from its
+// offset, reading the input twice.
+
+template<class T, class Function>
+void EpInclusiveScan(EpJobSystem& jobs, const T* begin, const T* end, T* out, const Function& op, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  const unsigned count = (unsigned)(end - begin);
+  if (count == 0u) {
+    return;
+  }
+  const unsigned blockSize = EpAlgorithmBlockSize(count, grainSize);
+  const unsigned blockCount = (count - 1u) / blockSize + 1u;
+
+  // The last block's total is not needed.
+  T partials[EP_ALGORITHM_MAX_BLOCKS];
+  jobs.ParallelFor(0u, blockCount - 1u, 1u, [&](unsigned first, unsigned last) {
+    for (unsigned b = first; b < last; ++b) {
+      const T* it = begin + b * blockSize;
+      T sum = it[0];
+      for (unsigned i = 1u; i < blockSize; ++i) {
+        sum = op(sum, it[i]);
+      }
+      partials[b] = sum;
+    }
+  });
+  for (unsigned b = 1u; b + 1u < blockCount; ++b) {
+    partials[b] = op(partials[b - 1u], partials[b]);
+  }
+
+  jobs.ParallelFor(0u, blockCount, 1u, [&](unsigned first, unsigned last) {
+    for (unsigned b = first; b < last; ++b) {
+      const unsigned offset = b * blockSize;
+      const unsigned n = EpMin(blockSize, count - offset);
+      const T* it = begin + offset;
+      T* o = out + offset;
+      T sum = b == 0u ? it[0] : op(partials[b - 1u], it[0]);
+      o[0] = sum;
+      for (unsigned i = 1u; i < n; ++i) {
+        sum = op(sum, it[i]);
+        o[i] = sum;
+      }
+    }
+  });
+}
+
+// Resizes out.
+template<class T, unsigned MaxDim, unsigned OutMaxDim, class Function>
+void EpInclusiveScan(EpJobSystem& jobs, const EpArray<T, MaxDim>& a, EpArray<T, OutMaxDim>& out, const Function& op, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  out.resize(a.size());
+  EpInclusiveScan(jobs, a.data(), a.data() + a.size(), out.data(), op, grainSize);
+}
+
+// ----------------------------------------------------------------------------
+// EpRadixKey
+//
+// Maps keys to unsigned integers with the same order.  Negative floats are
+// inverted and positive ones have the sign bit set, so -0 sorts before +0 and
+// NaNs sort to the end with their sign.
+
+template<class T> struct EpRadixKey;
+
+#define EP_RADIX_KEY_UNSIGNED(T) template<> struct EpRadixKey<T> { \
+  typedef T Bits; \
+  static EP_FORCEINLINE Bits ToBits(T t) { return t; } }
+#define EP_RADIX_KEY_SIGNED(T, U) template<> struct EpRadixKey<T> { \
+  typedef U Bits; \
+  static EP_FORCEINLINE Bits ToBits(T t) { return (U)t ^ ((U)1 << (sizeof(U) * 8u - 1u)); } }
+#define EP_RADIX_KEY_FLOAT(T, U) template<> struct EpRadixKey<T> { \
+  typedef U Bits; \
+  static EP_FORCEINLINE Bits ToBits(T t) { \
+    U u; \
+    ::memcpy(&u, &t, sizeof u); \
+    const U sign = (U)1 << (sizeof(U) * 8u - 1u); \
+    return (u & sign) ? (U)~u : (U)(u | sign); \
+  } }
+
+EP_RADIX_KEY_UNSIGNED(unsigned char);
+EP_RADIX_KEY_UNSIGNED(unsigned short);
+EP_RADIX_KEY_UNSIGNED(unsigned int);
+EP_RADIX_KEY_UNSIGNED(unsigned long);
+EP_RADIX_KEY_UNSIGNED(unsigned long long);
+EP_RADIX_KEY_SIGNED(signed char, unsigned char);
+EP_RADIX_KEY_SIGNED(short, unsigned short);
+EP_RADIX_KEY_SIGNED(int, unsigned int);
+EP_RADIX_KEY_SIGNED(long, unsigned long);
+EP_RADIX_KEY_SIGNED(long long, unsigned long long);
+EP_RADIX_KEY_FLOAT(float, uint32_t);
+EP_RADIX_KEY_FLOAT(double, uint64_t);
+
+#undef EP_RADIX_KEY_UNSIGNED
+#undef EP_RADIX_KEY_SIGNED
+#undef EP_RADIX_KEY_FLOAT
+
+// ----------------------------------------------------------------------------
+// EpSort: Least significant digit radix sort of integer or floating point
+// keys, one byte per pass.  Passes where every key has the same digit are
+// skipped.  Each pass counts digits per block in parallel, computes the
+// output position of every block's digits on the calling thread and scatters
+// in parallel.  Needs count * sizeof(T) + 1 KB per block of temporary stack,
+// beyond which it overflows to the heap with a warning.
+
+template<class T>
+void EpSort(EpJobSystem& jobs, T* begin, T* end, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  typedef EpRadixKey<T> Key;
+  const unsigned count = (unsigned)(end - begin);
+  if (count < 2u) {
+    return;
+  }
+  const unsigned blockSize = EpAlgorithmBlockSize(count, grainSize);
+  const unsigned blockCount = (count - 1u) / blockSize + 1u;
+
+  EpAllocatorScope scratchScope(EpMemoryAllocatorId_TemporaryStack);
+  T* scratch = (T*)EpMalloc(count * sizeof(T));
+  unsigned* histograms = (unsigned*)EpMalloc(blockCount * 256u * sizeof(unsigned));
+  T* src = begin;
+  T* dst = scratch;
+
+  for (unsigned shift = 0u; shift < sizeof(typename Key::Bits) * 8u; shift += 8u) {
+    jobs.ParallelFor(0u, blockCount, 1u, [&](unsigned first, unsigned last) {
+      for (unsigned b = first; b < last; ++b) {
+        unsigned* histogram = histograms + b * 256u;
+        ::memset(histogram, 0, 256u * sizeof(unsigned));
+        for (unsigned i = b * blockSize, iEnd = EpMin(i + blockSize, count); i < iEnd; ++i) {
+          ++histogram[(Key::ToBits(src[i]) >> shift) & 255u];
+        }
+      }
+    });
+
+    // Digit major and block minor, so the sort is stable.
+    bool isSorted = false;
+    unsigned total = 0u;
+    for (unsigned digit = 0u; digit < 256u; ++digit) {
+      unsigned digitTotal = total;
+      for (unsigned b = 0u; b < blockCount; ++b) {
+        unsigned* it = histograms + b * 256u + digit;
+        unsigned n = *it;
+        *it = total;
+        total += n;
+      }
+      isSorted = isSorted || total - digitTotal == count;
+    }
+    if (isSorted) {
+      continue;
+    }
+
+    jobs.ParallelFor(0u, blockCount, 1u, [&](unsigned first, unsigned last) {
+      for (unsigned b = first; b < last; ++b) {
+        unsigned* histogram = histograms + b * 256u;
+        for (unsigned i = b * blockSize, iEnd = EpMin(i + blockSize, count); i < iEnd; ++i) {
+          dst[histogram[(Key::ToBits(src[i]) >> shift) & 255u]++] = src[i];
+        }
+      }
+    });
+    EpSwap(src, dst);
+  }
+
+  if (src != begin) {
+    jobs.ParallelFor(0u, blockCount, 1u, [&](unsigned first, unsigned last) {
+      unsigned i = first * blockSize;
+      ::memcpy(begin + i, src + i, (EpMin(last * blockSize, count) - i) * sizeof(T));
+    });
+  }
+  EpFree(histograms);
+  EpFree(scratch);
+}
+
+template<class T, unsigned MaxDim>
+void EpSort(EpJobSystem& jobs, EpArray<T, MaxDim>& a, unsigned grainSize=EP_ALGORITHM_GRAIN) {
+  EpSort(jobs, a.data(), a.data() + a.size(), grainSize);
+}
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
@@ -0,0 +1,215 @@
+#include "EmbeddedPlatform.h"
+#include "EpAlgorithm.h"
+#include "EpTest.h"
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+#include <float.h>
+
+class EpAlgorithmTest :
+  public testing::Test
+{
+public:
+  enum { WORKER_COUNT = 3, ITEM_COUNT = 5000, BENCHMARK_COUNT = 4096 };
+
+  EpAlgorithmTest() {
+    s_jobSystem.Start(WORKER_COUNT);
+    m_random = 12345u;
+  }
+
+  ~EpAlgorithmTest() {
+    s_jobSystem.Stop();
+  }
+
+  unsigned Random() {
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return m_random;
+  }
+
+  // Sorted and a permutation of the original, by checksum.
+  template<class T>
+  bool IsSorted(const T* it, unsigned count, uint64_t checksum) {
+    for (unsigned i = 1u; i < count; ++i) {
+      if (it[i] < it[i - 1u]) {
+        return false;
+      }
+    }
+    return Checksum(it, count) == checksum;
+  }
+
+  // Sum of the bits of each key, which does not depend on order.
+  template<class T>
+  static uint64_t Checksum(const T* it, unsigned count) {
+    uint64_t checksum = 0u;
+    for (unsigned i = 0u; i < count; ++i) {
+      uint64_t bits = 0u;
+      ::memcpy(&bits, it + i, sizeof(T));
+      checksum += bits;
+    }
+    return checksum;
+  }
+
+  // Integer keys wrap in unsigned arithmetic instead of overflowing.
+  template<class T>
+  static T ScaleKey(unsigned random, T scale) { return (T)((uint64_t)random * (uint64_t)scale); }
+  static double ScaleKey(unsigned random, double scale) { return (double)random * scale; }
+
+  template<class T>
+  bool SortRandom(T scale) {
+    T* keys = (T*)s_keys;
+    for (unsigned i = 0u; i < (unsigned)ITEM_COUNT; ++i) {
+      keys[i] = ScaleKey(Random(), scale);
+    }
+    uint64_t checksum = Checksum(keys, ITEM_COUNT);
+    EpSort(s_jobSystem, keys, keys + ITEM_COUNT, 100u);
+    return IsSorted(keys, ITEM_COUNT, checksum);
+  }
+
+  static EpJobSystem s_jobSystem;
+  static uint64_t s_keys[ITEM_COUNT];
+  static float s_benchmark[BENCHMARK_COUNT];
+  unsigned m_random;
+};
+
+EpJobSystem EpAlgorithmTest::s_jobSystem;
+uint64_t EpAlgorithmTest::s_keys[EpAlgorithmTest::ITEM_COUNT];
+float EpAlgorithmTest::s_benchmark[EpAlgorithmTest::BENCHMARK_COUNT];
+
+TEST_F(EpAlgorithmTest, ForEachTransform) {
+  EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+  EpArray<int> a;
+  a.resize(ITEM_COUNT);
+  for (int i = 0; i < (int)ITEM_COUNT; ++i) {
+    a[i] = i;
+  }
+  EpParallelForEach(s_jobSystem, a, [](int& x) { x *= 2; }, 1u);
+
+  EpArray<float> b;
+  EpTransform(s_jobSystem, a, b, [](int x) { return (float)x + 0.5f; });
+  ASSERT_EQ(b.size(), (unsigned)ITEM_COUNT);
+  ASSERT_EQ(b[ITEM_COUNT - 1], (float)(ITEM_COUNT - 1) * 2.0f + 0.5f);
+
+  // In place over a pointer range.
+  EpTransform(s_jobSystem, b.data() + 1, b.data() + 3, b.data() + 1, [](float x) { return -x; });
+  ASSERT_EQ(b[0], 0.5f);
+  ASSERT_EQ(b[1], -2.5f);
+  ASSERT_EQ(b[2], -4.5f);
+  ASSERT_EQ(b[3], 6.5f);
+
+  EpArray<int> empty;
+  empty.reserve(1u);
+  EpParallelForEach(s_jobSystem, empty, [](int& x) { x = 0; });
+}
+
+// Float sums match with and without workers.
+TEST_F(EpAlgorithmTest, Reduce) {
+  float* values = s_benchmark;
+  for (unsigned i = 0u; i < (unsigned)BENCHMARK_COUNT; ++i) {
+    values[i] = (float)(Random() % 1000u) * 0.001f;
+  }
+  auto add = [](float x, float y) { return x + y; };
+  float sum = EpReduce(s_jobSystem, values, values + BENCHMARK_COUNT, 1.0f, add, 100u);
+  float serialSum = 1.0f;
+  for (unsigned i = 0u; i < (unsigned)BENCHMARK_COUNT; ++i) {
+    serialSum += values[i];
+  }
+  ASSERT_NEAR(sum, serialSum, 0.01f);
+
+  float maxValue = EpReduce(s_jobSystem, values, values + 7, -1.0f, [](float x, float y) { return EpMax(x, y); });
+  ASSERT_GE(maxValue, 0.0f);
+  ASSERT_EQ(EpReduce(s_jobSystem, values, values, 3.0f, add), 3.0f);
+
+  s_jobSystem.Stop();
+  ASSERT_TRUE(sum == EpReduce(s_jobSystem, values, values + BENCHMARK_COUNT, 1.0f, add, 100u));
+}
+
+TEST_F(EpAlgorithmTest, InclusiveScan) {
+  EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+  EpArray<unsigned> a;
+  a.resize(ITEM_COUNT);
+  for (unsigned i = 0u; i < (unsigned)ITEM_COUNT; ++i) {
+    a[i] = Random() % 100u;
+  }
+  EpArray<unsigned> out;
+  EpInclusiveScan(s_jobSystem, a, out, [](unsigned x, unsigned y) { return x + y; }, 64u);
+
+  bool isExpected = true;
+  unsigned sum = 0u;
+  for (unsigned i = 0u; i < (unsigned)ITEM_COUNT; ++i) {
+    sum += a[i];
+    isExpected = isExpected && out[i] == sum;
+  }
+  ASSERT_TRUE(isExpected);
+
+  // In place with a running maximum.
+  a[ITEM_COUNT / 2] = 1000u;
+  EpInclusiveScan(s_jobSystem, a.data(), a.data() + ITEM_COUNT, a.data(), [](unsigned x, unsigned y) { return EpMax(x, y); }, 1u);
+  ASSERT_EQ(a[ITEM_COUNT / 2 - 1], 99u);
+  ASSERT_EQ(a[ITEM_COUNT / 2], 1000u);
+  ASSERT_EQ(a[ITEM_COUNT - 1], 1000u);
+}
+
+TEST_F(EpAlgorithmTest, Sort) {
+  ASSERT_TRUE(SortRandom<uint32_t>(1u));
+  ASSERT_TRUE(SortRandom<uint32_t>(0u)); // Every pass skipped.
+  ASSERT_TRUE(SortRandom<int>(1)); // Negative too.
+  ASSERT_TRUE(SortRandom<unsigned char>(1u));
+  ASSERT_TRUE(SortRandom<short>(1));
+  ASSERT_TRUE(SortRandom<uint64_t>(0x100000001ull));
+  ASSERT_TRUE(SortRandom<long long>(-0x100000001ll));
+  ASSERT_TRUE(SortRandom<double>(-1.0e-3));
+
+  // Keys under 256 need one pass, so the result is copied back from scratch.
+  unsigned* keys = (unsigned*)s_keys;
+  for (unsigned i = 0u; i < (unsigned)ITEM_COUNT; ++i) {
+    keys[i] = Random() & 255u;
+  }
+  uint64_t checksum = Checksum(keys, ITEM_COUNT);
+  EpSort(s_jobSystem, keys, keys + ITEM_COUNT);
+  ASSERT_TRUE(IsSorted(keys, ITEM_COUNT, checksum));
+
+  float* floats = (float*)s_keys;
+  for (unsigned i = 0u; i < (unsigned)ITEM_COUNT; ++i) {
+    floats[i] = (float)(int)(Random() % 2001u - 1000u) * 0.25f;
+  }
+  floats[3] = FLT_MAX * 2.0f;
+  floats[4] = -FLT_MAX * 2.0f;
+  floats[5] = -0.0f;
+  checksum = Checksum(floats, ITEM_COUNT);
+  EpSort(s_jobSystem, floats, floats + ITEM_COUNT);
+  ASSERT_TRUE(IsSorted(floats, ITEM_COUNT, checksum));
+  ASSERT_EQ(floats[0], -FLT_MAX * 2.0f);
+  ASSERT_EQ(floats[ITEM_COUNT - 1], FLT_MAX * 2.0f);
+
+  EpSort(s_jobSystem, floats, floats + 1);
+  EpSort(s_jobSystem, floats, floats);
+}
+
+BENCHMARK_F(EpAlgorithmTest, ReduceBenchmark) {
+  for (unsigned i = 0u; i < (unsigned)BENCHMARK_COUNT; ++i) {
+    s_benchmark[i] = (float)i;
+  }
+  float sum = 0.0f;
+  while (state.KeepRunning()) {
+    sum = EpReduce(s_jobSystem, s_benchmark, s_benchmark + BENCHMARK_COUNT, 0.0f, [](float x, float y) { return x + y; });
+    EpBenchmarkDoNotOptimize(sum);
+  }
+  state.SetBytesPerIteration(sizeof s_benchmark);
+  ASSERT_EQ(sum, (float)BENCHMARK_COUNT * (BENCHMARK_COUNT - 1) / 2.0f);
+}
+
+// Includes refilling the keys.
+BENCHMARK_F(EpAlgorithmTest, SortBenchmark) {
+  while (state.KeepRunning()) {
+    for (unsigned i = 0u; i < (unsigned)BENCHMARK_COUNT; ++i) {
+      s_benchmark[i] = (float)Random();
+    }
+    EpSort(s_jobSystem, s_benchmark, s_benchmark + BENCHMARK_COUNT);
+  }
+  state.SetBytesPerIteration(sizeof s_benchmark);
+  ASSERT_TRUE(IsSorted(s_benchmark, BENCHMARK_COUNT, Checksum(s_benchmark, BENCHMARK_COUNT)));
+}
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
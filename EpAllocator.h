@@ -5,20 +5,86 @@
 #include "EpDma.h"
 #include "EpSettings.h"
 
+#include <new>
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+#include <type_traits>
+#endif
+
 #define EpAllocatorMode_Dynamic     0u  // Dynamically allocated
+#define EpAllocatorMode_SmallFlag   0x80000000u
+#define EpAllocatorMode_Small(n)    (EpAllocatorMode_SmallFlag | (unsigned)(n)) // n inline, then spills
+#define EpAllocatorMode_VirtualFlag 0x40000000u
+#define EpAllocatorMode_Mask        (EpAllocatorMode_SmallFlag | EpAllocatorMode_VirtualFlag)
+
+// EpAllocatorMode_Virtual requires POSIX virtual memory and is not defined
+// without it.
+#if defined(EP_BUILD_SOFTWARE) && (defined(__unix__) || defined(__APPLE__))
+#define EP_ALLOCATOR_VIRTUAL 1
+#else
+#define EP_ALLOCATOR_VIRTUAL 0
+#endif
+
+#if (EP_ALLOCATOR_VIRTUAL==1)
+#define EpAllocatorMode_Virtual     EpAllocatorMode_VirtualFlag // Commits reserved pages as needed
+
+// Address space reserved by each virtual allocator and the granularity it is
+// committed in.  16GB with 64-bit pointers, 256MB with 32-bit.
+#define EP_ALLOCATOR_VIRTUAL_RESERVE ((size_t)1 << (sizeof(void*) > 4u ? 34 : 28))
+#define EP_ALLOCATOR_VIRTUAL_COMMIT  ((size_t)64 * 1024)
+
+// See EpMemoryManager.cpp.  Reserve returns NULL on failure.
+void* EpVirtualReserve(size_t bytes);
+void EpVirtualCommit(void* ptr, size_t bytes);
+void EpVirtualRelease(void* ptr, size_t bytes);
+#endif
+
+// ----------------------------------------------------------------------------
+// EpIsTriviallyCopyable, EpIsTrivial
+//
+// Containers copy trivially copyable types with memcpy and skip destructing
+// them.  Trivial types are also left uninitialized when default constructed.
+// The C++98 build only recognizes built in types and pointers.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+template<class T> struct EpIsTriviallyCopyable { enum { value = std::is_trivially_copyable<T>::value }; };
+template<class T> struct EpIsTrivial { enum { value = std::is_trivial<T>::value }; };
+#else
+template<class T> struct EpIsTriviallyCopyable { enum { value = 0 }; };
+template<class T> struct EpIsTriviallyCopyable<T*> { enum { value = 1 }; };
+#define EP_TRIVIALLY_COPYABLE(T) template<> struct EpIsTriviallyCopyable<T> { enum { value = 1 }; }
+EP_TRIVIALLY_COPYABLE(bool);
+EP_TRIVIALLY_COPYABLE(char);
+EP_TRIVIALLY_COPYABLE(signed char);
+EP_TRIVIALLY_COPYABLE(unsigned char);
+EP_TRIVIALLY_COPYABLE(short);
+EP_TRIVIALLY_COPYABLE(unsigned short);
+EP_TRIVIALLY_COPYABLE(int);
+EP_TRIVIALLY_COPYABLE(unsigned int);
+EP_TRIVIALLY_COPYABLE(long);
+EP_TRIVIALLY_COPYABLE(unsigned long);
+EP_TRIVIALLY_COPYABLE(long long);
+EP_TRIVIALLY_COPYABLE(unsigned long long);
+EP_TRIVIALLY_COPYABLE(float);
+EP_TRIVIALLY_COPYABLE(double);
+#undef EP_TRIVIALLY_COPYABLE
+template<class T> struct EpIsTrivial { enum { value = EpIsTriviallyCopyable<T>::value }; };
+#endif
 
 // ----------------------------------------------------------------------------
 // EpAllocator
 //
 // Static allocation for known capacities, dynamic allocation otherwise.
+// IS_GROWABLE is set when Reserve(c, used) may relocate existing contents.  The
+// first used elements are relocated, the rest of the old storage is discarded.
 
-template<class T, unsigned Capacity>
+template<class T, unsigned Capacity, unsigned Mode=(Capacity & EpAllocatorMode_Mask)>
 struct EpAllocator {
 public:
   static_assert(Capacity > 0u, "Capacity > 0");
+  enum { IS_GROWABLE = 0 };
   EP_FORCEINLINE EpAllocator() {
     if (EpIsDebug()) {
       ::memset(m_storage, 0xab, sizeof(T) * Capacity);
@@ -26,11 +92,14 @@ public:
   }
 
   // Because Reserve() will not actually reallocate it is also used to ensure initial capacity.
-  EP_FORCEINLINE void Reserve(unsigned size) { EpReleaseAssertMsg(size <= Capacity, "EpAllocator: Overflowing fixed capacity."); }
+  EP_FORCEINLINE void Reserve(unsigned size, unsigned=0u) { EpReleaseAssertMsg(size <= Capacity, "EpAllocator: Overflowing fixed capacity."); }
   EP_FORCEINLINE unsigned GetCapacity() const { return Capacity; }
   EP_FORCEINLINE T* GetStorage() const { return (T*)(unsigned*)m_storage; }
   EP_FORCEINLINE T* GetStorageNoReadWrite() const { return (T*)(unsigned*)m_storage; }
 
+  // Fixed storage cannot change hands.
+  EP_FORCEINLINE bool Swap(EpAllocator&) { return false; }
+
 private:
   // Force 32-bit alignment
   unsigned m_storage[(Capacity * sizeof(T) + 3) >> 2];
@@ -40,6 +109,7 @@ private:
 template<class T>
 struct EpAllocator<T, EpAllocatorMode_Dynamic> {
 public:
+  enum { IS_GROWABLE = 0 };
   EP_FORCEINLINE EpAllocator() {
     m_storage = NULL;
     m_capacity = 0;
@@ -54,21 +124,175 @@ public:
   }
 
   // Because Reserve() will not actually reallocate it is also used to ensure initial capacity.
-  EP_FORCEINLINE void Reserve(unsigned c) {
+  EP_FORCEINLINE void Reserve(unsigned c, unsigned=0u) {
     if (c <= m_capacity) { return; }
     EpReleaseAssertMsg(m_capacity == 0, "EpAllocator: Reallocation disallowed.");
     m_storage = EpAliasingCast<T>(EpMalloc(sizeof(T) * c));
     EpReleaseAssertMsg(m_storage != 0, "EpAllocator: Allocation failure"); // Must never fail.
     m_capacity = c;
     if (EpIsDebug()) {
-      ::memset(m_storage, 0xab, sizeof(T) * c);
+      ::memset((void*)m_storage, 0xab, sizeof(T) * c);
     }
   }
 
   EP_FORCEINLINE unsigned GetCapacity() const { return m_capacity; }
   EP_FORCEINLINE T* GetStorage() const { return m_storage; }
 
+  // Exchanges storage without touching the contents.  Returns true.
+  EP_FORCEINLINE bool Swap(EpAllocator& rhs) {
+    unsigned capacity = m_capacity;
+    T* storage = m_storage;
+    m_capacity = rhs.m_capacity;
+    m_storage = rhs.m_storage;
+    rhs.m_capacity = capacity;
+    rhs.m_storage = storage;
+    return true;
+  }
+
 protected:
   unsigned m_capacity;
   T* m_storage;
 };
+
+// ----------------------------------------------------------------------------
+// Small buffer mode: EpAllocator<T, EpAllocatorMode_Small(N)>
+//
+// Starts with N elements inline.  Reserve() beyond the current capacity spills
+// to the allocator of the current EpAllocatorScope, typically the temp stack,
+// at least doubling the capacity each time.  Trivially copyable contents are
+// relocated with memcpy, others are move constructed and destroyed.
+
+template<class T, unsigned Capacity>
+struct EpAllocator<T, Capacity, EpAllocatorMode_SmallFlag> {
+public:
+  enum { INLINE_CAPACITY = Capacity & ~EpAllocatorMode_SmallFlag, IS_GROWABLE = 1 };
+  static_assert(INLINE_CAPACITY > 0u, "Capacity > 0");
+
+  EP_FORCEINLINE EpAllocator() {
+    m_storage = (T*)(unsigned*)m_inline;
+    m_capacity = INLINE_CAPACITY;
+    if (EpIsDebug()) {
+      ::memset(m_inline, 0xab, sizeof(T) * INLINE_CAPACITY);
+    }
+  }
+
+  EP_FORCEINLINE ~EpAllocator() {
+    if (IsSpilled()) {
+      EpFree(m_storage);
+    }
+  }
+
+  EP_FORCEINLINE void Reserve(unsigned c, unsigned used=0u) {
+    if (c <= m_capacity) { return; }
+    EpAssert(used <= m_capacity);
+    unsigned capacity = EpMax(c, m_capacity * 2u);
+    T* storage = EpAliasingCast<T>(EpMalloc(sizeof(T) * capacity));
+    EpReleaseAssertMsg(storage != 0, "EpAllocator: Allocation failure"); // Must never fail.
+    if (EpIsTriviallyCopyable<T>::value) {
+      ::memcpy((void*)storage, m_storage, sizeof(T) * used);
+    } else {
+      for (unsigned i = 0u; i < used; ++i) {
+        ::new (storage + i) T(EpMove(m_storage[i]));
+        m_storage[i].~T();
+      }
+    }
+    if (EpIsDebug()) {
+      ::memset((void*)(storage + used), 0xab, sizeof(T) * (capacity - used));
+    }
+    if (IsSpilled()) {
+      EpFree(m_storage);
+    }
+    m_storage = storage;
+    m_capacity = capacity;
+  }
+
+  EP_FORCEINLINE unsigned GetCapacity() const { return m_capacity; }
+  EP_FORCEINLINE T* GetStorage() const { return m_storage; }
+  EP_FORCEINLINE bool IsSpilled() const { return m_storage != (T*)(unsigned*)m_inline; }
+
+  // Only spilled storage can change hands.
+  EP_FORCEINLINE bool Swap(EpAllocator& rhs) {
+    if (!IsSpilled() || !rhs.IsSpilled()) {
+      return false;
+    }
+    unsigned capacity = m_capacity;
+    T* storage = m_storage;
+    m_capacity = rhs.m_capacity;
+    m_storage = rhs.m_storage;
+    rhs.m_capacity = capacity;
+    rhs.m_storage = storage;
+    return true;
+  }
+
+private:
+  EpAllocator(const EpAllocator&);
+  void operator=(const EpAllocator&);
+
+  unsigned m_capacity;
+  T* m_storage;
+  // Force 32-bit alignment
+  unsigned m_inline[(INLINE_CAPACITY * sizeof(T) + 3) >> 2];
+};
+
+// ----------------------------------------------------------------------------
+// Virtual mode: EpAllocator<T, EpAllocatorMode_Virtual>
+//
+// Reserves EP_ALLOCATOR_VIRTUAL_RESERVE bytes of address space on first use
+// and commits it in EP_ALLOCATOR_VIRTUAL_COMMIT steps as Reserve() grows.
+// Storage never moves, so pointers to elements stay valid.  Host only, and
+// not counted by the allocator scopes.
+
+#if (EP_ALLOCATOR_VIRTUAL==1)
+template<class T, unsigned Capacity>
+struct EpAllocator<T, Capacity, EpAllocatorMode_VirtualFlag> {
+public:
+  enum { IS_GROWABLE = 1 };
+
+  EP_FORCEINLINE EpAllocator() {
+    m_storage = NULL;
+    m_capacity = 0;
+    m_committedBytes = 0;
+  }
+
+  EP_FORCEINLINE ~EpAllocator() {
+    if (m_storage) {
+      EpVirtualRelease(m_storage, EP_ALLOCATOR_VIRTUAL_RESERVE);
+    }
+  }
+
+  EP_FORCEINLINE void Reserve(unsigned c, unsigned=0u) {
+    if (c <= m_capacity) { return; }
+    if (m_storage == NULL) {
+      m_storage = (T*)EpVirtualReserve(EP_ALLOCATOR_VIRTUAL_RESERVE);
+      EpReleaseAssertMsg(m_storage != 0, "EpAllocator: Address space reservation failure");
+    }
+    size_t bytes = ((size_t)c * sizeof(T) + EP_ALLOCATOR_VIRTUAL_COMMIT - 1u) & ~(EP_ALLOCATOR_VIRTUAL_COMMIT - 1u);
+    EpReleaseAssertMsg(bytes <= EP_ALLOCATOR_VIRTUAL_RESERVE, "EpAllocator: Overflowing virtual reservation.");
+    EpVirtualCommit((char*)m_storage + m_committedBytes, bytes - m_committedBytes);
+    if (EpIsDebug()) {
+      ::memset((char*)m_storage + m_committedBytes, 0xab, bytes - m_committedBytes);
+    }
+    m_committedBytes = bytes;
+    m_capacity = (unsigned)EpMin(bytes / sizeof(T), (size_t)0xffffffffu);
+  }
+
+  EP_FORCEINLINE unsigned GetCapacity() const { return m_capacity; }
+  EP_FORCEINLINE T* GetStorage() const { return m_storage; }
+
+  // Exchanges storage without touching the contents.  Returns true.
+  EP_FORCEINLINE bool Swap(EpAllocator& rhs) {
+    EpSwap(m_capacity, rhs.m_capacity);
+    EpSwap(m_storage, rhs.m_storage);
+    EpSwap(m_committedBytes, rhs.m_committedBytes);
+    return true;
+  }
+
+private:
+  EpAllocator(const EpAllocator&);
+  void operator=(const EpAllocator&);
+
+  unsigned m_capacity;
+  T* m_storage;
+  size_t m_committedBytes;
+};
+#endif // (EP_ALLOCATOR_VIRTUAL==1)
@@ -11,6 +11,12 @@ void EpMemoryManagementInit();
 void EpMemoryManagementShutDown();
 void EpMemoryManagementLog();
 
+// Gives the calling thread its own temporary stack in the buffer provided,
+// which must be aligned for EpMalloc().  It becomes the thread's current
+// allocator.  The other allocators are only for the main thread.
+void EpMemoryManagementThreadInit(void* temporaryStack, size_t size);
+void EpMemoryManagementThreadShutDown();
+
 // ----------------------------------------------------------------------------
 // EpAllocatorScope (See EpMemoryManager.cpp)
 //
@@ -44,9 +50,60 @@ public:
   uintptr_t GetPreviousAllocationCount() const { return m_previousAllocationCount; }
   uintptr_t GetPreviousBytesAllocated() const { return m_previousBytesAllocated; }
 
+  // Allocations from any allocator since construction.  Frees are not subtracted.
+  uintptr_t GetScopeAllocationsMade() const;
+
 private:
   EpMemoryAllocatorId m_thisId;
   EpMemoryAllocatorId m_previousId;
   uintptr_t m_previousAllocationCount;
   uintptr_t m_previousBytesAllocated;
+  uintptr_t m_previousAllocationsMade;
+};
+
+// ----------------------------------------------------------------------------
+// EpAllocationTracker (See EpMemoryManager.cpp)
+//
+// Counts allocations by the allocator that provided them while in scope, so
+// overflow from a full allocator counts as EpMemoryAllocatorId_Heap.  The
+// call stacks of the first MAX_CALL_SITES allocations are kept for
+// LogCallSites().  Trackers nest and each counts everything in its scope.
+// Only allocations by the thread that created the tracker are counted.
+
+class EpAllocationTracker
+{
+public:
+  enum { MAX_CALL_SITES = 8, MAX_FRAMES = 8 };
+
+  EpAllocationTracker();
+  ~EpAllocationTracker();
+
+  uintptr_t GetAllocationCount() const;
+  uintptr_t GetBytesAllocated() const;
+  uintptr_t GetAllocationCount(EpMemoryAllocatorId id) const { return m_allocationCounts[id]; }
+  uintptr_t GetBytesAllocated(EpMemoryAllocatorId id) const { return m_bytesAllocated[id]; }
+
+  // Logs each recorded allocation with its call stack.  Uses backtrace()
+  // where available and the immediate caller otherwise.
+  void LogCallSites() const;
+
+  // Called by the memory manager.
+  static void OnAllocate(EpMemoryAllocatorId id, size_t size);
+
+private:
+  EpAllocationTracker(const EpAllocationTracker&);
+  void operator=(const EpAllocationTracker&);
+
+  struct CallSite {
+    EpMemoryAllocatorId id;
+    size_t size;
+    int frameCount;
+    void* frames[MAX_FRAMES];
+  };
+
+  EpAllocationTracker* m_previous;
+  uintptr_t m_allocationCounts[EpMemoryAllocatorId_MAX];
+  uintptr_t m_bytesAllocated[EpMemoryAllocatorId_MAX];
+  unsigned m_callSiteCount;
+  CallSite m_callSites[MAX_CALL_SITES];
 };
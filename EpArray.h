@@ -8,7 +8,8 @@
 // EpArray
 //
 // Requires a default constructor.
-// Inherits Reserve(size), GetCapacity() and "T GetStorage()[Capacity]".
+// Inherits Reserve(size, used), GetCapacity() and "T GetStorage()[Capacity]".
+// EpArray<T, EpAllocatorMode_Small(N)> spills past N instead of asserting.
 
 template<class T, unsigned MaxDim=EpAllocatorMode_Dynamic>
 struct EpArray : private EpAllocator<T, MaxDim> {
@@ -20,7 +21,7 @@ public:
   // m_end will be 0 if MaxDim is 0.
   EP_FORCEINLINE EpArray() { m_end = this->GetStorage(); }
 
-  EP_FORCEINLINE EpArray(const EpArray& rhs) {
+  EP_FORCEINLINE EpArray(const EpArray& rhs) : allocator_type() {
     m_end = 0;
     assign(rhs.begin(), rhs.end());
   }
@@ -31,6 +32,20 @@ public:
     assign(rhs.begin(), rhs.end());
   }
 
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+  // Dynamic storage is taken from rhs.  Fixed storage moves each element.
+  EP_FORCEINLINE EpArray(EpArray&& rhs) {
+    m_end = this->GetStorage();
+    Move(rhs);
+  }
+
+  EP_FORCEINLINE void operator=(EpArray&& rhs) {
+    if (this != &rhs) {
+      Move(rhs);
+    }
+  }
+#endif
+
   EP_FORCEINLINE ~EpArray() {
     this->Destruct(this->GetStorage(), m_end);
   }
@@ -68,9 +83,12 @@ public:
   }
 
   EP_FORCEINLINE void reserve(unsigned c) {
-    this->Reserve(c);
+    T* storage = this->GetStorage();
+    this->Reserve(c, m_end ? (unsigned)(m_end - storage) : 0u);
     if (m_end == 0) {
       m_end = this->GetStorage();
+    } else {
+      m_end = this->GetStorage() + (m_end - storage); // Growable storage relocates.
     }
   }
 
@@ -94,10 +112,40 @@ public:
   }
 
   EP_FORCEINLINE void push_back(const T& t) {
+    if (allocator_type::IS_GROWABLE && full()) {
+      T copy(t); // t may be an element.
+      Grow();
+      ::new (m_end++) T(EpMove(copy));
+      return;
+    }
     EpAssert(size() < capacity());
     ::new (m_end++) T(t);
   }
 
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+  EP_FORCEINLINE void push_back(T&& t) {
+    if (allocator_type::IS_GROWABLE && full()) {
+      T copy(EpMove(t));
+      Grow();
+      ::new (m_end++) T(EpMove(copy));
+      return;
+    }
+    EpAssert(size() < capacity());
+    ::new (m_end++) T(EpMove(t));
+  }
+
+  template <class... Args>
+  EP_FORCEINLINE T& emplace_back(Args&&... args) {
+    if (allocator_type::IS_GROWABLE && full()) {
+      T copy(EpForward<Args>(args)...);
+      Grow();
+      return *::new (m_end++) T(EpMove(copy));
+    }
+    EpAssert(size() < capacity());
+    return *::new (m_end++) T(EpForward<Args>(args)...);
+  }
+#endif
+
   EP_FORCEINLINE void pop_back() {
     EpAssert(size());
     (--m_end)->~T();
@@ -108,8 +156,7 @@ public:
     reserve((unsigned)(end - begin));
     T* it = this->GetStorage();
     this->Destruct(it, m_end);
-    while (begin != end) { ::new (it++) T(*begin++); }
-    m_end = it;
+    m_end = CopyConstruct(it, begin, end);
   }
 
   // --------------------------------------------------------------------------
@@ -123,6 +170,9 @@ public:
 
   // Returns pointer for use with placement new.
   EP_FORCEINLINE void* emplace_back_raw() {
+    if (allocator_type::IS_GROWABLE && full()) {
+      Grow();
+    }
     EpAssert(size() < capacity());
     return (void*)m_end++;
   }
@@ -132,7 +182,7 @@ public:
     EpAssert(index < size());
     T* it = this->GetStorage() + index;
     if (it != --m_end) {
-      *it = *m_end;
+      *it = EpMove(*m_end);
     }
     m_end->~T();
   }
@@ -141,23 +191,80 @@ public:
   EP_FORCEINLINE void erase_unordered(T* it) {
     EpAssert((unsigned)(it - this->GetStorage()) < size());
     if (it != --m_end) {
-      *it = *m_end;
+      *it = EpMove(*m_end);
     }
     m_end->~T();
   }
 
-  EP_FORCEINLINE bool full() {
+  EP_FORCEINLINE bool full() const {
     return size() == capacity();
   }
 
 private:
+  // Capacity grows according to the allocator.
+  EP_FORCEINLINE void Grow() {
+    reserve(capacity() + 1u);
+  }
+
+  EP_FORCEINLINE void Move(EpArray& rhs) {
+    this->Destruct(this->GetStorage(), m_end);
+    m_end = this->GetStorage();
+    T* rhsEnd = rhs.m_end;
+    if (this->Swap(rhs)) {
+      // rhs now holds the old storage, which has been destructed.
+      m_end = rhsEnd;
+      rhs.m_end = rhs.GetStorage();
+      return;
+    }
+
+    reserve((unsigned)(rhsEnd - rhs.GetStorage()));
+    T* it = this->GetStorage();
+    if (EpIsTriviallyCopyable<T>::value) {
+      ::memcpy((void*)it, rhs.begin(), (size_t)(rhsEnd - rhs.begin()) * sizeof(T));
+      it += rhsEnd - rhs.begin();
+    } else {
+      for (T* rhsIt = rhs.begin(); rhsIt != rhsEnd; ++rhsIt) {
+        ::new (it++) T(EpMove(*rhsIt));
+      }
+    }
+    m_end = it;
+    rhs.clear();
+  }
+
+  // Returns the new end.  Pointers to T are copied with memcpy when possible.
+  EP_FORCEINLINE static T* CopyConstruct(T* it, const T* begin, const T* end) {
+    if (EpIsTriviallyCopyable<T>::value) {
+      ::memcpy((void*)it, begin, (size_t)(end - begin) * sizeof(T));
+      return it + (end - begin);
+    }
+    while (begin != end) { ::new (it++) T(*begin++); }
+    return it;
+  }
+
+  EP_FORCEINLINE static T* CopyConstruct(T* it, T* begin, T* end) {
+    return CopyConstruct(it, (const T*)begin, (const T*)end);
+  }
+
+  template <class Iter>
+  EP_FORCEINLINE static T* CopyConstruct(T* it, Iter begin, Iter end) {
+    while (begin != end) { ::new (it++) T(*begin++); }
+    return it;
+  }
+
+  // Trivial types are left uninitialized, as by "new T".
   EP_FORCEINLINE void Construct(T* begin, T* end) {
+    if (EpIsTrivial<T>::value) {
+      return;
+    }
     while (begin != end) {
       ::new (begin++) T;
     }
   }
 
   EP_FORCEINLINE void Destruct(T* begin, T* end) {
+    if (EpIsTriviallyCopyable<T>::value) {
+      return;
+    }
     while (begin != end) {
       (begin++)->~T();
     }
@@ -1,6 +1,7 @@
 #include "EmbeddedPlatform.h"
 #include "EpArray.h"
 #include "EpUniquePtr.h"
+#include "EpProfiler.h"
 #include "EpTest.h"
 #include <limits.h>
 
@@ -21,6 +22,14 @@ public:
       ++s_currentTest->m_constructed;
       id = rhs.id;
     }
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+    TestObject(TestObject&& rhs) {
+      ++s_currentTest->m_constructed;
+      ++s_currentTest->m_moved;
+      id = rhs.id;
+      rhs.id = 0;
+    }
+#endif
     explicit TestObject(int x) {
       EpAssert(x >= 0); // User supplied IDs are positive
       ++s_currentTest->m_constructed;
@@ -44,6 +53,7 @@ public:
   EpArrayTest() {
     m_constructed = 0;
     m_destructed = 0;
+    m_moved = 0;
     m_nextId = -1;
     s_currentTest = this;
   }
@@ -57,6 +67,7 @@ public:
 
   int m_constructed;
   int m_destructed;
+  int m_moved;
   int m_nextId;
 };
 
@@ -257,3 +268,292 @@ TEST_F(EpArrayTest, UniquePtr) {
 
   ASSERT_TRUE(CheckTotals(4));
 }
+
+TEST_F(EpArrayTest, SmallBuffer) {
+  {
+    EpArray<TestObject, EpAllocatorMode_Small(2u)> objs;
+    ASSERT_EQ(objs.capacity(), 2u);
+    objs.push_back(TestObject(1));
+    objs.push_back(TestObject(2));
+    ASSERT_FALSE(objs.get_allocator().IsSpilled());
+
+    // Spills to the current scope, doubling the capacity.
+    int moved = m_moved;
+    objs.push_back(objs[0]);
+    ASSERT_TRUE(objs.get_allocator().IsSpilled());
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+    ASSERT_EQ(m_moved, moved + 3); // Both elements are relocated, then the copy.
+#else
+    (void)moved;
+#endif
+    ASSERT_EQ(objs.capacity(), 4u);
+    ASSERT_EQ(objs.size(), 3u);
+    ASSERT_EQ(objs[0].id, 1);
+    ASSERT_EQ(objs[1].id, 2);
+    ASSERT_EQ(objs[2].id, 1);
+
+    objs.resize(9u);
+    ASSERT_EQ(objs.capacity(), 9u);
+    ASSERT_EQ(objs[1].id, 2);
+
+    EpArray<TestObject, EpAllocatorMode_Small(2u)> copy(objs);
+    ASSERT_EQ(copy.size(), 9u);
+    ASSERT_EQ(copy[2].id, 1);
+  }
+
+  ASSERT_EQ(m_constructed, m_destructed);
+}
+
+// Reserved and fixed arrays do not allocate in the loop.
+TEST_F(EpArrayTest, NoAllocations) {
+  {
+    EpArray<TestObject> objsDynamic;
+    objsDynamic.reserve(16u);
+    EpArray<TestObject, 16u> objsStatic;
+    {
+      EpExpectNoAllocations();
+      for (int i = 0; i < 16; ++i) {
+        objsDynamic.push_back(TestObject(i));
+        objsStatic.push_back(TestObject(i));
+      }
+    }
+    ASSERT_ALLOCATIONS_LE(1u, 16u * sizeof(TestObject));
+  }
+
+  // Spilling from the small buffer is counted by the allocator that provided it.
+  EpAllocationTracker tracker;
+  {
+    EpArray<TestObject, EpAllocatorMode_Small(2u)> objs;
+    objs.resize(2u);
+    ASSERT_EQ(tracker.GetAllocationCount(), 0u);
+    objs.resize(3u);
+    ASSERT_EQ(tracker.GetAllocationCount(EpMemoryAllocatorId_TemporaryStack), 1u);
+    ASSERT_EQ(tracker.GetBytesAllocated(), 4u * sizeof(TestObject));
+
+    EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+    EpExpectNoHeapAllocations();
+    objs.resize(4u);
+  }
+  ASSERT_EQ(tracker.GetAllocationCount(EpMemoryAllocatorId_Heap), 0u);
+  ASSERT_EQ(m_constructed, m_destructed);
+}
+
+#if (EP_ALLOCATOR_VIRTUAL==1)
+TEST_F(EpArrayTest, Virtual) {
+  {
+    EpArray<TestObject, EpAllocatorMode_Virtual> objs;
+    objs.reserve(1u);
+    ASSERT_EQ(objs.capacity(), (unsigned)(EP_ALLOCATOR_VIRTUAL_COMMIT / sizeof(TestObject)));
+    objs.push_back(TestObject(7));
+    TestObject* first = &objs[0];
+
+    // Grows across many commits without moving.
+    const unsigned count = 100000u;
+    for (unsigned i = 1u; i < count; ++i) {
+      objs.push_back(TestObject((int)i));
+    }
+    ASSERT_TRUE((&objs[0] == first));
+    ASSERT_EQ(objs.size(), count);
+    ASSERT_EQ(objs[0].id, 7);
+    ASSERT_EQ(objs[count - 1u].id, (int)count - 1);
+  }
+
+  ASSERT_EQ(m_constructed, m_destructed);
+}
+#endif
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+TEST_F(EpArrayTest, UniquePtrDeleter) {
+  typedef EpUniquePtr<TestObject, EpAllocatorDelete<TestObject, EpMemoryAllocatorId_TemporaryStack> > TempPtr;
+  ASSERT_EQ(sizeof(TempPtr), sizeof(TestObject*));
+  ASSERT_EQ(sizeof(EpUniquePtr<TestObject>), sizeof(TestObject*));
+
+  {
+    EpAllocatorScope scope(EpMemoryAllocatorId_TemporaryStack);
+    TempPtr p0 = EpMakeUnique<TestObject, EpMemoryAllocatorId_TemporaryStack>(3);
+    ASSERT_EQ(p0->id, 3);
+    ASSERT_EQ(scope.GetScopeAllocationCount(), 1u);
+
+    TempPtr p1(EpMove(p0));
+    ASSERT_FALSE(p0);
+    ASSERT_EQ(p1->id, 3);
+
+    p1.reset();
+    ASSERT_EQ(scope.GetScopeAllocationCount(), 0u); // Freed directly to the stack.
+  }
+
+  {
+    EpUniquePtr<TestObject> p0 = EpMakeUnique<TestObject>(EpMemoryAllocatorId_Heap, 4);
+    EpUniquePtr<TestObject> p1;
+    p1 = EpMove(p0);
+    ASSERT_EQ(p1->id, 4);
+  }
+
+  ASSERT_TRUE(CheckTotals(2));
+}
+
+TEST_F(EpArrayTest, Move) {
+  {
+    EpArray<TestObject> objs;
+    objs.reserve(4u);
+    objs.emplace_back(10);
+    objs.emplace_back(11);
+    ASSERT_EQ(m_constructed, 2);
+    ASSERT_EQ(m_moved, 0);
+
+    // Dynamic storage changes hands without touching the elements.
+    TestObject* storage = objs.begin();
+    EpArray<TestObject> objs2(EpMove(objs));
+    ASSERT_TRUE((objs2.begin() == storage));
+    ASSERT_EQ(objs2.size(), 2u);
+    ASSERT_TRUE(objs.empty());
+    ASSERT_EQ(objs.capacity(), 0u);
+    ASSERT_EQ(m_constructed, 2);
+
+    EpArray<TestObject> objs3;
+    objs3.reserve(1u);
+    objs3.push_back(TestObject(20));
+    objs3 = EpMove(objs2);
+    ASSERT_TRUE((objs3.begin() == storage));
+    ASSERT_EQ(objs3[1].id, 11);
+    ASSERT_TRUE(objs2.empty());
+
+    // Fixed storage moves each element.
+    EpArray<TestObject, 4u> objs4;
+    objs4.push_back(TestObject(30));
+    objs4.push_back(TestObject(31));
+    int moved = m_moved;
+    EpArray<TestObject, 4u> objs5(EpMove(objs4));
+    ASSERT_EQ(m_moved, moved + 2);
+    ASSERT_EQ(objs5[0].id, 30);
+    ASSERT_EQ(objs5[1].id, 31);
+    ASSERT_EQ(objs4.size(), 0u);
+
+    objs5.erase_unordered(0u);
+    ASSERT_EQ(objs5.size(), 1u);
+    ASSERT_EQ(objs5[0].id, 31);
+  }
+
+  ASSERT_EQ(m_constructed, m_destructed);
+
+  {
+    EpArray<EpUniquePtr<TestObject> > ptrs;
+    ptrs.reserve(2u);
+    EpUniquePtr<TestObject> ptr(EpNew<TestObject>(EpMemoryAllocatorId_Heap));
+    TestObject* raw = ptr.get();
+    ptrs.push_back(EpMove(ptr));
+    ptrs.emplace_back(EpNew<TestObject>(EpMemoryAllocatorId_Heap));
+    ASSERT_TRUE((ptr.get() == NULL));
+
+    ptrs.erase_unordered(0u);
+    ASSERT_EQ(ptrs.size(), 1u);
+    ASSERT_TRUE((ptrs[0].get() != raw));
+  }
+
+  ASSERT_EQ(m_constructed, m_destructed);
+}
+#endif
+
+// Same layout as float but copied element by element.
+struct EpArrayTestFloat {
+  EpArrayTestFloat() { }
+  EpArrayTestFloat(const EpArrayTestFloat& rhs) : x(rhs.x) { }
+  ~EpArrayTestFloat() { }
+  void operator=(const EpArrayTestFloat& rhs) { x = rhs.x; }
+  float x;
+};
+
+// Trivially copyable elements are assigned with memcpy and others element by
+// element.  Both copy every value.
+TEST_F(EpArrayTest, TrivialAssign) {
+  ASSERT_TRUE(EpIsTriviallyCopyable<float>::value);
+  ASSERT_FALSE(EpIsTriviallyCopyable<EpArrayTestFloat>::value);
+
+  const unsigned count = 100u;
+  EpArray<float> src;
+  EpArray<EpArrayTestFloat> srcSlow;
+  src.resize(count);
+  srcSlow.resize(count);
+  for (unsigned i = 0u; i < count; ++i) {
+    src[i] = (float)i;
+    srcSlow[i].x = (float)i;
+  }
+
+  EpArray<float> dst;
+  EpArray<EpArrayTestFloat> dstSlow;
+  dst.reserve(count);
+  dstSlow.reserve(count);
+  dst.resize(3u);
+  dstSlow.resize(3u);
+  dst = src;
+  dstSlow = srcSlow;
+  ASSERT_EQ(dst.size(), count);
+  ASSERT_EQ(dstSlow.size(), count);
+  unsigned mismatches = 0u;
+  for (unsigned i = 0u; i < count; ++i) {
+    mismatches += (dst[i] != (float)i) + (dstSlow[i].x != (float)i);
+  }
+  ASSERT_EQ(mismatches, 0u);
+
+  // Replaced elements of other types are destructed.
+  {
+    EpArray<TestObject> objs;
+    objs.reserve(4u);
+    objs.resize(2u);
+    EpArray<TestObject> replacement;
+    replacement.reserve(4u);
+    replacement.push_back(TestObject(5));
+    int destructed = m_destructed;
+    objs = replacement;
+    ASSERT_EQ(m_destructed, destructed + 2);
+    ASSERT_EQ(objs[0].id, 5);
+  }
+  ASSERT_EQ(m_constructed, m_destructed);
+}
+
+enum { EP_ARRAY_TEST_ASSIGN_COUNT = 64 * 1024 };
+
+BENCHMARK_F(EpArrayTest, TrivialAssignBenchmark) {
+  EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+  EpArray<float> src;
+  EpArray<float> dst;
+  src.resize((unsigned)EP_ARRAY_TEST_ASSIGN_COUNT);
+  dst.reserve((unsigned)EP_ARRAY_TEST_ASSIGN_COUNT);
+  for (unsigned i = 0u; i < (unsigned)EP_ARRAY_TEST_ASSIGN_COUNT; ++i) {
+    src[i] = (float)i;
+  }
+  state.SetBytesPerIteration(EP_ARRAY_TEST_ASSIGN_COUNT * sizeof(float));
+  while (state.KeepRunning()) {
+    dst = src;
+    EpBenchmarkDoNotOptimize(dst[0]);
+  }
+}
+
+// The same assignment copied element by element.
+BENCHMARK_F(EpArrayTest, ElementwiseAssignBenchmark) {
+  EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+  EpArray<EpArrayTestFloat> src;
+  EpArray<EpArrayTestFloat> dst;
+  src.resize((unsigned)EP_ARRAY_TEST_ASSIGN_COUNT);
+  dst.reserve((unsigned)EP_ARRAY_TEST_ASSIGN_COUNT);
+  for (unsigned i = 0u; i < (unsigned)EP_ARRAY_TEST_ASSIGN_COUNT; ++i) {
+    src[i].x = (float)i;
+  }
+  state.SetBytesPerIteration(EP_ARRAY_TEST_ASSIGN_COUNT * sizeof(EpArrayTestFloat));
+  while (state.KeepRunning()) {
+    dst = src;
+    EpBenchmarkDoNotOptimize(dst[0].x);
+  }
+}
+
+BENCHMARK_F(EpArrayTest, PushBackBenchmark) {
+  EpArray<int, 256u> a;
+  state.SetBytesPerIteration(256u * sizeof(int));
+  while (state.KeepRunning()) {
+    a.clear();
+    for (int i = 0; i < 256; ++i) {
+      a.push_back(i);
+    }
+    EpBenchmarkDoNotOptimize(a[255]);
+  }
+}
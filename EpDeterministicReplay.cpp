@@ -0,0 +1,1103 @@
+#include "EpDeterministicReplay.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#if (EP_DETERMINISTIC_REPLAY == 1)
+
+#if defined(EP_BUILD_SOFTWARE) && (defined(__unix__) || defined(__APPLE__))
+#define EP_DETERMINE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define EP_DETERMINE_MMAP 0
+#endif
+
+#if defined(EP_BUILD_SOFTWARE)
+#include <atomic>
+#include <new>
+#include <thread>
+#endif
+
+EP_THREAD_LOCAL EpDetermine* g_epDetermineContext = NULL;
+
+// Replay buffers use the C heap directly.  EpDetermineInstance() is destroyed
+// after EpShutdown() has disabled the memory manager.
+static void* EpDetermineMalloc(size_t size) {
+  void* t = ::malloc(size);
+  EpReleaseAssertMsg(t != NULL, "EpDetermine: allocation failure");
+  return t;
+}
+
+// ----------------------------------------------------------------------------
+// LZ4-style block codec
+//
+// A block is a sequence of (token, literals, offset, match) records.  The
+// token's high nibble is the literal count and the low nibble the match length
+// minus EP_LZ_MIN_MATCH.  A nibble of 15 is extended by following bytes that
+// are summed until one is less than 255.  The offset is 16-bit little endian.
+// The final record has literals only.
+
+#define EP_LZ_MIN_MATCH 4
+#define EP_LZ_HASH_BITS 14
+#define EP_LZ_HASH_SIZE (1u << EP_LZ_HASH_BITS)
+#define EP_LZ_LAST_LITERALS 5 // Matches stop short of the end of the block.
+
+static size_t EpLzBound(size_t size) {
+  return size + size / 255u + 16u;
+}
+
+static uint32_t EpLzRead32(const uint8_t* p) {
+  uint32_t x;
+  ::memcpy(&x, p, sizeof x);
+  return x;
+}
+
+static uint8_t* EpLzWriteLength(uint8_t* op, size_t length) {
+  for (; length >= 255u; length -= 255u) {
+    *op++ = 255u;
+  }
+  *op++ = (uint8_t)length;
+  return op;
+}
+
+static uint8_t* EpLzWriteLiterals(uint8_t* op, const uint8_t* literals, size_t literalCount, size_t matchLength) {
+  uint8_t* token = op++;
+  *token = (uint8_t)(((literalCount < 15u) ? literalCount : 15u) << 4);
+  if (literalCount >= 15u) {
+    op = EpLzWriteLength(op, literalCount - 15u);
+  }
+  ::memcpy(op, literals, literalCount);
+  op += literalCount;
+
+  *token |= (uint8_t)((matchLength < 15u) ? matchLength : 15u);
+  return op;
+}
+
+// Returns the compressed size.  dst must hold EpLzBound(size) bytes.  table is
+// scratch for EP_LZ_HASH_SIZE positions.
+static size_t EpLzCompress(const uint8_t* src, size_t size, uint8_t* dst, uint32_t* table) {
+  ::memset(table, 0, EP_LZ_HASH_SIZE * sizeof *table);
+
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + size;
+  uint8_t* op = dst;
+
+  if (size > EP_LZ_MIN_MATCH + EP_LZ_LAST_LITERALS) {
+    const uint8_t* matchLimit = end - EP_LZ_LAST_LITERALS;
+    while (ip + EP_LZ_MIN_MATCH <= matchLimit) {
+      uint32_t sequence = EpLzRead32(ip);
+      uint32_t hash = (sequence * 2654435761u) >> (32 - EP_LZ_HASH_BITS);
+      const uint8_t* ref = src + table[hash];
+      table[hash] = (uint32_t)(ip - src);
+
+      if (ref >= ip || (ip - ref) > 0xffff || EpLzRead32(ref) != sequence) {
+        ++ip;
+        continue;
+      }
+
+      const uint8_t* matchEnd = ip + EP_LZ_MIN_MATCH;
+      const uint8_t* refIt = ref + EP_LZ_MIN_MATCH;
+      while (matchEnd < matchLimit && *matchEnd == *refIt) {
+        ++matchEnd;
+        ++refIt;
+      }
+
+      size_t matchLength = (size_t)(matchEnd - ip) - EP_LZ_MIN_MATCH;
+      op = EpLzWriteLiterals(op, anchor, (size_t)(ip - anchor), matchLength);
+
+      uint32_t offset = (uint32_t)(ip - ref);
+      *op++ = (uint8_t)offset;
+      *op++ = (uint8_t)(offset >> 8);
+      if (matchLength >= 15u) {
+        op = EpLzWriteLength(op, matchLength - 15u);
+      }
+
+      ip = anchor = matchEnd;
+    }
+  }
+
+  op = EpLzWriteLiterals(op, anchor, (size_t)(end - anchor), 0u);
+  EpAssert((size_t)(op - dst) <= EpLzBound(size));
+  return (size_t)(op - dst);
+}
+
+// Returns false if src is corrupt or does not decompress to exactly dstSize.
+static bool EpLzDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+  const uint8_t* ip = src;
+  const uint8_t* ipEnd = src + srcSize;
+  uint8_t* op = dst;
+  uint8_t* opEnd = dst + dstSize;
+
+  while (ip < ipEnd) {
+    unsigned token = *ip++;
+
+    size_t literalCount = token >> 4;
+    if (literalCount == 15u) {
+      unsigned b;
+      do {
+        if (ip >= ipEnd) { return false; }
+        b = *ip++;
+        literalCount += b;
+      } while (b == 255u);
+    }
+    if ((size_t)(ipEnd - ip) < literalCount || (size_t)(opEnd - op) < literalCount) {
+      return false;
+    }
+    ::memcpy(op, ip, literalCount);
+    ip += literalCount;
+    op += literalCount;
+
+    if (ip == ipEnd) {
+      break; // Final record.
+    }
+
+    if (ipEnd - ip < 2) { return false; }
+    size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+
+    size_t matchLength = token & 15u;
+    if (matchLength == 15u) {
+      unsigned b;
+      do {
+        if (ip >= ipEnd) { return false; }
+        b = *ip++;
+        matchLength += b;
+      } while (b == 255u);
+    }
+    matchLength += EP_LZ_MIN_MATCH;
+
+    if (offset == 0u || offset > (size_t)(op - dst) || (size_t)(opEnd - op) < matchLength) {
+      return false;
+    }
+
+    // May overlap, which is how runs are encoded.
+    const uint8_t* ref = op - offset;
+    while (matchLength--) {
+      *op++ = *ref++;
+    }
+  }
+
+  return op == opEnd;
+}
+
+// Groups byte k of every 32-bit word together.  The exponent bytes of float
+// streams then form long runs the codec above can match.  Trailing bytes are
+// copied unchanged.
+static void EpLzShuffle(const uint8_t* src, size_t size, uint8_t* dst) {
+  size_t words = size / 4u;
+  for (size_t k = 0; k < 4u; ++k) {
+    for (size_t i = 0; i < words; ++i) {
+      *dst++ = src[i * 4u + k];
+    }
+  }
+  ::memcpy(dst, src + words * 4u, size - words * 4u);
+}
+
+static void EpLzUnshuffle(const uint8_t* src, size_t size, uint8_t* dst) {
+  size_t words = size / 4u;
+  for (size_t k = 0; k < 4u; ++k) {
+    for (size_t i = 0; i < words; ++i) {
+      dst[i * 4u + k] = *src++;
+    }
+  }
+  ::memcpy(dst + words * 4u, src, size - words * 4u);
+}
+
+
+// FNV-1a
+static uint32_t EpDetermineHash(const char* label) {
+  uint32_t hash = 2166136261u;
+  for (const char* it = label; *it != '\0'; ++it) {
+    hash = (hash ^ (uint8_t)*it) * 16777619u;
+  }
+  return hash;
+}
+
+static void* EpDetermineGrow(void* ptr, unsigned* capacity, size_t elementSize) {
+  *capacity = *capacity ? *capacity * 2u : 64u;
+  ptr = ::realloc(ptr, *capacity * elementSize);
+  EpReleaseAssertMsg(ptr != NULL, "EpDetermine: allocation failure");
+  return ptr;
+}
+
+// ----------------------------------------------------------------------------
+// EpDetermine
+
+EpDetermine::EpDetermine() {
+  m_enabled = false;
+  m_replaying = false;
+  m_counter = 0;
+  m_max = 0;
+  m_divergenceCount = 0;
+  m_assertOnDivergence = true;
+  m_firstDivergence[0] = '\0';
+  m_label[0] = '\0';
+  m_labelHash = 0;
+  m_log = NULL;
+  m_writeBuffer = NULL;
+  m_writeSize = 0;
+  m_compressed = false;
+  m_isWritingCompressed = false;
+  m_packBuffer = NULL;
+  m_fileOffset = 0;
+  m_chunkOffsets = NULL;
+  m_chunkCount = 0;
+  m_chunkCapacity = 0;
+  m_streamOffset = 0;
+  m_labelEntries = NULL;
+  m_labelCount = 0;
+  m_labelCapacity = 0;
+  m_readBegin = NULL;
+  m_readEnd = NULL;
+  m_isMapped = false;
+  m_isReadingUnframed = false;
+  m_readPos = 0;
+  m_readRecordsEnd = 0;
+  m_streamSize = 0;
+  m_window = NULL;
+  m_windowBegin = 0;
+  m_windowEnd = 0;
+  m_readChunks = NULL;
+  m_readChunkCount = 0;
+  m_readChunkCapacity = 0;
+  m_inflateBuffer = NULL;
+  m_inflateCapacity = 0;
+  m_shuffleBuffer = NULL;
+  m_shuffleCapacity = 0;
+  m_readLabels = NULL;
+  m_readLabelCount = 0;
+  m_readLabelCapacity = 0;
+}
+
+EpDetermine::~EpDetermine() {
+  Close();
+  ::free(m_writeBuffer);
+  ::free(m_packBuffer);
+  ::free(m_chunkOffsets);
+  ::free(m_labelEntries);
+  ::free(m_readChunks);
+  ::free(m_inflateBuffer);
+  ::free(m_shuffleBuffer);
+  ::free(m_readLabels);
+}
+
+bool EpDetermine::TickAt(const char* label, bool replaying, int tick) {
+  EpAssert(tick > 0);
+  m_enabled = true;
+  m_replaying = replaying;
+  m_counter = tick - 1;
+  m_max = tick;
+  return Tick(label, replaying);
+}
+
+bool EpDetermine::Tick(const char* label, bool replaying, int warm_up, int max) {
+  if(m_enabled == false) {
+    m_enabled = true;
+    m_replaying = replaying;
+    m_counter = -warm_up;
+    m_max = max;
+  }
+
+  Close();
+
+  if (m_counter < 0) {
+    ++m_counter;
+    return false;
+  }
+  if (m_counter >= m_max) {
+    return false;
+  }
+
+  ++m_counter;
+  char buf[256];
+  sprintf(buf, label, m_counter);
+  EpLogAt(Replay, Verbose, (m_replaying ? "Deterministic Replay %s...\n" : "Deterministic Recording %s...\n"), buf);
+  bool isOpen = Open(buf);
+  if (!isOpen) {
+    Report("tick %d: unable to open %s", m_counter, buf);
+  }
+
+  if(isOpen) {
+    SetLabel("EpDetermineHeader");
+    EpDetermineHeader h(m_isReadingUnframed ? EP_DETERMINE_MAGIC_UNFRAMED : EP_DETERMINE_MAGIC_RAW);
+    h.tick = m_counter;
+    Record(EpDetermineTag_Header, EpDetermineType_Bytes, &h, sizeof h);
+  }
+
+  return isOpen;
+}
+
+void EpDetermine::Playback(void* data, int32_t size) {
+  if (!IsOpen() || size == 0) {
+    return;
+  }
+  if (!m_replaying) {
+    WriteRecord(EpDetermineTag_Playback, EpDetermineType_Bytes, data, (uint32_t)size);
+  }
+  else {
+    const char* src = ReadRecord(EpDetermineTag_Playback, EpDetermineType_Bytes, (uint32_t)size);
+    if (src) {
+      ::memcpy(data, src, (size_t)size);
+    }
+  }
+}
+
+void EpDetermine::Data(const void* data, uint32_t size) {
+  Record(EpDetermineTag_Data, EpDetermineType_Bytes, data, size);
+}
+
+void EpDetermine::Number(int32_t val) {
+  Record(EpDetermineTag_Number, EpDetermineType_Int, &val, sizeof val);
+}
+
+void EpDetermine::Record(EpDetermineTag tag, EpDetermineType type, const void* data, uint32_t size) {
+  if (!IsOpen() || size == 0) {
+    return;
+  }
+  if (!m_replaying) {
+    WriteRecord(tag, type, data, size);
+    return;
+  }
+
+  const char* expected = ReadRecord(tag, type, size);
+  if (expected == NULL || ::memcmp(expected, data, size) == 0) {
+    return;
+  }
+
+  const uint8_t* actual = (const uint8_t*)data;
+  uint32_t mismatches = 0;
+  uint32_t first = size;
+  for (uint32_t i = 0; i < size; ++i) {
+    if ((uint8_t)expected[i] != actual[i]) {
+      first = EpMin(first, i);
+      ++mismatches;
+    }
+  }
+  Diverged(size, mismatches, first, (uint8_t)expected[first], actual[first], 0.0);
+}
+
+void EpDetermine::Floats(const float* data, uint32_t count, float tolerance) {
+  if (!IsOpen() || count == 0) {
+    return;
+  }
+  if (!m_replaying) {
+    WriteRecord(EpDetermineTag_Data, EpDetermineType_Float, data, count * sizeof(float));
+    return;
+  }
+
+  const char* expected = ReadRecord(EpDetermineTag_Data, EpDetermineType_Float, count * sizeof(float));
+  if (expected == NULL) {
+    return;
+  }
+
+  // Branch free so that it vectorizes.  NaN fails the comparison.
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    float e;
+    ::memcpy(&e, expected + i * sizeof e, sizeof e);
+    mismatches += !(EpAbs(e - data[i]) <= tolerance);
+  }
+  if (mismatches == 0) {
+    return;
+  }
+
+  // Slow path.  Identical bits, including NaN, are not divergence.
+  mismatches = 0;
+  uint32_t first = count;
+  double maxError = 0.0;
+  for (uint32_t i = 0; i < count; ++i) {
+    float e;
+    ::memcpy(&e, expected + i * sizeof e, sizeof e);
+    if (EpAbs(e - data[i]) <= tolerance || ::memcmp(&e, data + i, sizeof e) == 0) {
+      continue;
+    }
+    double error = EpAbs((double)e - (double)data[i]);
+    maxError = (error > maxError || error != error) ? error : maxError; // Keeps NaN.
+    first = EpMin(first, i);
+    ++mismatches;
+  }
+  if (mismatches) {
+    float e;
+    ::memcpy(&e, expected + first * sizeof e, sizeof e);
+    Diverged(count, mismatches, first, e, data[first], maxError);
+  }
+}
+
+// Maps float bits onto integers that are ordered the same way as the floats.
+static int64_t EpDetermineUlpOrder(const char* p) {
+  int32_t i;
+  ::memcpy(&i, p, sizeof i);
+  return (i < 0) ? ((int64_t)(int32_t)0x80000000 - (int64_t)i) : (int64_t)i;
+}
+
+void EpDetermine::FloatsUlp(const float* data, uint32_t count, int32_t maxUlps) {
+  if (!IsOpen() || count == 0) {
+    return;
+  }
+  if (!m_replaying) {
+    WriteRecord(EpDetermineTag_Data, EpDetermineType_Float, data, count * sizeof(float));
+    return;
+  }
+
+  const char* expected = ReadRecord(EpDetermineTag_Data, EpDetermineType_Float, count * sizeof(float));
+  if (expected == NULL) {
+    return;
+  }
+
+  // Identical bits, including NaN, are 0 ulps apart.
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    int64_t error = EpDetermineUlpOrder(expected + i * sizeof(float)) - EpDetermineUlpOrder((const char*)(data + i));
+    mismatches += EpAbs(error) > maxUlps;
+  }
+  if (mismatches == 0) {
+    return;
+  }
+
+  uint32_t first = count;
+  int64_t maxError = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    int64_t error = EpAbs(EpDetermineUlpOrder(expected + i * sizeof(float)) - EpDetermineUlpOrder((const char*)(data + i)));
+    if (error > maxUlps) {
+      maxError = EpMax(maxError, error);
+      first = EpMin(first, i);
+    }
+  }
+  float e;
+  ::memcpy(&e, expected + first * sizeof e, sizeof e);
+  Diverged(count, mismatches, first, e, data[first], (double)maxError);
+}
+
+void EpDetermine::Ints(const int32_t* data, uint32_t count, int32_t tolerance) {
+  if (!IsOpen() || count == 0) {
+    return;
+  }
+  if (!m_replaying) {
+    WriteRecord(EpDetermineTag_Data, EpDetermineType_Int, data, count * sizeof(int32_t));
+    return;
+  }
+
+  const char* expected = ReadRecord(EpDetermineTag_Data, EpDetermineType_Int, count * sizeof(int32_t));
+  if (expected == NULL) {
+    return;
+  }
+
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    int32_t e;
+    ::memcpy(&e, expected + i * sizeof e, sizeof e);
+    mismatches += EpAbs((int64_t)e - (int64_t)data[i]) > tolerance;
+  }
+  if (mismatches == 0) {
+    return;
+  }
+
+  uint32_t first = count;
+  int64_t maxError = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    int32_t e;
+    ::memcpy(&e, expected + i * sizeof e, sizeof e);
+    int64_t error = EpAbs((int64_t)e - (int64_t)data[i]);
+    if (error > tolerance) {
+      maxError = EpMax(maxError, error);
+      first = EpMin(first, i);
+    }
+  }
+  int32_t e;
+  ::memcpy(&e, expected + first * sizeof e, sizeof e);
+  Diverged(count, mismatches, first, e, data[first], (double)maxError);
+}
+
+void EpDetermine::Label(const char* label) {
+  if (!IsOpen()) {
+    return;
+  }
+  SetLabel(label);
+  if (!m_replaying) {
+    if (m_labelCount == m_labelCapacity) {
+      m_labelEntries = (EpDetermineLabelEntry*)EpDetermineGrow(m_labelEntries, &m_labelCapacity, sizeof *m_labelEntries);
+    }
+    EpDetermineLabelEntry& entry = m_labelEntries[m_labelCount++];
+    entry.labelHash = m_labelHash;
+    entry.reserved = 0;
+    entry.offset = m_streamOffset;
+  }
+  Record(EpDetermineTag_Label, EpDetermineType_Bytes, label, (uint32_t)::strlen(label));
+}
+
+bool EpDetermine::SeekLabel(const char* label) {
+  if (!m_replaying || m_readBegin == NULL) {
+    return false;
+  }
+
+  uint32_t hash = EpDetermineHash(label);
+  uint32_t length = (uint32_t)::strlen(label);
+  for (unsigned i = 0; i < m_readLabelCount; ++i) {
+    const EpDetermineLabelEntry& entry = m_readLabels[i];
+    if (entry.labelHash != hash || entry.offset > m_readRecordsEnd || m_readRecordsEnd - entry.offset < sizeof(EpDetermineRecord) + length) {
+      continue;
+    }
+    // Only the chunks holding the label record are inflated.
+    const char* it = ReadAt(entry.offset, sizeof(EpDetermineRecord) + length);
+    if (it == NULL) {
+      continue;
+    }
+    EpDetermineRecord rec;
+    ::memcpy(&rec, it, sizeof rec);
+    if (rec.tag == EpDetermineTag_Label && rec.length == length && ::memcmp(it + sizeof rec, label, length) == 0) {
+      m_readPos = entry.offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+void EpDetermine::SetLabel(const char* label) {
+  ::strncpy(m_label, label, LABEL_SIZE - 1);
+  m_label[LABEL_SIZE - 1] = '\0';
+  m_labelHash = EpDetermineHash(label);
+}
+
+void EpDetermine::Diverged(uint32_t count, uint32_t mismatches, uint32_t first, double expected, double actual, double maxError) {
+  Report("tick %d %s: %u of %u elements diverged, first at [%u] expected %.9g actual %.9g, max error %.9g",
+    m_counter, m_label, (unsigned)mismatches, (unsigned)count, (unsigned)first, expected, actual, maxError);
+}
+
+void EpDetermine::Report(const char* format, ...) {
+  char buf[REPORT_SIZE];
+  va_list args;
+  va_start(args, format);
+  ::vsnprintf(buf, sizeof buf, format, args);
+  va_end(args);
+
+  if (m_divergenceCount++ == 0) {
+    ::strcpy(m_firstDivergence, buf);
+  }
+  EpLogHandler(EpLogLevel_Warning, "EpDetermine: %s", buf);
+  if (m_assertOnDivergence) {
+    EpAssertMsg(false, "EpDetermine: %s diverged", m_label);
+  }
+}
+
+bool EpDetermine::Open(const char* filename) {
+  if (!m_replaying) {
+    m_log = ::fopen(filename, "wb");
+    if (!m_log) {
+      return false;
+    }
+    ::setvbuf(m_log, NULL, _IONBF, 0); // Already buffered.
+    if (!m_writeBuffer) {
+      m_writeBuffer = (char*)EpDetermineMalloc(EP_DETERMINE_WRITE_BUFFER);
+    }
+    m_writeSize = 0;
+    m_fileOffset = 0;
+    m_chunkCount = 0;
+    m_streamOffset = 0;
+    m_labelCount = 0;
+    m_isWritingCompressed = m_compressed;
+
+    if (m_isWritingCompressed && !m_packBuffer) {
+      // The compressor's hash table, shuffled bytes and compressed bytes.
+      m_packBuffer = (char*)EpDetermineMalloc(EP_LZ_HASH_SIZE * sizeof(uint32_t) + EP_DETERMINE_WRITE_BUFFER + EpLzBound(EP_DETERMINE_WRITE_BUFFER));
+    }
+    EpDetermineHeader h(m_isWritingCompressed ? EP_DETERMINE_MAGIC_COMPRESSED : EP_DETERMINE_MAGIC_RAW);
+    h.tick = m_counter;
+    size_t result = ::fwrite(&h, sizeof h, 1, m_log);
+    EpAssert(result == (size_t)1); (void)result;
+    m_fileOffset = sizeof h;
+    return true;
+  }
+
+#if (EP_DETERMINE_MMAP == 1)
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+    map = ::mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd); // The mapping keeps the file alive.
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  ::madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  m_isMapped = true;
+  m_readBegin = (const char*)map;
+  m_readEnd = m_readBegin + st.st_size;
+#else
+  // Without mmap the whole file is read with a single call instead.
+  FILE* f = ::fopen(filename, "rb");
+  if (!f) {
+    return false;
+  }
+  ::fseek(f, 0, SEEK_END);
+  long size = ::ftell(f);
+  ::fseek(f, 0, SEEK_SET);
+  char* buf = (size > 0) ? (char*)EpDetermineMalloc((size_t)size) : NULL;
+  bool isOk = buf && ::fread(buf, (size_t)size, 1, f) == (size_t)1;
+  ::fclose(f);
+  if (!isOk) {
+    ::free(buf);
+    return false;
+  }
+
+  m_isMapped = false;
+  m_readBegin = buf;
+  m_readEnd = buf + size;
+#endif
+  m_readPos = 0;
+
+  int32_t magic = 0;
+  if ((size_t)(m_readEnd - m_readBegin) >= sizeof magic) {
+    ::memcpy(&magic, m_readBegin, sizeof magic);
+  }
+  if (magic == EP_DETERMINE_MAGIC_COMPRESSED) {
+    if (!IndexChunks()) {
+      EpDebugWarning(false, "EpDetermine: %s is corrupt", filename);
+      Close();
+      return false;
+    }
+  }
+  else if (magic == EP_DETERMINE_MAGIC_RAW && (size_t)(m_readEnd - m_readBegin) >= sizeof(EpDetermineHeader)) {
+    m_window = m_readBegin + sizeof(EpDetermineHeader);
+    m_windowBegin = 0;
+    m_windowEnd = m_streamSize = (uint64_t)(m_readEnd - m_window);
+  }
+  else if (magic == EP_DETERMINE_MAGIC_UNFRAMED) {
+    // The header is the first payload.  There is no label index.
+    m_isReadingUnframed = true;
+    m_window = m_readBegin;
+    m_windowBegin = 0;
+    m_windowEnd = m_streamSize = (uint64_t)(m_readEnd - m_readBegin);
+    m_readRecordsEnd = m_streamSize;
+    return true;
+  }
+  else {
+    EpReleaseWarning(false, "EpDetermine: %s is not a replay file", filename);
+    Close();
+    return false;
+  }
+  m_readRecordsEnd = m_streamSize;
+  ReadLabelIndex();
+  return true;
+}
+
+void EpDetermine::Close() {
+  if (m_log != NULL) {
+    WriteLabelIndex();
+    Flush();
+    if (m_isWritingCompressed) {
+      WriteIndex();
+    }
+    ::fclose(m_log);
+    m_log = NULL;
+  }
+
+  if (m_readBegin != NULL) {
+    if (m_readPos != m_readRecordsEnd) {
+      Report("tick %d %s: %d bytes of replay unread", m_counter, m_label, (int)(m_readRecordsEnd - m_readPos));
+    }
+#if (EP_DETERMINE_MMAP == 1)
+    if (m_isMapped) {
+      ::munmap((void*)m_readBegin, (size_t)(m_readEnd - m_readBegin));
+    }
+    else
+#endif
+    {
+      ::free((void*)m_readBegin);
+    }
+    m_readBegin = m_readEnd = NULL;
+    m_isReadingUnframed = false;
+    m_readPos = m_readRecordsEnd = m_streamSize = 0;
+    m_window = NULL;
+    m_windowBegin = m_windowEnd = 0;
+    m_readChunkCount = 0;
+    m_readLabelCount = 0;
+  }
+}
+
+void EpDetermine::WriteRecord(EpDetermineTag tag, EpDetermineType type, const void* data, uint32_t length) {
+  static const uint8_t padding[4] = { 0, 0, 0, 0 };
+
+  EpDetermineRecord rec;
+  rec.tag = (uint8_t)tag;
+  rec.type = (uint8_t)type;
+  rec.sync = EP_DETERMINE_RECORD_SYNC;
+  rec.length = length;
+  rec.labelHash = m_labelHash;
+
+  Write(&rec, sizeof rec);
+  Write(data, length);
+  Write(padding, (0u - length) & 3u);
+}
+
+void EpDetermine::Write(const void* data, size_t size) {
+  m_streamOffset += size;
+
+  if (m_isWritingCompressed) {
+    // Every full buffer becomes a chunk.
+    const char* it = (const char*)data;
+    while (size > 0u) {
+      size_t chunk = EpMin(size, (size_t)EP_DETERMINE_WRITE_BUFFER - m_writeSize);
+      ::memcpy(m_writeBuffer + m_writeSize, it, chunk);
+      m_writeSize += chunk;
+      it += chunk;
+      size -= chunk;
+      if (m_writeSize == EP_DETERMINE_WRITE_BUFFER) {
+        Flush();
+      }
+    }
+    return;
+  }
+
+  if (m_writeSize + size > EP_DETERMINE_WRITE_BUFFER) {
+    Flush();
+    if (size > EP_DETERMINE_WRITE_BUFFER) {
+      // Too large to be worth copying.
+      size_t result = ::fwrite(data, size, 1, m_log);
+      EpAssert(result == (size_t)1); (void)result;
+      return;
+    }
+  }
+  ::memcpy(m_writeBuffer + m_writeSize, data, size);
+  m_writeSize += size;
+}
+
+void EpDetermine::Flush() {
+  if (m_writeSize == 0) {
+    return;
+  }
+
+  if (!m_isWritingCompressed) {
+    size_t result = ::fwrite(m_writeBuffer, m_writeSize, 1, m_log);
+    EpAssert(result == (size_t)1); (void)result;
+    m_writeSize = 0;
+    return;
+  }
+
+  if (m_chunkCount == m_chunkCapacity) {
+    m_chunkOffsets = (uint64_t*)EpDetermineGrow(m_chunkOffsets, &m_chunkCapacity, sizeof *m_chunkOffsets);
+  }
+  m_chunkOffsets[m_chunkCount++] = m_fileOffset;
+
+  uint32_t* table = (uint32_t*)m_packBuffer;
+  uint8_t* shuffled = (uint8_t*)(table + EP_LZ_HASH_SIZE);
+  uint8_t* packed = shuffled + EP_DETERMINE_WRITE_BUFFER;
+  EpLzShuffle((const uint8_t*)m_writeBuffer, m_writeSize, shuffled);
+
+  EpDetermineChunk chunk;
+  chunk.rawBytes = (uint32_t)m_writeSize;
+  chunk.packedBytes = (uint32_t)EpLzCompress(shuffled, m_writeSize, packed, table);
+
+  size_t result = ::fwrite(&chunk, sizeof chunk, 1, m_log);
+  result += ::fwrite(packed, chunk.packedBytes, 1, m_log);
+  EpAssert(result == (size_t)2); (void)result;
+
+  m_fileOffset += sizeof chunk + chunk.packedBytes;
+  m_writeSize = 0;
+}
+
+// Part of the uncompressed stream.
+void EpDetermine::WriteLabelIndex() {
+  EpDetermineIndex index;
+  index.count = m_labelCount;
+  index.magic = EP_DETERMINE_MAGIC_LABELS;
+
+  Write(m_labelEntries, m_labelCount * sizeof *m_labelEntries);
+  Write(&index, sizeof index);
+}
+
+// Follows the compressed chunks.
+void EpDetermine::WriteIndex() {
+  EpDetermineIndex index;
+  index.count = m_chunkCount;
+  index.magic = EP_DETERMINE_MAGIC_INDEX;
+
+  size_t result = m_chunkCount ? ::fwrite(m_chunkOffsets, m_chunkCount * sizeof *m_chunkOffsets, 1, m_log) : (size_t)1;
+  result += ::fwrite(&index, sizeof index, 1, m_log);
+  EpAssert(result == (size_t)2); (void)result;
+}
+
+const char* EpDetermine::ReadRecord(EpDetermineTag tag, EpDetermineType type, uint32_t length) {
+  if (m_isReadingUnframed) {
+    const char* payload = Read(length);
+    if (payload == NULL) {
+      Report("tick %d %s: replay overrun", m_counter, m_label);
+    }
+    return payload;
+  }
+
+  EpDetermineRecord rec;
+  const char* it = Read(sizeof rec);
+  if (it == NULL) {
+    Report("tick %d %s: replay overrun", m_counter, m_label);
+    return NULL;
+  }
+  ::memcpy(&rec, it, sizeof rec);
+
+  if (rec.sync != EP_DETERMINE_RECORD_SYNC) {
+    // Nothing after this can be trusted.
+    m_readPos = m_readRecordsEnd;
+    Report("tick %d %s: replay corrupt", m_counter, m_label);
+    return NULL;
+  }
+
+  // Always consume the recorded length to stay in sync.  The padding is read
+  // with the payload so that both are in the same window.
+  const char* payload = Read((size_t)rec.length + ((0u - rec.length) & 3u));
+  if (payload == NULL) {
+    Report("tick %d %s: replay truncated", m_counter, m_label);
+    return NULL;
+  }
+
+  if (rec.tag == tag && rec.type == type && rec.length == length && rec.labelHash == m_labelHash) {
+    return payload;
+  }
+
+  if (rec.tag == EpDetermineTag_Label && tag == EpDetermineTag_Label) {
+    Report("tick %d %s: expected label %.*s", m_counter, m_label, (int)EpMin(rec.length, (uint32_t)LABEL_SIZE), payload);
+  }
+  else {
+    Report("tick %d %s: expected record tag %u type %u length %u, actual tag %u type %u length %u",
+      m_counter, m_label, (unsigned)rec.tag, (unsigned)rec.type, (unsigned)rec.length, (unsigned)tag, (unsigned)type, (unsigned)length);
+  }
+  return NULL;
+}
+
+const char* EpDetermine::Read(size_t size) {
+  const char* it = (m_readRecordsEnd - m_readPos >= size) ? ReadAt(m_readPos, size) : NULL;
+  m_readPos = it ? m_readPos + size : m_readRecordsEnd;
+  return it;
+}
+
+const char* EpDetermine::ReadAt(uint64_t pos, size_t size) {
+  if (size == 0) {
+    return m_readBegin; // Not dereferenced.
+  }
+  if (pos > m_streamSize || m_streamSize - pos < size) {
+    return NULL;
+  }
+  if ((pos < m_windowBegin || pos + size > m_windowEnd) && !InflateWindow(pos, size)) {
+    return NULL;
+  }
+  return m_window + (pos - m_windowBegin);
+}
+
+// Inflates the chunks holding [pos, pos + size) of the stream into the window.
+bool EpDetermine::InflateWindow(uint64_t pos, size_t size) {
+  unsigned first = 0;
+  unsigned last = m_readChunkCount;
+  while (last - first > 1u) {
+    unsigned middle = (first + last) / 2u;
+    if (m_readChunks[middle].streamOffset <= pos) {
+      first = middle;
+    }
+    else {
+      last = middle;
+    }
+  }
+  last = first;
+  while (m_readChunks[last].streamOffset + m_readChunks[last].rawBytes < pos + size) {
+    ++last;
+  }
+
+  uint64_t windowBegin = m_readChunks[first].streamOffset;
+  size_t windowBytes = (size_t)(m_readChunks[last].streamOffset + m_readChunks[last].rawBytes - windowBegin);
+  if (windowBytes > m_inflateCapacity) {
+    m_inflateBuffer = (char*)::realloc(m_inflateBuffer, windowBytes);
+    EpReleaseAssertMsg(m_inflateBuffer != NULL, "EpDetermine: allocation failure");
+    m_inflateCapacity = windowBytes;
+  }
+
+  m_window = NULL;
+  m_windowBegin = m_windowEnd = 0;
+  for (unsigned i = first; i <= last; ++i) {
+    const EpDetermineChunkEntry& chunk = m_readChunks[i];
+    if (!EpLzDecompress((const uint8_t*)m_readBegin + chunk.fileOffset, chunk.packedBytes, m_shuffleBuffer, chunk.rawBytes)) {
+      m_readPos = m_readRecordsEnd;
+      Report("tick %d %s: replay chunk %u corrupt", m_counter, m_label, i);
+      return false;
+    }
+    EpLzUnshuffle(m_shuffleBuffer, chunk.rawBytes, (uint8_t*)m_inflateBuffer + (chunk.streamOffset - windowBegin));
+  }
+  m_window = m_inflateBuffer;
+  m_windowBegin = windowBegin;
+  m_windowEnd = windowBegin + windowBytes;
+  return true;
+}
+
+// Validates the chunk index of the compressed file in [m_readBegin, m_readEnd).
+// Nothing is inflated until it is read.
+bool EpDetermine::IndexChunks() {
+  const char* begin = m_readBegin;
+  const char* end = m_readEnd;
+  size_t fileSize = (size_t)(end - begin);
+
+  EpDetermineIndex index;
+  if (fileSize < sizeof(EpDetermineHeader) + sizeof index) {
+    return false;
+  }
+  ::memcpy(&index, end - sizeof index, sizeof index);
+  size_t indexBytes = (size_t)index.count * sizeof(uint64_t);
+  if (index.magic != EP_DETERMINE_MAGIC_INDEX || indexBytes > fileSize - sizeof(EpDetermineHeader) - sizeof index) {
+    return false;
+  }
+  const char* offsets = end - sizeof index - indexBytes;
+
+  while (m_readChunkCapacity < index.count) {
+    m_readChunks = (EpDetermineChunkEntry*)EpDetermineGrow(m_readChunks, &m_readChunkCapacity, sizeof *m_readChunks);
+  }
+  // Chunks lie between the header and the index.  Comparisons subtract from
+  // the limit so corrupt offsets and sizes cannot wrap.
+  const uint64_t limit = (uint64_t)(offsets - begin);
+  uint64_t streamOffset = 0;
+  size_t maxChunkSize = 1;
+  for (uint32_t i = 0; i < index.count; ++i) {
+    uint64_t offset;
+    EpDetermineChunk chunk;
+    ::memcpy(&offset, offsets + i * sizeof offset, sizeof offset);
+    if (offset < sizeof(EpDetermineHeader) || limit < sizeof chunk || offset > limit - sizeof chunk) {
+      return false;
+    }
+    ::memcpy(&chunk, begin + offset, sizeof chunk);
+    offset += sizeof chunk;
+    if (chunk.rawBytes == 0 || chunk.packedBytes > limit - offset) {
+      return false;
+    }
+    EpDetermineChunkEntry& entry = m_readChunks[i];
+    entry.fileOffset = offset;
+    entry.streamOffset = streamOffset;
+    entry.rawBytes = chunk.rawBytes;
+    entry.packedBytes = chunk.packedBytes;
+    streamOffset += chunk.rawBytes;
+    maxChunkSize = EpMax(maxChunkSize, (size_t)chunk.rawBytes);
+  }
+  m_readChunkCount = index.count;
+  m_streamSize = streamOffset;
+
+  if (maxChunkSize > m_shuffleCapacity) {
+    m_shuffleBuffer = (uint8_t*)::realloc(m_shuffleBuffer, maxChunkSize);
+    EpReleaseAssertMsg(m_shuffleBuffer != NULL, "EpDetermine: allocation failure");
+    m_shuffleCapacity = maxChunkSize;
+  }
+  m_window = NULL;
+  m_windowBegin = m_windowEnd = 0;
+  return true;
+}
+
+// Files without a valid label index can still be replayed sequentially.
+void EpDetermine::ReadLabelIndex() {
+  m_readLabelCount = 0;
+
+  EpDetermineIndex index;
+  const char* it = (m_streamSize >= sizeof index) ? ReadAt(m_streamSize - sizeof index, sizeof index) : NULL;
+  if (it == NULL) {
+    return;
+  }
+  ::memcpy(&index, it, sizeof index);
+  uint64_t indexBytes = (uint64_t)index.count * sizeof(EpDetermineLabelEntry);
+  if (index.magic != EP_DETERMINE_MAGIC_LABELS || indexBytes > m_streamSize - sizeof index) {
+    return;
+  }
+
+  uint64_t labelsPos = m_streamSize - sizeof index - indexBytes;
+  it = ReadAt(labelsPos, (size_t)indexBytes);
+  if (it == NULL) {
+    return;
+  }
+  while (m_readLabelCapacity < index.count) {
+    m_readLabels = (EpDetermineLabelEntry*)EpDetermineGrow(m_readLabels, &m_readLabelCapacity, sizeof *m_readLabels);
+  }
+  ::memcpy(m_readLabels, it, (size_t)indexBytes);
+  m_readLabelCount = index.count;
+  m_readRecordsEnd = labelsPos;
+}
+
+// ----------------------------------------------------------------------------
+// EpDetermineValidateParallel
+
+#if defined(EP_BUILD_SOFTWARE)
+
+struct EpDetermineValidation {
+  const char* label;
+  int tickCount;
+  EpDetermineReplayFn fn;
+  void* user;
+  EpDetermineTickResult* results;
+  std::atomic<int> nextTick;
+};
+
+static void EpDetermineValidateWorker(EpDetermineValidation* v) {
+  for (int tick = ++v->nextTick; tick <= v->tickCount; tick = ++v->nextTick) {
+    EpDetermineTickResult& result = v->results[tick - 1];
+    result.tick = tick;
+
+    EpDetermine context;
+    context.SetAssertOnDivergence(false);
+    EpDetermineScope scope(context);
+    if (context.TickAt(v->label, true, tick)) {
+      v->fn(tick, v->user);
+      context.Close();
+    }
+
+    result.divergenceCount = context.GetDivergenceCount();
+    ::strcpy(result.firstDivergence, context.GetFirstDivergence());
+  }
+}
+
+int EpDetermineValidateParallel(const char* label, int tickCount, EpDetermineReplayFn fn, void* user,
+                                unsigned threadCount, EpDetermineTickResult* results) {
+  EpDetermineTickResult* allocated = NULL;
+  if (results == NULL) {
+    allocated = results = (EpDetermineTickResult*)EpDetermineMalloc(EpMax(tickCount, 1) * sizeof *results);
+  }
+
+  if (threadCount == 0) {
+    threadCount = EpMax(std::thread::hardware_concurrency(), 1u);
+  }
+  threadCount = EpMin(threadCount, (unsigned)EpMax(tickCount, 1));
+
+  EpDetermineValidation v;
+  v.label = label;
+  v.tickCount = tickCount;
+  v.fn = fn;
+  v.user = user;
+  v.results = results;
+  v.nextTick = 0;
+
+  // The calling thread is one of the workers.
+  std::thread* threads = (std::thread*)EpDetermineMalloc(threadCount * sizeof(std::thread));
+  for (unsigned i = 1; i < threadCount; ++i) {
+    ::new (threads + i) std::thread(EpDetermineValidateWorker, &v);
+  }
+  EpDetermineValidateWorker(&v);
+  for (unsigned i = 1; i < threadCount; ++i) {
+    threads[i].join();
+    threads[i].~thread();
+  }
+  ::free(threads);
+
+  // Reported in tick order regardless of scheduling.
+  int failCount = 0;
+  for (int i = 0; i < tickCount; ++i) {
+    if (results[i].divergenceCount != 0) {
+      ++failCount;
+      EpLogAt(Replay, Info, "EpDetermine: tick %d FAILED with %d divergences: %s\n", results[i].tick, results[i].divergenceCount, results[i].firstDivergence);
+    }
+  }
+  EpLogAt(Replay, Info, "EpDetermine: %d of %d ticks passed on %u threads.\n", tickCount - failCount, tickCount, threadCount);
+
+  ::free(allocated);
+  return failCount;
+}
+
+#endif // EP_BUILD_SOFTWARE
+
+#endif // (EP_DETERMINISTIC_REPLAY == 1)
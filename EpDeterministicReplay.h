@@ -12,15 +12,88 @@
 
 #if (EP_DETERMINISTIC_REPLAY == 1)
 
+// Recording is batched through a buffer of this size before reaching the file.
+#define EP_DETERMINE_WRITE_BUFFER (1024 * 1024)
+
+#define EP_DETERMINE_MAGIC(c) (('e' << 24) | ('p' << 16) | ('d' << 8) | (c))
+#define EP_DETERMINE_MAGIC_RAW        EP_DETERMINE_MAGIC('s')
+#define EP_DETERMINE_MAGIC_UNFRAMED   EP_DETERMINE_MAGIC('r') // Older raw files.
+#define EP_DETERMINE_MAGIC_COMPRESSED EP_DETERMINE_MAGIC('z')
+#define EP_DETERMINE_MAGIC_INDEX      EP_DETERMINE_MAGIC('i')
+#define EP_DETERMINE_MAGIC_LABELS     EP_DETERMINE_MAGIC('l')
+
+// Marks the start of every EpDetermineRecord so that corruption is detected.
+#define EP_DETERMINE_RECORD_SYNC 0xd7e5u
+
 struct EpDetermineHeader {
-  // First 4 bytes of little endian file are "epdr"
-  EpDetermineHeader() {
-    version = ('e' << 24) | ('p' << 16) | ('d' << 8) | 'r';
+  // First 4 bytes of little endian file are "epds", or "epdz" when compressed.
+  // Files starting "epdr" predate EpDetermineRecord framing.  They hold only
+  // the payloads and are replayed without checking tags, lengths or labels.
+  EpDetermineHeader(int32_t magic=EP_DETERMINE_MAGIC_RAW) {
+    version = magic;
   }
   int32_t version;
   int32_t tick;
 };
 
+// A raw tick file is an "epds" EpDetermineHeader followed by the stream of
+// records and the label index.  A compressed tick file is an "epdz" EpDetermineHeader, a sequence of chunks
+// and an index.  Each chunk is an EpDetermineChunk followed by packedBytes of
+// byte-shuffled, LZ4-style compressed data.  The index is the uint64_t file offset of every
+// chunk followed by an EpDetermineIndex.  Decompressed, the chunks are exactly
+// the contents of the equivalent raw file.
+struct EpDetermineChunk {
+  uint32_t rawBytes;
+  uint32_t packedBytes;
+};
+
+struct EpDetermineIndex {
+  uint32_t count;
+  int32_t magic; // EP_DETERMINE_MAGIC_INDEX
+};
+
+// Where playback finds each chunk.  Built from the index, not stored.
+struct EpDetermineChunkEntry {
+  uint64_t fileOffset; // Of the compressed bytes.
+  uint64_t streamOffset; // Of the first uncompressed byte.
+  uint32_t rawBytes;
+  uint32_t packedBytes;
+};
+
+// Every call is stored as an EpDetermineRecord followed by length bytes of
+// payload, padded to 4 byte alignment.  Playback skips each record by its
+// recorded length, so a mismatch does not desynchronize the rest of the tick.
+enum EpDetermineTag {
+  EpDetermineTag_Header,
+  EpDetermineTag_Label,
+  EpDetermineTag_Data,
+  EpDetermineTag_Playback,
+  EpDetermineTag_Number
+};
+
+enum EpDetermineType {
+  EpDetermineType_Bytes,
+  EpDetermineType_Float,
+  EpDetermineType_Int
+};
+
+struct EpDetermineRecord {
+  uint8_t tag; // EpDetermineTag
+  uint8_t type; // EpDetermineType
+  uint16_t sync; // EP_DETERMINE_RECORD_SYNC
+  uint32_t length;
+  uint32_t labelHash; // Of the most recent label.
+};
+
+// The records of a tick are followed by an EpDetermineLabelEntry for every
+// label record and then an EpDetermineIndex with EP_DETERMINE_MAGIC_LABELS.
+// Offsets are from the start of the uncompressed tick.
+struct EpDetermineLabelEntry {
+  uint32_t labelHash;
+  uint32_t reserved;
+  uint64_t offset;
+};
+
 template<int Sz>
 struct EpDetermineFloats {
   float vals[Sz];
@@ -31,129 +104,206 @@ struct EpDetermineInts {
   int32_t vals[Sz];
 };
 
-class EpDetermine {
-  enum {
-    BUF_SIZE = 16 * 1024
-  };
+enum { EpDetermineTickResult_REPORT_SIZE = 200 };
 
+// Playback memory maps each tick file and compares directly against the
+// mapping.  Recording appends to a large buffer that is written out when full
+// and when the tick file is closed.  When compressed each buffer becomes one
+// chunk.  Playback finds chunks with the chunk index and inflates only those
+// holding the records being read, so SeekLabel() does not inflate the chunks
+// it skips.  See EpDeterministicReplay.cpp.
+class EpDetermine {
 public:
-  EpDetermine() {
-    m_enabled = false;
-    m_log = NULL;
-  }
+  EpDetermine();
+  ~EpDetermine();
 
   void Reset() {
     m_enabled = false; // next tick will reconfigure.
   }
 
+  // Recording only.  Playback detects compressed files automatically.
+  void SetCompressed(bool compressed) { m_compressed = compressed; }
+
+  // Number of comparisons that have failed during playback.
+  int GetDivergenceCount() const { return m_divergenceCount; }
+
+  // Text of the first failed comparison, or "".
+  const char* GetFirstDivergence() const { return m_firstDivergence; }
+
+  // Divergence is always logged and counted.  Asserting can be disabled when
+  // collecting a report instead.
+  void SetAssertOnDivergence(bool assertOnDivergence) { m_assertOnDivergence = assertOnDivergence; }
+
   // Warm-up it the number of ticks before
-  bool Tick(const char* label, bool replaying, int warm_up=0, int max=1) {
-    if(m_enabled == false) {
-      m_enabled = true;
-      m_replaying = replaying;
-      m_counter = -warm_up;
-      m_max = max;
-    }
-
-    if (m_log != NULL) {
-      ::fclose(m_log);
-      m_log = NULL;
-    }
-
-    if (m_counter < 0) {
-      ++m_counter;
-      return false;
-    }
-    if (m_counter >= m_max) {
-      return false;
-    }
-
-    ++m_counter;
-    char buf[256];
-    sprintf(buf, label, m_counter);
-    EpLog((m_replaying ? "Deterministic Replay %s...\n" : "Deterministic Recording %s...\n"), buf);
-    m_log = ::fopen(buf, m_replaying ? "rb" : "wb");
-    EpAssert(m_log != NULL);
-
-    if(m_log) {
-      EpDetermineHeader h;
-      h.tick = m_counter;
-      Data(&h, sizeof h);
-    }
-
-    return m_log != NULL;
-  }
+  bool Tick(const char* label, bool replaying, int warm_up=0, int max=1);
 
-  void Playback(void* data, int32_t size) {
-    if (!m_log || size == 0) {
-      return;
-    }
-    if (!m_replaying) {
-      size_t result = ::fwrite(data, size, 1, m_log);
-      EpAssert(result == (size_t)1); (void)result;
-    }
-    else {
-      size_t result = ::fread(data, size, 1, m_log);
-      EpAssert(result > (size_t)0); (void)result; // Should be == size, compiler workaround.
-    }
-  }
+  // Opens a single tick directly, for replaying ticks out of order.
+  bool TickAt(const char* label, bool replaying, int tick);
 
+  // Closes the current tick file.  Tick() does this implicitly.
+  void Close();
 
-  void Data(const void* data, uint32_t size) {
-    if (!m_log || size == 0) {
-      return;
-    }
-    if (!m_replaying) {
-      size_t result = ::fwrite(data, size, 1, m_log);
-      EpAssert(result == (size_t)1); (void)result;
-    } else {
-      static int8_t buf[EpDetermine::BUF_SIZE];
-      int8_t* it = (int8_t*)data;
-      while (size > 0u) {
-        int32_t chunk = (size < EpDetermine::BUF_SIZE) ? size : EpDetermine::BUF_SIZE;
-
-        size_t result = ::fread(buf, chunk, 1, m_log);
-        EpAssert(result > (size_t)0); (void)result; // Should be == chunk, works around OS bug.
-
-        int cmp = ::memcmp(buf, data, chunk);
-        EpAssert(cmp == 0); (void)cmp;
-
-        it += chunk;
-        size -= chunk;
-      }
-    }
-  }
+  void Playback(void* data, int32_t size);
 
-  void Label(const char* label) {
-    if (m_log) {
-      Data(label, (uint32_t)::strlen(label));
-    }
-  }
+  void Data(const void* data, uint32_t size);
 
-  void Number(int32_t val) {
-    if (m_log) {
-      Data(&val, sizeof val);
-    }
-  }
+  // Typed comparisons.  These record the same payload as Data() but on playback
+  // allow each element to differ by tolerance, or by maxUlps units in the last
+  // place, and report the first divergent element and the maximum error.
+  void Floats(const float* data, uint32_t count, float tolerance=0.0f);
+  void FloatsUlp(const float* data, uint32_t count, int32_t maxUlps);
+  void Ints(const int32_t* data, uint32_t count, int32_t tolerance=0);
+
+  template<int Sz>
+  void Floats(const EpDetermineFloats<Sz>& floats, float tolerance=0.0f) { Floats(floats.vals, (uint32_t)Sz, tolerance); }
+
+  template<int Sz>
+  void Ints(const EpDetermineInts<Sz>& ints, int32_t tolerance=0) { Ints(ints.vals, (uint32_t)Sz, tolerance); }
+
+  void Label(const char* label);
+
+  // Playback only.  Moves to the first record of label in the current tick
+  // using the label index.  Label(label) should be called next.
+  bool SeekLabel(const char* label);
+
+  void Number(int32_t val);
 
 private:
+  EpDetermine(const EpDetermine&);
+  void operator=(const EpDetermine&);
+
+  bool IsOpen() const { return m_log != NULL || m_readBegin != NULL; }
+  bool Open(const char* filename);
+
+  void Record(EpDetermineTag tag, EpDetermineType type, const void* data, uint32_t size);
+
+  // Recording.
+  void WriteRecord(EpDetermineTag tag, EpDetermineType type, const void* data, uint32_t length);
+  void Write(const void* data, size_t size);
+  void Flush();
+  void WriteLabelIndex();
+  void WriteIndex();
+
+  // Playback.  Returns a pointer into the window or NULL when overrunning it.
+  // The pointer is valid until the next read.
+  const char* ReadRecord(EpDetermineTag tag, EpDetermineType type, uint32_t length);
+  const char* Read(size_t size);
+  const char* ReadAt(uint64_t pos, size_t size);
+  bool InflateWindow(uint64_t pos, size_t size);
+  bool IndexChunks();
+  void ReadLabelIndex();
+  void Diverged(uint32_t count, uint32_t mismatches, uint32_t first, double expected, double actual, double maxError);
+  void Report(const char* format, ...) EP_PRINTF_FORMAT(2, 3);
+  void SetLabel(const char* label);
+
+  enum { LABEL_SIZE = 64, REPORT_SIZE = EpDetermineTickResult_REPORT_SIZE };
+
   bool m_enabled;
   bool m_replaying;
   int m_counter;
   int m_max;
+  int m_divergenceCount;
+  bool m_assertOnDivergence;
+  char m_firstDivergence[REPORT_SIZE];
+  char m_label[LABEL_SIZE]; // Most recent Label() for reporting.
+  uint32_t m_labelHash;
+
   FILE* m_log;
+  char* m_writeBuffer;
+  size_t m_writeSize;
+
+  bool m_compressed;
+  bool m_isWritingCompressed; // m_compressed when m_log was opened.
+  char* m_packBuffer;
+  uint64_t m_fileOffset;
+  uint64_t* m_chunkOffsets;
+  unsigned m_chunkCount;
+  unsigned m_chunkCapacity;
+  uint64_t m_streamOffset; // Uncompressed bytes written this tick.
+  EpDetermineLabelEntry* m_labelEntries;
+  unsigned m_labelCount;
+  unsigned m_labelCapacity;
+
+  // Playback reads the uncompressed stream of records through a window.  For
+  // raw files the window is the whole file.  Offsets are within the stream.
+  const char* m_readBegin; // The file.
+  const char* m_readEnd;
+  bool m_isMapped; // Otherwise m_readBegin was allocated.
+  bool m_isReadingUnframed; // An "epdr" file.
+  uint64_t m_readPos;
+  uint64_t m_readRecordsEnd; // Start of the label index.
+  uint64_t m_streamSize;
+  const char* m_window; // Holds [m_windowBegin, m_windowEnd) of the stream.
+  uint64_t m_windowBegin;
+  uint64_t m_windowEnd;
+  EpDetermineChunkEntry* m_readChunks;
+  unsigned m_readChunkCount;
+  unsigned m_readChunkCapacity;
+  char* m_inflateBuffer;
+  size_t m_inflateCapacity;
+  uint8_t* m_shuffleBuffer;
+  size_t m_shuffleCapacity;
+  EpDetermineLabelEntry* m_readLabels; // Copied from the stream.
+  unsigned m_readLabelCount;
+  unsigned m_readLabelCapacity;
 };
 
+// The context used by the EpDetermine* macros on this thread.  NULL selects
+// the shared instance.
+extern EP_THREAD_LOCAL EpDetermine* g_epDetermineContext;
+
 inline EpDetermine& EpDetermineInstance() {
+  if (g_epDetermineContext) {
+    return *g_epDetermineContext;
+  }
   static EpDetermine data;
   return data;
 }
 
+// Directs the EpDetermine* macros on this thread to context.
+class EpDetermineScope {
+public:
+  explicit EpDetermineScope(EpDetermine& context) {
+    m_previous = g_epDetermineContext;
+    g_epDetermineContext = &context;
+  }
+  ~EpDetermineScope() {
+    g_epDetermineContext = m_previous;
+  }
+
+private:
+  EpDetermineScope(const EpDetermineScope&);
+  void operator=(const EpDetermineScope&);
+  EpDetermine* m_previous;
+};
+
+#if defined(EP_BUILD_SOFTWARE)
+struct EpDetermineTickResult {
+  int tick;
+  int divergenceCount;
+  char firstDivergence[EpDetermineTickResult_REPORT_SIZE];
+};
+
+// Runs the candidate implementation for one tick using the EpDetermine* macros.
+typedef void (*EpDetermineReplayFn)(int tick, void* user);
+
+// Replays ticks 1 to tickCount of the files named by label across threadCount
+// threads, 0 for one per core.  Each tick gets its own EpDetermine bound with
+// EpDetermineScope, so fn must be safe to run concurrently and should not use
+// the memory manager or profiler.  Logs a report in tick order and returns the
+// number of failing ticks.  results receives tickCount entries if not NULL.
+int EpDetermineValidateParallel(const char* label, int tickCount, EpDetermineReplayFn fn, void* user,
+                                unsigned threadCount=0, EpDetermineTickResult* results=0);
+#endif // EP_BUILD_SOFTWARE
+
 #define EpDetermineTick(...) EpDetermineInstance().Tick(__VA_ARGS__);
 #define EpDeterminePlayback(...) EpDetermineInstance().Playback(__VA_ARGS__);
 #define EpDetermineData(...) EpDetermineInstance().Data(__VA_ARGS__);
 #define EpDetermineLabel(...) EpDetermineInstance().Label(__VA_ARGS__);
 #define EpDetermineNumber(...) EpDetermineInstance().Number(__VA_ARGS__);
+#define EpDetermineFloatArray(...) EpDetermineInstance().Floats(__VA_ARGS__);
+#define EpDetermineFloatArrayUlp(...) EpDetermineInstance().FloatsUlp(__VA_ARGS__);
+#define EpDetermineIntArray(...) EpDetermineInstance().Ints(__VA_ARGS__);
 
 #else // !EP_DETERMINISTIC_REPLAY
 
@@ -162,7 +312,8 @@ inline EpDetermine& EpDetermineInstance() {
 #define EpDetermineData(...)
 #define EpDetermineLabel(...)
 #define EpDetermineNumber(...)
+#define EpDetermineFloatArray(...)
+#define EpDetermineFloatArrayUlp(...)
+#define EpDetermineIntArray(...)
 
 #endif // !EP_DETERMINISTIC_REPLAY
-
-
@@ -1,5 +1,6 @@
 #include "EpDeterministicReplay.h"
 #include "EpTest.h"
+#include "EpSettings.h"
 
 // ----------------------------------------------------------------------------
 #if (EP_DETERMINISTIC_REPLAY == 1)
@@ -65,6 +66,284 @@ TEST_F(EpDeterministicReplayTest, Replay) {
   ASSERT_FALSE(isRunning); (void)isRunning;
 }
 
+// Larger than EP_DETERMINE_WRITE_BUFFER to exercise unbuffered writes.
+static const unsigned s_epLargeCount = 300u * 1024u;
+static float s_epLargeData[s_epLargeCount];
+static const char* s_epLargeFilename = "DeterministicReplayTestLarge_%d.bin";
+
+TEST_F(EpDeterministicReplayTest, LargeData) {
+  for (unsigned i = 0; i < s_epLargeCount; ++i) {
+    s_epLargeData[i] = (float)i * 0.5f;
+  }
+
+  for (int replaying = 0; replaying < 2; ++replaying) {
+    EpDetermineInstance().Reset(); // Testing only
+
+    const bool isRunning = EpDetermineTick(s_epLargeFilename, replaying != 0, 0, 1);
+    ASSERT_TRUE(isRunning); (void)isRunning;
+
+    for (int i = 0; i < 4; ++i) {
+      EpDetermineNumber(i);
+      EpDetermineData(s_epLargeData, sizeof s_epLargeData);
+    }
+  }
+
+  const bool isRunning = EpDetermineTick(s_epLargeFilename, true, 0, 1);
+  ASSERT_FALSE(isRunning); (void)isRunning;
+}
+
+static long EpDetermineTestFileSize(const char* filename) {
+  FILE* f = ::fopen(filename, "rb");
+  if (!f) {
+    return -1;
+  }
+  ::fseek(f, 0, SEEK_END);
+  long size = ::ftell(f);
+  ::fclose(f);
+  return size;
+}
+
+static const char* s_epCompressedFilename = "DeterministicReplayTestCompressed_%d.bin";
+
+TEST_F(EpDeterministicReplayTest, Compressed) {
+  for (unsigned i = 0; i < s_epLargeCount; ++i) {
+    s_epLargeData[i] = (float)i * 0.5f;
+  }
+
+  for (int replaying = 0; replaying < 2; ++replaying) {
+    EpDetermineInstance().Reset(); // Testing only
+    EpDetermineInstance().SetCompressed(replaying == 0);
+
+    const bool isRunning = EpDetermineTick(s_epCompressedFilename, replaying != 0, 0, 1);
+    ASSERT_TRUE(isRunning); (void)isRunning;
+
+    char buf[256];
+    ::strcpy(buf, s_epTestData);
+    EpDeterminePlayback(buf, sizeof s_epTestData);
+    ASSERT_TRUE(0 == ::strcmp(buf, s_epTestData));
+
+    for (int i = 0; i < 4; ++i) {
+      SharedCodeSection();
+      EpDetermineData(s_epLargeData, sizeof s_epLargeData);
+    }
+    EpDetermineLabel("end");
+    EpDetermineNumber(5);
+  }
+
+  bool isRunning = EpDetermineTick(s_epCompressedFilename, true, 0, 1);
+  ASSERT_FALSE(isRunning);
+
+  // Jump to the last chunk.
+  EpDetermineInstance().Reset(); // Testing only
+  isRunning = EpDetermineTick(s_epCompressedFilename, true, 0, 1);
+  ASSERT_TRUE(isRunning);
+  int divergenceCount = EpDetermineInstance().GetDivergenceCount();
+  ASSERT_TRUE(EpDetermineInstance().SeekLabel("end"));
+  EpDetermineLabel("end");
+  EpDetermineNumber(5);
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount);
+  isRunning = EpDetermineTick(s_epCompressedFilename, true, 0, 1);
+  ASSERT_FALSE(isRunning);
+
+  // The float data is regular, so expect at least ten-fold compression.
+  long compressedSize = EpDetermineTestFileSize("DeterministicReplayTestCompressed_1.bin");
+  ASSERT_TRUE(compressedSize > 0);
+  ASSERT_TRUE(compressedSize * 10 < (long)(4 * sizeof s_epLargeData));
+}
+
+static const char* s_epToleranceFilename = "DeterministicReplayTestTolerance_%d.bin";
+
+TEST_F(EpDeterministicReplayTest, Tolerance) {
+  EpDetermineFloats<4> floats = { { 1.0f, 2.0f, 3.0f, g_epNAN } };
+  EpDetermineInts<3> ints = { { 10, 20, 30 } };
+
+  EpDetermineInstance().Reset(); // Testing only
+  EpDetermineInstance().SetCompressed(false);
+  bool isRunning = EpDetermineTick(s_epToleranceFilename, false, 0, 1);
+  ASSERT_TRUE(isRunning);
+  for (int i = 0; i < 3; ++i) {
+    EpDetermineLabel("floats");
+    EpDetermineInstance().Floats(floats);
+    EpDetermineFloatArrayUlp(floats.vals, 4u, 2);
+    EpDetermineLabel("ints");
+    EpDetermineInstance().Ints(ints);
+  }
+  isRunning = EpDetermineTick(s_epToleranceFilename, false, 0, 1);
+  ASSERT_FALSE(isRunning);
+
+  EpDetermineInstance().Reset(); // Testing only
+  isRunning = EpDetermineTick(s_epToleranceFilename, true, 0, 1);
+  ASSERT_TRUE(isRunning);
+  int divergenceCount = EpDetermineInstance().GetDivergenceCount();
+
+  // Exact, NaN included.
+  EpDetermineLabel("floats");
+  EpDetermineInstance().Floats(floats);
+  EpDetermineFloatArrayUlp(floats.vals, 4u, 2);
+  EpDetermineLabel("ints");
+  EpDetermineInstance().Ints(ints);
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount);
+
+  // Within tolerance.
+  floats.vals[1] = 2.0001f;
+  ints.vals[2] = 31;
+  EpDetermineLabel("floats");
+  EpDetermineInstance().Floats(floats, 0.001f);
+  EpDetermineFloatArrayUlp(floats.vals, 4u, 1000);
+  EpDetermineLabel("ints");
+  EpDetermineInstance().Ints(ints, 1);
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount);
+
+  // Outside tolerance.
+  int assertsAllowed = g_epSettings.platform_assertsAllowed;
+  g_epSettings.platform_assertsAllowed = 3;
+  EpLog("EXPECTING FAILURE:\n");
+  EpDetermineLabel("floats");
+  EpDetermineInstance().Floats(floats, 0.00001f);
+  EpDetermineFloatArrayUlp(floats.vals, 4u, 2);
+  EpDetermineLabel("ints");
+  EpDetermineInstance().Ints(ints);
+  g_epSettings.platform_assertsAllowed = assertsAllowed;
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount + 3);
+
+  isRunning = EpDetermineTick(s_epToleranceFilename, true, 0, 1);
+  ASSERT_FALSE(isRunning);
+}
+
+static const char* s_epSectionsFilename = "DeterministicReplayTestSections_%d.bin";
+
+static void SectionsCodeSection(int32_t bLength) {
+  const int32_t nums[4] = { 1, 2, 3, 4 };
+  EpDetermineLabel("section_a");
+  EpDetermineIntArray(nums, 4u);
+  EpDetermineLabel("section_b");
+  EpDetermineIntArray(nums, (uint32_t)bLength);
+  EpDetermineLabel("section_c");
+  EpDetermineNumber(99);
+}
+
+TEST_F(EpDeterministicReplayTest, Sections) {
+  EpDetermineInstance().Reset(); // Testing only
+  EpDetermineInstance().SetCompressed(true);
+  bool isRunning = EpDetermineTick(s_epSectionsFilename, false, 0, 1);
+  ASSERT_TRUE(isRunning);
+  SectionsCodeSection(4);
+  isRunning = EpDetermineTick(s_epSectionsFilename, false, 0, 1);
+  ASSERT_FALSE(isRunning);
+  EpDetermineInstance().SetCompressed(false);
+
+  // Jump straight to a section using the label index.
+  EpDetermineInstance().Reset(); // Testing only
+  isRunning = EpDetermineTick(s_epSectionsFilename, true, 0, 1);
+  ASSERT_TRUE(isRunning);
+  int divergenceCount = EpDetermineInstance().GetDivergenceCount();
+  ASSERT_TRUE(EpDetermineInstance().SeekLabel("section_c"));
+  ASSERT_FALSE(EpDetermineInstance().SeekLabel("section_d"));
+  EpDetermineLabel("section_c");
+  EpDetermineNumber(99);
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount);
+
+  // A record of the wrong length is reported once and replay resynchronizes.
+  ASSERT_TRUE(EpDetermineInstance().SeekLabel("section_a"));
+  int assertsAllowed = g_epSettings.platform_assertsAllowed;
+  g_epSettings.platform_assertsAllowed = 1;
+  EpLog("EXPECTING FAILURE:\n");
+  SectionsCodeSection(3);
+  g_epSettings.platform_assertsAllowed = assertsAllowed;
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount + 1);
+
+  isRunning = EpDetermineTick(s_epSectionsFilename, true, 0, 1);
+  ASSERT_FALSE(isRunning);
+}
+
+static const char* s_epUnframedFilename = "DeterministicReplayTestUnframed_%d.bin";
+
+// Writes a tick as recorded before records were framed: the header followed
+// by each payload.
+static void WriteUnframedTick(int32_t magic) {
+  char filename[64];
+  ::sprintf(filename, s_epUnframedFilename, 1);
+  FILE* f = ::fopen(filename, "wb");
+  EpReleaseAssertMsg(f != NULL, "Cannot write %s", filename);
+  EpDetermineHeader h(magic);
+  h.tick = 1;
+  const int32_t nums[3] = { 7, 13, 17 };
+  const int32_t number = 77;
+  ::fwrite(&h, sizeof h, 1, f);
+  ::fwrite("label_3", 7, 1, f);
+  ::fwrite(nums, sizeof nums, 1, f);
+  ::fwrite("label_77", 8, 1, f);
+  ::fwrite(&number, sizeof number, 1, f);
+  ::fclose(f);
+}
+
+TEST_F(EpDeterministicReplayTest, OlderVersion) {
+  // "epdr" files still replay.
+  WriteUnframedTick(EP_DETERMINE_MAGIC_UNFRAMED);
+  EpDetermineInstance().Reset(); // Testing only
+  int divergenceCount = EpDetermineInstance().GetDivergenceCount();
+  bool isRunning = EpDetermineTick(s_epUnframedFilename, true, 0, 1);
+  ASSERT_TRUE(isRunning);
+  SharedCodeSection();
+  isRunning = EpDetermineTick(s_epUnframedFilename, true, 0, 1);
+  ASSERT_FALSE(isRunning);
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount);
+
+  // Anything else is rejected.
+  WriteUnframedTick(EP_DETERMINE_MAGIC('?'));
+  EpDetermineInstance().Reset(); // Testing only
+  int assertsAllowed = g_epSettings.platform_assertsAllowed;
+  g_epSettings.platform_assertsAllowed = 1;
+  EpLog("EXPECTING FAILURE:\n");
+  isRunning = EpDetermineTick(s_epUnframedFilename, true, 0, 1);
+  g_epSettings.platform_assertsAllowed = assertsAllowed;
+  ASSERT_FALSE(isRunning);
+  ASSERT_EQ(EpDetermineInstance().GetDivergenceCount(), divergenceCount + 1);
+}
+
+#if defined(EP_BUILD_SOFTWARE)
+static const int s_epParallelTicks = 8;
+static const char* s_epParallelFilename = "DeterministicReplayTestParallel_%d.bin";
+
+static void ParallelCodeSection(int tick, void* divergentTick) {
+  float vals[64];
+  for (int i = 0; i < 64; ++i) {
+    vals[i] = (float)(tick * i);
+  }
+  if (divergentTick && *(int*)divergentTick == tick) {
+    vals[7] += 1.0f;
+  }
+
+  EpDetermineLabel("parallel");
+  EpDetermineNumber(tick);
+  EpDetermineFloatArray(vals, 64u);
+}
+
+TEST_F(EpDeterministicReplayTest, Parallel) {
+  EpDetermineInstance().Reset(); // Testing only
+  for (int i = 0; i < s_epParallelTicks; ++i) {
+    const bool isRunning = EpDetermineTick(s_epParallelFilename, false, 0, s_epParallelTicks);
+    ASSERT_TRUE(isRunning); (void)isRunning;
+    ParallelCodeSection(i + 1, NULL);
+  }
+  const bool isRunning = EpDetermineTick(s_epParallelFilename, false, 0, s_epParallelTicks);
+  ASSERT_FALSE(isRunning); (void)isRunning;
+
+  int failCount = EpDetermineValidateParallel(s_epParallelFilename, s_epParallelTicks, ParallelCodeSection, NULL, 4u);
+  ASSERT_EQ(failCount, 0);
+
+  EpLog("EXPECTING FAILURE:\n");
+  int divergentTick = 5;
+  EpDetermineTickResult results[s_epParallelTicks];
+  failCount = EpDetermineValidateParallel(s_epParallelFilename, s_epParallelTicks, ParallelCodeSection, &divergentTick, 4u, results);
+  ASSERT_EQ(failCount, 1);
+  ASSERT_EQ(results[4].tick, 5);
+  ASSERT_EQ(results[4].divergenceCount, 1);
+  ASSERT_EQ(results[3].divergenceCount, 0);
+  ASSERT_TRUE((::strstr(results[4].firstDivergence, "first at [7]") != NULL));
+}
+#endif // EP_BUILD_SOFTWARE
+
 #endif // (EP_DETERMINISTIC_REPLAY == 1)
 
 
@@ -4,6 +4,12 @@
 
 #include <string.h>
 
+#if (EP_DMA_FILE==1)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 //#define USING_SOME_DMA_DRIVER
 
 #if (EP_DEBUG_DMA==1)
@@ -20,6 +26,34 @@ static EpArray<DmaDebugRecord, 16> s_epDmaDebugRecords;
 static unsigned int s_epDmaCounter = 0;
 #endif
 
+#if (EP_DMA_FILE==1)
+// A mapped file range waiting to be copied into dst.  The kernel reads ahead
+// into the page cache while the caller continues working.
+struct DmaFileRecord {
+  DmaFileRecord(void* d, void* m, size_t mb, size_t a, size_t b, const char* l) :
+    dst(d), map(m), mapBytes(mb), adjust(a), bytes(b), label(l) { }
+  void* dst;
+  void* map;
+  size_t mapBytes;
+  size_t adjust; // Offset of the requested range within the mapping.
+  size_t bytes;
+  const char* label;
+};
+static EpArray<DmaFileRecord, EP_DMA_MAX_FILE_TRANSFERS> s_epDmaFileRecords;
+
+static void EpDmaCompleteFileTransfers() {
+  for (DmaFileRecord* it = s_epDmaFileRecords.begin(); it != s_epDmaFileRecords.end(); ++it) {
+    const char* src = (const char*)it->map + it->adjust;
+    ::memcpy(it->dst, src, it->bytes);
+#if (EP_DEBUG_DMA==1)
+    EpReleaseWarning(::memcmp(it->dst, src, it->bytes) == 0, "%s: <-- file data CORRUPTED", it->label);
+#endif
+    ::munmap(it->map, it->mapBytes);
+  }
+  s_epDmaFileRecords.clear();
+}
+#endif
+
 void EpDmaInit() {
 #ifdef USING_SOME_DMA_DRIVER
 #error "TODO"
@@ -30,6 +64,10 @@ void EpDmaShutDown() {
 #ifdef USING_SOME_DMA_DRIVER
 #error "TODO"
 #endif
+#if (EP_DMA_FILE==1)
+  EpReleaseWarning(s_epDmaFileRecords.empty(), "dma file transfers never awaited");
+  EpDmaCompleteFileTransfers();
+#endif
 }
 
 void EpDmaRecycleBarriers() {
@@ -45,7 +83,7 @@ void EpDmaRecycleBarriers() {
 
 void EpDmaStartLabeled(void* dst, const void* src, size_t bytes, const char* label) {
   label = label ? label : "EpDmaStart";
-  EpReleaseAssertMsg(src != 0 && dst != 0 && bytes != 0, "%s(0x%x, 0x%x, 0x%x): dma illegal args", label, (unsigned)dst, (unsigned)src, (unsigned)bytes);
+  EpReleaseAssertMsg(src != 0 && dst != 0 && bytes != 0, "%s(0x%x, 0x%x, 0x%x): dma illegal args", label, (unsigned)(uintptr_t)dst, (unsigned)(uintptr_t)src, (unsigned)bytes);
 #ifdef USING_SOME_DMA_DRIVER
 #else
   ::memcpy(dst, src, bytes);
@@ -55,6 +93,38 @@ void EpDmaStartLabeled(void* dst, const void* src, size_t bytes, const char* lab
 #endif
 }
 
+#if (EP_DMA_FILE==1)
+void EpDmaStartFromFileLabeled(void* dst, int fd, uint64_t offset, size_t bytes, const char* label) {
+  label = label ? label : "EpDmaStartFromFile";
+  EpReleaseAssertMsg(dst != 0 && fd >= 0 && bytes != 0, "%s(0x%x, %d, 0x%x): dma illegal args", label, (unsigned)(uintptr_t)dst, fd, (unsigned)bytes);
+  EpReleaseAssertMsg(!s_epDmaFileRecords.full(), "%s: too many file transfers in flight", label);
+
+  // Mapped pages past the end of the file fault at the barrier, so check now.
+  struct stat fileStat;
+  if (::fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+    EpReleaseAssertMsg(offset + bytes <= (uint64_t)fileStat.st_size, "%s: file dma past end of file", label);
+  }
+
+  // mmap requires a page aligned file offset.
+  uint64_t pageMask = (uint64_t)::sysconf(_SC_PAGESIZE) - 1u;
+  size_t adjust = (size_t)(offset & pageMask);
+  size_t mapBytes = adjust + bytes;
+  void* map = ::mmap(0, mapBytes, PROT_READ, MAP_PRIVATE, fd, (off_t)(offset - adjust));
+
+  if (map == MAP_FAILED) {
+    // Not mappable, e.g. a pipe.  Read synchronously instead.
+    EpDebugWarning(false, "%s: mmap failed, reading synchronously", label);
+    ssize_t result = ::pread(fd, dst, bytes, (off_t)offset);
+    EpReleaseAssertMsg(result == (ssize_t)bytes, "%s: file dma read failed", label); (void)result;
+    return;
+  }
+
+  // Start reading ahead now so the copy at the barrier is from the page cache.
+  ::madvise(map, mapBytes, MADV_WILLNEED);
+  s_epDmaFileRecords.push_back(DmaFileRecord(dst, map, mapBytes, adjust, bytes, label));
+}
+#endif
+
 void EpDmaAddBarrier(EpDmaBarrier& barrier) {
 #ifdef USING_SOME_DMA_DRIVER
 #error "TODO"
@@ -69,6 +139,10 @@ void EpDmaAwaitBarrierLabeled(EpDmaBarrier& barrier, const char* label) {
 #ifdef USING_SOME_DMA_DRIVER
 #error "TODO"
 #endif
+#if (EP_DMA_FILE==1)
+  // File transfers are not ordered against barriers.  All of them complete here.
+  EpDmaCompleteFileTransfers();
+#endif
 #if (EP_DEBUG_DMA==1)
   EpReleaseAssertMsg(barrier.debug <= s_epDmaCounter, "dma barrier corrupt: %s", label);
   for(DmaDebugRecord* it = (s_epDmaDebugRecords.end() - 1); it >= s_epDmaDebugRecords.begin(); --it ) {
@@ -8,6 +8,16 @@
 // Set to 1 or 0 as needed
 #define EP_DEBUG_DMA EP_DEBUG
 
+// File transfers are only available on hosts with POSIX file descriptors.
+#if defined(EP_BUILD_SOFTWARE) && (defined(__unix__) || defined(__APPLE__))
+#define EP_DMA_FILE 1
+#else
+#define EP_DMA_FILE 0
+#endif
+
+// Maximum number of file transfers in flight between barriers.
+#define EP_DMA_MAX_FILE_TRANSFERS 16
+
 struct EpDmaBarrier {
   unsigned int value;
 #if (EP_DEBUG_DMA==1)
@@ -24,6 +34,14 @@ void EpDmaRecycleBarriers();
 // Initiates a DMA transfer from src to dst of bytes length.  An async ::memcpy.
 void EpDmaStartLabeled(void* dst, const void* src, size_t bytes, const char* label=0);
 
+#if (EP_DMA_FILE==1)
+// Initiates a transfer of bytes from file descriptor fd at offset into dst.  The
+// file range is mapped and prefetched immediately and copied into dst by the
+// next barrier, so dst must not be accessed before then.  fd must remain open
+// until the barrier is reached.  The range must lie within the file.
+void EpDmaStartFromFileLabeled(void* dst, int fd, uint64_t offset, size_t bytes, const char* label=0);
+#endif
+
 // Introduces a barrier in the DMA command stream.  The EpDmaBarrier object itself
 // will not be modified when that barrier is reached.
 void EpDmaAddBarrier(EpDmaBarrier& barrier);
@@ -37,10 +55,12 @@ void EpDmaAwaitLabeled(const char* label=0);
 
 #if (EP_PROFILE==1)
 #define EpDmaStart(dst, src, bytes) EpDmaStartLabeled(dst, src, bytes, __FILE__ "(" EP_QUOTE(__LINE__) ") start dma")
+#define EpDmaStartFromFile(dst, fd, offset, bytes) EpDmaStartFromFileLabeled(dst, fd, offset, bytes, __FILE__ "(" EP_QUOTE(__LINE__) ") start file dma")
 #define EpDmaAwaitBarrier(barrier) EpDmaAwaitBarrierLabeled(barrier, __FILE__ "(" EP_QUOTE(__LINE__) ") wait dma")
 #define EpDmaAwait() EpDmaAwaitLabeled(__FILE__ "(" EP_QUOTE(__LINE__) ") wait dma")
 #else
 #define EpDmaStart EpDmaStartLabeled
+#define EpDmaStartFromFile EpDmaStartFromFileLabeled
 #define EpDmaAwaitBarrier EpDmaAwaitBarrierLabeled
 #define EpDmaAwait EpDmaAwaitLabeled
 #endif
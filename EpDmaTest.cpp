@@ -0,0 +1,67 @@
+#include "EmbeddedPlatform.h"
+#include "EpDma.h"
+#include "EpTest.h"
+
+#include <stdio.h>
+
+class EpDmaTest :
+  public testing::Test
+{
+public:
+};
+
+TEST_F(EpDmaTest, Memory) {
+  unsigned src[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  unsigned dst[8] = { 0 };
+
+  EpDmaBarrier barrier;
+  EpDmaStart(dst, src, sizeof src);
+  EpDmaAddBarrier(barrier);
+  EpDmaAwaitBarrier(barrier);
+
+  ASSERT_TRUE(::memcmp(dst, src, sizeof src) == 0);
+}
+
+// ----------------------------------------------------------------------------
+#if (EP_DMA_FILE==1)
+
+static const char* s_epDmaTestFilename = "DmaTest.bin";
+
+TEST_F(EpDmaTest, FromFile) {
+  // Larger than a page so the second transfer starts at an unaligned offset
+  // past the first page.
+  static unsigned data[3000];
+  for (unsigned i = 0; i < 3000u; ++i) {
+    data[i] = i * 7u;
+  }
+
+  FILE* f = ::fopen(s_epDmaTestFilename, "wb");
+  ASSERT_TRUE((f != NULL));
+  if (!f) {
+    return;
+  }
+  ::fwrite(data, sizeof data, 1, f);
+  ::fclose(f);
+
+  f = ::fopen(s_epDmaTestFilename, "rb");
+  ASSERT_TRUE((f != NULL));
+  if (!f) {
+    return;
+  }
+
+  static unsigned dst0[100];
+  static unsigned dst1[1000];
+  EpDmaStartFromFile(dst0, ::fileno(f), 0u, sizeof dst0);
+  EpDmaStartFromFile(dst1, ::fileno(f), 1500u * sizeof(unsigned), sizeof dst1);
+
+  EpDmaBarrier barrier;
+  EpDmaAddBarrier(barrier);
+  EpDmaAwaitBarrier(barrier);
+  ::fclose(f);
+  ::remove(s_epDmaTestFilename);
+
+  ASSERT_TRUE(::memcmp(dst0, data, sizeof dst0) == 0);
+  ASSERT_TRUE(::memcmp(dst1, data + 1500, sizeof dst1) == 0);
+}
+
+#endif // (EP_DMA_FILE==1)
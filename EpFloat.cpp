@@ -0,0 +1,330 @@
+#include "EpFloat.h"
+
+#include <float.h>
+#include <string.h>
+
+#ifndef EP_FLOAT_SIMD
+#if defined(__AVX2__)
+#define EP_FLOAT_SIMD 3
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EP_FLOAT_SIMD 2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define EP_FLOAT_SIMD 1
+#else
+#define EP_FLOAT_SIMD 0
+#endif
+#endif
+
+#if (EP_FLOAT_SIMD==3)
+#include <immintrin.h>
+#elif (EP_FLOAT_SIMD==2)
+#include <emmintrin.h>
+#elif (EP_FLOAT_SIMD==1)
+#include <arm_neon.h>
+#endif
+
+#define EP_FLOAT_EXP_MASK 0x7f800000u
+#define EP_FLOAT_FRAC_MASK 0x007fffffu
+
+// ----------------------------------------------------------------------------
+// Each EpFloatLanes* struct wraps one instruction set for the kernels below.
+// A mask holds all ones in each selected lane and Bits() packs it with lane 0
+// in bit 0.
+
+static EP_FORCEINLINE unsigned EpFloatLowestBit(unsigned bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned)__builtin_ctz(bits);
+#else
+  unsigned i = 0u;
+  while (!(bits & 1u)) { bits >>= 1; ++i; }
+  return i;
+#endif
+}
+
+static EP_FORCEINLINE unsigned EpFloatBitCount(unsigned bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned)__builtin_popcount(bits);
+#else
+  unsigned count = 0u;
+  for (; bits; bits &= bits - 1u) { ++count; }
+  return count;
+#endif
+}
+
+struct EpFloatLanesScalar {
+  enum { WIDTH = 1 };
+  typedef float V;
+  typedef bool M;
+  typedef double Sum;
+
+  static EP_FORCEINLINE uint32_t AsBits(float f) { uint32_t u; ::memcpy(&u, &f, sizeof u); return u; }
+  static EP_FORCEINLINE V Load(const float* p) { return *p; }
+  static EP_FORCEINLINE V Splat(float f) { return f; }
+  static EP_FORCEINLINE M NonFinite(V v) { return (AsBits(v) & EP_FLOAT_EXP_MASK) == EP_FLOAT_EXP_MASK; }
+  static EP_FORCEINLINE M Nan(V v) { return NonFinite(v) && (AsBits(v) & EP_FLOAT_FRAC_MASK) != 0u; }
+  static EP_FORCEINLINE M Differ(V a, V b, V tolerance) { return !(EpAbs(a - b) <= tolerance) && !(a == b); }
+  static EP_FORCEINLINE M Or(M a, M b) { return a || b; }
+  static EP_FORCEINLINE unsigned Bits(M m) { return m ? 1u : 0u; }
+  static EP_FORCEINLINE V Select(M m, V a, V b) { return m ? a : b; }
+  static EP_FORCEINLINE V Min(V a, V b) { return a < b ? a : b; }
+  static EP_FORCEINLINE V Max(V a, V b) { return a > b ? a : b; }
+  static EP_FORCEINLINE float ReduceMin(V v) { return v; }
+  static EP_FORCEINLINE float ReduceMax(V v) { return v; }
+  static EP_FORCEINLINE Sum SumZero() { return 0.0; }
+  static EP_FORCEINLINE Sum Add(Sum s, V v) { return s + (double)v; }
+  static EP_FORCEINLINE double ReduceSum(Sum s) { return s; }
+};
+
+#if (EP_FLOAT_SIMD==3)
+struct EpFloatLanesAvx2 {
+  enum { WIDTH = 8 };
+  typedef __m256 V;
+  typedef __m256 M;
+  struct Sum { __m256d lo, hi; };
+
+  static EP_FORCEINLINE V Load(const float* p) { return _mm256_loadu_ps(p); }
+  static EP_FORCEINLINE V Splat(float f) { return _mm256_set1_ps(f); }
+  static EP_FORCEINLINE M NonFinite(V v) {
+    __m256i e = _mm256_set1_epi32((int)EP_FLOAT_EXP_MASK);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_castps_si256(v), e), e));
+  }
+  static EP_FORCEINLINE M Nan(V v) { return _mm256_cmp_ps(v, v, _CMP_UNORD_Q); }
+  static EP_FORCEINLINE M Differ(V a, V b, V tolerance) {
+    V diff = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(a, b));
+    return _mm256_and_ps(_mm256_cmp_ps(diff, tolerance, _CMP_NLE_UQ), _mm256_cmp_ps(a, b, _CMP_NEQ_UQ));
+  }
+  static EP_FORCEINLINE M Or(M a, M b) { return _mm256_or_ps(a, b); }
+  static EP_FORCEINLINE unsigned Bits(M m) { return (unsigned)_mm256_movemask_ps(m); }
+  static EP_FORCEINLINE V Select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+  static EP_FORCEINLINE V Min(V a, V b) { return _mm256_min_ps(a, b); }
+  static EP_FORCEINLINE V Max(V a, V b) { return _mm256_max_ps(a, b); }
+  static EP_FORCEINLINE float ReduceMin(V v) {
+    __m128 x = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+    return _mm_cvtss_f32(_mm_min_ss(x, _mm_shuffle_ps(x, x, 1)));
+  }
+  static EP_FORCEINLINE float ReduceMax(V v) {
+    __m128 x = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    return _mm_cvtss_f32(_mm_max_ss(x, _mm_shuffle_ps(x, x, 1)));
+  }
+  static EP_FORCEINLINE Sum SumZero() { Sum s = { _mm256_setzero_pd(), _mm256_setzero_pd() }; return s; }
+  static EP_FORCEINLINE Sum Add(Sum s, V v) {
+    s.lo = _mm256_add_pd(s.lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    s.hi = _mm256_add_pd(s.hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    return s;
+  }
+  static EP_FORCEINLINE double ReduceSum(Sum s) {
+    double d[4];
+    _mm256_storeu_pd(d, _mm256_add_pd(s.lo, s.hi));
+    return (d[0] + d[1]) + (d[2] + d[3]);
+  }
+};
+typedef EpFloatLanesAvx2 EpFloatLanes;
+
+#elif (EP_FLOAT_SIMD==2)
+struct EpFloatLanesSse2 {
+  enum { WIDTH = 4 };
+  typedef __m128 V;
+  typedef __m128 M;
+  struct Sum { __m128d lo, hi; };
+
+  static EP_FORCEINLINE V Load(const float* p) { return _mm_loadu_ps(p); }
+  static EP_FORCEINLINE V Splat(float f) { return _mm_set1_ps(f); }
+  static EP_FORCEINLINE M NonFinite(V v) {
+    __m128i e = _mm_set1_epi32((int)EP_FLOAT_EXP_MASK);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_castps_si128(v), e), e));
+  }
+  static EP_FORCEINLINE M Nan(V v) { return _mm_cmpunord_ps(v, v); }
+  static EP_FORCEINLINE M Differ(V a, V b, V tolerance) {
+    V diff = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(a, b));
+    return _mm_and_ps(_mm_cmpnle_ps(diff, tolerance), _mm_cmpneq_ps(a, b));
+  }
+  static EP_FORCEINLINE M Or(M a, M b) { return _mm_or_ps(a, b); }
+  static EP_FORCEINLINE unsigned Bits(M m) { return (unsigned)_mm_movemask_ps(m); }
+  static EP_FORCEINLINE V Select(M m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+  static EP_FORCEINLINE V Min(V a, V b) { return _mm_min_ps(a, b); }
+  static EP_FORCEINLINE V Max(V a, V b) { return _mm_max_ps(a, b); }
+  static EP_FORCEINLINE float ReduceMin(V v) {
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+  }
+  static EP_FORCEINLINE float ReduceMax(V v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+  }
+  static EP_FORCEINLINE Sum SumZero() { Sum s = { _mm_setzero_pd(), _mm_setzero_pd() }; return s; }
+  static EP_FORCEINLINE Sum Add(Sum s, V v) {
+    s.lo = _mm_add_pd(s.lo, _mm_cvtps_pd(v));
+    s.hi = _mm_add_pd(s.hi, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    return s;
+  }
+  static EP_FORCEINLINE double ReduceSum(Sum s) {
+    double d[2];
+    _mm_storeu_pd(d, _mm_add_pd(s.lo, s.hi));
+    return d[0] + d[1];
+  }
+};
+typedef EpFloatLanesSse2 EpFloatLanes;
+
+#elif (EP_FLOAT_SIMD==1)
+struct EpFloatLanesNeon {
+  enum { WIDTH = 4 };
+  typedef float32x4_t V;
+  typedef uint32x4_t M;
+  struct Sum { float64x2_t lo, hi; };
+
+  static EP_FORCEINLINE V Load(const float* p) { return vld1q_f32(p); }
+  static EP_FORCEINLINE V Splat(float f) { return vdupq_n_f32(f); }
+  static EP_FORCEINLINE M NonFinite(V v) {
+    uint32x4_t e = vdupq_n_u32(EP_FLOAT_EXP_MASK);
+    return vceqq_u32(vandq_u32(vreinterpretq_u32_f32(v), e), e);
+  }
+  static EP_FORCEINLINE M Nan(V v) { return vmvnq_u32(vceqq_f32(v, v)); }
+  static EP_FORCEINLINE M Differ(V a, V b, V tolerance) {
+    return vandq_u32(vmvnq_u32(vcleq_f32(vabdq_f32(a, b), tolerance)), vmvnq_u32(vceqq_f32(a, b)));
+  }
+  static EP_FORCEINLINE M Or(M a, M b) { return vorrq_u32(a, b); }
+  static EP_FORCEINLINE unsigned Bits(M m) {
+    static const uint32_t lanes[4] = { 1u, 2u, 4u, 8u };
+    return vaddvq_u32(vandq_u32(m, vld1q_u32(lanes)));
+  }
+  static EP_FORCEINLINE V Select(M m, V a, V b) { return vbslq_f32(m, a, b); }
+  static EP_FORCEINLINE V Min(V a, V b) { return vminq_f32(a, b); }
+  static EP_FORCEINLINE V Max(V a, V b) { return vmaxq_f32(a, b); }
+  static EP_FORCEINLINE float ReduceMin(V v) { return vminvq_f32(v); }
+  static EP_FORCEINLINE float ReduceMax(V v) { return vmaxvq_f32(v); }
+  static EP_FORCEINLINE Sum SumZero() { Sum s = { vdupq_n_f64(0.0), vdupq_n_f64(0.0) }; return s; }
+  static EP_FORCEINLINE Sum Add(Sum s, V v) {
+    s.lo = vaddq_f64(s.lo, vcvt_f64_f32(vget_low_f32(v)));
+    s.hi = vaddq_f64(s.hi, vcvt_high_f64_f32(v));
+    return s;
+  }
+  static EP_FORCEINLINE double ReduceSum(Sum s) { return vaddvq_f64(vaddq_f64(s.lo, s.hi)); }
+};
+typedef EpFloatLanesNeon EpFloatLanes;
+
+#else
+typedef EpFloatLanesScalar EpFloatLanes;
+#endif
+
+// ----------------------------------------------------------------------------
+// Kernels.  Each processes whole vectors from begin and returns where it
+// stopped so the scalar version can finish the remainder.
+
+template<class L>
+static unsigned EpFindNonFiniteKernel(const float* ptr, unsigned begin, unsigned count) {
+  unsigned i = begin;
+  // Four vectors per branch.
+  for (; i + 4u * L::WIDTH <= count; i += 4u * L::WIDTH) {
+    typename L::M m = L::Or(L::Or(L::NonFinite(L::Load(ptr + i)), L::NonFinite(L::Load(ptr + i + L::WIDTH))),
+      L::Or(L::NonFinite(L::Load(ptr + i + 2u * L::WIDTH)), L::NonFinite(L::Load(ptr + i + 3u * L::WIDTH))));
+    if (L::Bits(m)) {
+      break;
+    }
+  }
+  for (; i + L::WIDTH <= count; i += L::WIDTH) {
+    unsigned bits = L::Bits(L::NonFinite(L::Load(ptr + i)));
+    if (bits) {
+      return i + EpFloatLowestBit(bits);
+    }
+  }
+  return i;
+}
+
+template<class L>
+struct EpFloatStatsKernel {
+  EpFloatStatsKernel() : min(L::Splat(FLT_MAX)), max(L::Splat(-FLT_MAX)), sum(L::SumZero()), nanCount(0u), nonFiniteCount(0u) { }
+
+  unsigned Run(const float* ptr, unsigned begin, unsigned count) {
+    unsigned i = begin;
+    typename L::V zero = L::Splat(0.0f);
+    typename L::V fltMax = L::Splat(FLT_MAX);
+    typename L::V fltMin = L::Splat(-FLT_MAX);
+    for (; i + L::WIDTH <= count; i += L::WIDTH) {
+      typename L::V v = L::Load(ptr + i);
+      typename L::M nonFinite = L::NonFinite(v);
+      unsigned bits = L::Bits(nonFinite);
+      if (bits) {
+        nonFiniteCount += EpFloatBitCount(bits);
+        nanCount += EpFloatBitCount(L::Bits(L::Nan(v)));
+        min = L::Min(min, L::Select(nonFinite, fltMax, v));
+        max = L::Max(max, L::Select(nonFinite, fltMin, v));
+        sum = L::Add(sum, L::Select(nonFinite, zero, v));
+      } else {
+        min = L::Min(min, v);
+        max = L::Max(max, v);
+        sum = L::Add(sum, v);
+      }
+    }
+    return i;
+  }
+
+  typename L::V min;
+  typename L::V max;
+  typename L::Sum sum;
+  unsigned nanCount;
+  unsigned nonFiniteCount;
+};
+
+template<class L>
+static unsigned EpFloatDiffKernel(const float* a, const float* b, unsigned begin, unsigned count, float tolerance,
+                                  unsigned* diffCount, unsigned* firstIndex) {
+  typename L::V tol = L::Splat(tolerance);
+  unsigned i = begin;
+  for (; i + L::WIDTH <= count; i += L::WIDTH) {
+    unsigned bits = L::Bits(L::Differ(L::Load(a + i), L::Load(b + i), tol));
+    if (bits) {
+      if (*diffCount == 0u) {
+        *firstIndex = i + EpFloatLowestBit(bits);
+      }
+      *diffCount += EpFloatBitCount(bits);
+    }
+  }
+  return i;
+}
+
+// ----------------------------------------------------------------------------
+
+unsigned EpFindNonFinite(const float* ptr, unsigned count) {
+  unsigned i = EpFindNonFiniteKernel<EpFloatLanes>(ptr, 0u, count);
+  return EpFindNonFiniteKernel<EpFloatLanesScalar>(ptr, i, count);
+}
+
+EpFloatStatsResult EpFloatStats(const float* ptr, unsigned count) {
+  EpFloatStatsKernel<EpFloatLanes> simd;
+  EpFloatStatsKernel<EpFloatLanesScalar> scalar;
+  scalar.Run(ptr, simd.Run(ptr, 0u, count), count);
+
+  EpFloatStatsResult result;
+  result.nanCount = simd.nanCount + scalar.nanCount;
+  result.infCount = simd.nonFiniteCount + scalar.nonFiniteCount - result.nanCount;
+  unsigned finiteCount = count - simd.nonFiniteCount - scalar.nonFiniteCount;
+  if (finiteCount == 0u) {
+    result.min = result.max = result.mean = 0.0f;
+    return result;
+  }
+  result.min = EpMin(EpFloatLanes::ReduceMin(simd.min), scalar.min);
+  result.max = EpMax(EpFloatLanes::ReduceMax(simd.max), scalar.max);
+  result.mean = (float)((EpFloatLanes::ReduceSum(simd.sum) + scalar.sum) / (double)finiteCount);
+  return result;
+}
+
+unsigned EpFloatDiff(const float* a, const float* b, unsigned count, float tolerance, unsigned* firstIndex) {
+  unsigned diffCount = 0u;
+  unsigned first = count;
+  unsigned i = EpFloatDiffKernel<EpFloatLanes>(a, b, 0u, count, tolerance, &diffCount, &first);
+  EpFloatDiffKernel<EpFloatLanesScalar>(a, b, i, count, tolerance, &diffCount, &first);
+  if (firstIndex) {
+    *firstIndex = first;
+  }
+  return diffCount;
+}
+
+void EpAssertFiniteAt(const float* ptr, unsigned count, const char* label, const char* file, unsigned line) {
+  unsigned i = EpFindNonFinite(ptr, count);
+  if (i != count) {
+    EpLogHandler(EpLogLevel_Assert, "%s[%u] is %f", label, i, ptr[i]);
+    EpAssertHandler(file, line);
+  }
+}
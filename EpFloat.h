@@ -0,0 +1,37 @@
+#pragma once
+
+#include "EmbeddedPlatform.h"
+
+// ----------------------------------------------------------------------------
+// Bulk float validation
+//
+// SIMD versions of EpIsFinite() for whole buffers.  EP_FLOAT_SIMD selects
+// AVX2, SSE2 or NEON from the compiler's target flags.  Define it as 0 for the
+// portable version.  Results are identical for every path.  Buffers need no
+// particular alignment.
+
+struct EpFloatStatsResult {
+  float min; // Of the finite values.  0 when there are none.
+  float max;
+  float mean;
+  unsigned nanCount;
+  unsigned infCount;
+};
+
+// Returns the index of the first NaN or infinity, or count if there is none.
+unsigned EpFindNonFinite(const float* ptr, unsigned count);
+
+EpFloatStatsResult EpFloatStats(const float* ptr, unsigned count);
+
+// Returns the number of elements that are not equal and differ by more than
+// tolerance.  NaN always differs.  firstIndex is set to the first of them, or
+// to count.
+unsigned EpFloatDiff(const float* a, const float* b, unsigned count, float tolerance, unsigned* firstIndex=0);
+
+#if (EP_DEBUG==1)
+#define EpAssertFinite(ptr, count) EpAssertFiniteAt((ptr), (count), #ptr, __FILE__, __LINE__)
+#else
+#define EpAssertFinite(ptr, count) ((void)0)
+#endif
+
+void EpAssertFiniteAt(const float* ptr, unsigned count, const char* label, const char* file, unsigned line);
@@ -0,0 +1,117 @@
+#include "EmbeddedPlatform.h"
+#include "EpFloat.h"
+#include "EpAllocatorScope.h"
+#include "EpProfiler.h"
+#include "EpTest.h"
+
+#include <float.h>
+
+class EpFloatTest :
+  public testing::Test
+{
+public:
+  enum { BUFFER_SIZE = 1024, BENCHMARK_SIZE = 1 << 16 };
+
+  EpFloatTest() {
+    for (int i = 0; i < (int)BUFFER_SIZE; ++i) {
+      s_a[i] = (float)(i % 37) - 11.5f;
+      s_b[i] = s_a[i];
+    }
+  }
+
+  static unsigned FindNonFiniteReference(const float* ptr, unsigned count) {
+    unsigned i = 0u;
+    while (i < count && EpIsFinite(ptr[i])) { ++i; }
+    return i;
+  }
+
+  static float s_a[BUFFER_SIZE];
+  static float s_b[BUFFER_SIZE];
+};
+
+float EpFloatTest::s_a[EpFloatTest::BUFFER_SIZE];
+float EpFloatTest::s_b[EpFloatTest::BUFFER_SIZE];
+
+TEST_F(EpFloatTest, FindNonFinite) {
+  ASSERT_EQ(EpFindNonFinite(s_a, BUFFER_SIZE), (unsigned)BUFFER_SIZE);
+
+  // Every offset and length near a vector boundary.
+  s_a[100] = g_epNAN;
+  s_a[130] = FLT_MAX * 2.0f;
+  for (unsigned begin = 90u; begin < 132u; ++begin) {
+    for (unsigned count = 0u; count < 48u; ++count) {
+      unsigned index = EpFindNonFinite(s_a + begin, count);
+      ASSERT_EQ(index, FindNonFiniteReference(s_a + begin, count));
+    }
+  }
+
+  s_a[100] = 1.0f;
+  s_a[130] = -FLT_MAX; // Finite
+  ASSERT_EQ(EpFindNonFinite(s_a, BUFFER_SIZE), (unsigned)BUFFER_SIZE);
+  EpAssertFinite(s_a, BUFFER_SIZE);
+}
+
+TEST_F(EpFloatTest, Stats) {
+  s_a[3] = g_epNAN;
+  s_a[500] = -FLT_MAX * 2.0f;
+  s_a[1021] = FLT_MAX * 2.0f; // In the scalar remainder for odd counts.
+  s_a[7] = 1000.0f;
+  s_a[1020] = -2000.0f;
+
+  EpFloatStatsResult stats = EpFloatStats(s_a, BUFFER_SIZE - 1u);
+  ASSERT_EQ(stats.nanCount, 1u);
+  ASSERT_EQ(stats.infCount, 2u);
+  ASSERT_EQ(stats.min, -2000.0f);
+  ASSERT_EQ(stats.max, 1000.0f);
+
+  double sum = 0.0;
+  for (unsigned i = 0u; i < BUFFER_SIZE - 1u; ++i) {
+    sum += EpIsFinite(s_a[i]) ? s_a[i] : 0.0f;
+  }
+  ASSERT_NEAR(stats.mean, (float)(sum / (BUFFER_SIZE - 4u)), 1.0e-5f);
+
+  stats = EpFloatStats(s_a + 3, 1u);
+  ASSERT_EQ(stats.nanCount, 1u);
+  ASSERT_EQ(stats.mean, 0.0f); // No finite values.
+}
+
+TEST_F(EpFloatTest, Diff) {
+  unsigned first = 0u;
+  unsigned diffCount = EpFloatDiff(s_a, s_b, BUFFER_SIZE, 0.0f, &first);
+  ASSERT_EQ(diffCount, 0u);
+  ASSERT_EQ(first, (unsigned)BUFFER_SIZE);
+
+  s_a[9] = s_b[9] = FLT_MAX * 2.0f; // Equal infinities do not differ.
+  s_b[10] += 0.25f; // Within tolerance.
+  s_b[17] += 1.0f;
+  s_a[600] = g_epNAN;
+  s_b[600] = g_epNAN;
+  s_b[1023] -= 1.0f;
+  diffCount = EpFloatDiff(s_a, s_b, BUFFER_SIZE, 0.5f, &first);
+  ASSERT_EQ(diffCount, 3u);
+  ASSERT_EQ(first, 17u);
+
+  diffCount = EpFloatDiff(s_a + 18, s_b + 18, BUFFER_SIZE - 18u, 0.5f, &first);
+  ASSERT_EQ(diffCount, 2u);
+  ASSERT_EQ(first, 600u - 18u);
+}
+
+// Logs cycles per float for EpFindNonFinite() and for an EpIsFinite() loop.
+TEST_F(EpFloatTest, FindNonFiniteBenchmark) {
+  EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+  float* buffer = (float*)EpMalloc(BENCHMARK_SIZE * sizeof(float));
+  for (int i = 0; i < (int)BENCHMARK_SIZE; ++i) {
+    buffer[i] = (float)i;
+  }
+
+  unsigned t0 = EpProfilerSample();
+  unsigned index = EpFindNonFinite(buffer, BENCHMARK_SIZE);
+  unsigned t1 = EpProfilerSample();
+  unsigned reference = FindNonFiniteReference(buffer, BENCHMARK_SIZE);
+  unsigned t2 = EpProfilerSample();
+
+  EpLog("EpFindNonFinite: %.2f cycles per float, EpIsFinite loop %.2f\n",
+    (double)(t1 - t0) / (double)BENCHMARK_SIZE, (double)(t2 - t1) / (double)BENCHMARK_SIZE);
+  ASSERT_EQ(index, reference);
+  EpFree(buffer);
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "EpAllocator.h"
+
+#include <new>
+
+// ----------------------------------------------------------------------------
+// EpHash
+//
+// 32-bit hash functor used by EpHashMap.  Integers and pointers are mixed
+// directly, anything else hashes its bytes, which suits plain structs without
+// padding.  Specialize for other key types.
+
+EP_FORCEINLINE uint32_t EpHashMix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  return (uint32_t)x;
+}
+
+template<class K>
+struct EpHash {
+  EP_FORCEINLINE uint32_t operator()(const K& key) const {
+    const unsigned char* it = (const unsigned char*)&key;
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0u; i < sizeof(K); ++i) {
+      hash = (hash ^ it[i]) * 16777619u;
+    }
+    return hash;
+  }
+};
+
+#define EP_HASH_INTEGER(K) template<> struct EpHash<K> { \
+  EP_FORCEINLINE uint32_t operator()(K key) const { return EpHashMix((uint64_t)key); } }
+EP_HASH_INTEGER(char);
+EP_HASH_INTEGER(signed char);
+EP_HASH_INTEGER(unsigned char);
+EP_HASH_INTEGER(short);
+EP_HASH_INTEGER(unsigned short);
+EP_HASH_INTEGER(int);
+EP_HASH_INTEGER(unsigned int);
+EP_HASH_INTEGER(long);
+EP_HASH_INTEGER(unsigned long);
+EP_HASH_INTEGER(long long);
+EP_HASH_INTEGER(unsigned long long);
+#undef EP_HASH_INTEGER
+
+template<class K>
+struct EpHash<K*> {
+  EP_FORCEINLINE uint32_t operator()(const K* key) const { return EpHashMix((uint64_t)(uintptr_t)key); }
+};
+
+// ----------------------------------------------------------------------------
+// EpHashMapSlot
+
+template<class K, class V>
+struct EpHashMapSlot {
+  uint32_t probe; // 0 when empty, otherwise 1 + distance from the home slot.
+  K key;
+  V value;
+};
+
+// ----------------------------------------------------------------------------
+// EpHashMap
+//
+// Open addressing hash map using Robin Hood linear probing.  Like EpArray the
+// storage is either fixed or allocated once by reserve() and is never
+// reallocated.  Capacity is the slot count and must be a power of 2.  Keep
+// the load under about 80% for short probes.  Keys and values are only
+// constructed while in use, so neither requires a default constructor unless
+// operator[] is used.  Erasing shifts the following cluster back, so pointers
+// to values are invalidated by any modification.
+
+template<class K, class V, unsigned Capacity=EpAllocatorMode_Dynamic, class Hash=EpHash<K> >
+class EpHashMap : private EpAllocator<EpHashMapSlot<K, V>, Capacity> {
+public:
+  typedef EpHashMapSlot<K, V> slot_type;
+  typedef EpAllocator<slot_type, Capacity> allocator_type;
+
+  static_assert((Capacity & (Capacity - 1u)) == 0u, "EpHashMap: Capacity must be a power of 2");
+
+  // Visits occupied slots in storage order.
+  class iterator {
+  public:
+    EP_FORCEINLINE iterator(slot_type* it, slot_type* end) : m_it(it), m_end(end) { Skip(); }
+    EP_FORCEINLINE slot_type& operator*() const { return *m_it; }
+    EP_FORCEINLINE slot_type* operator->() const { return m_it; }
+    EP_FORCEINLINE iterator& operator++() { ++m_it; Skip(); return *this; }
+    EP_FORCEINLINE bool operator==(const iterator& rhs) const { return m_it == rhs.m_it; }
+    EP_FORCEINLINE bool operator!=(const iterator& rhs) const { return m_it != rhs.m_it; }
+  private:
+    EP_FORCEINLINE void Skip() { while (m_it != m_end && m_it->probe == 0u) { ++m_it; } }
+    slot_type* m_it;
+    slot_type* m_end;
+  };
+
+  EP_FORCEINLINE EpHashMap() {
+    m_size = 0u;
+    if (Capacity != EpAllocatorMode_Dynamic) {
+      MarkEmpty();
+    }
+  }
+
+  EP_FORCEINLINE ~EpHashMap() {
+    clear();
+  }
+
+  EP_FORCEINLINE unsigned size() const { return m_size; }
+  EP_FORCEINLINE unsigned capacity() const { return this->GetCapacity(); }
+  EP_FORCEINLINE bool empty() const { return m_size == 0u; }
+
+  EP_FORCEINLINE iterator begin() const { return iterator(this->GetStorage(), this->GetStorage() + capacity()); }
+  EP_FORCEINLINE iterator end() const { return iterator(this->GetStorage() + capacity(), this->GetStorage() + capacity()); }
+
+  // Rounds up to a power of 2.  Only allocates once when dynamic.
+  EP_FORCEINLINE void reserve(unsigned c) {
+    if (c <= capacity()) {
+      return;
+    }
+    unsigned slots = 1u;
+    while (slots < c) {
+      slots <<= 1;
+    }
+    this->Reserve(slots);
+    MarkEmpty();
+  }
+
+  EP_FORCEINLINE void clear() {
+    slot_type* storage = this->GetStorage();
+    for (unsigned i = 0u; i < capacity() && m_size != 0u; ++i) {
+      if (storage[i].probe != 0u) {
+        Destruct(storage[i]);
+        --m_size;
+      }
+    }
+  }
+
+  // Returns NULL if key is not present.
+  EP_FORCEINLINE V* find(const K& key) const {
+    unsigned index = Find(key);
+    return index != NOT_FOUND ? &this->GetStorage()[index].value : NULL;
+  }
+
+  EP_FORCEINLINE bool contains(const K& key) const {
+    return Find(key) != NOT_FOUND;
+  }
+
+  // Inserts a default constructed value if key is not present.
+  EP_FORCEINLINE V& operator[](const K& key) {
+    V* value = find(key);
+    return value ? *value : *Insert(key, V());
+  }
+
+  // Returns false and leaves the existing value if key is present.
+  EP_FORCEINLINE bool insert(const K& key, const V& value) {
+    if (Find(key) != NOT_FOUND) {
+      return false;
+    }
+    Insert(key, value);
+    return true;
+  }
+
+  EP_FORCEINLINE bool erase(const K& key) {
+    unsigned index = Find(key);
+    if (index == NOT_FOUND) {
+      return false;
+    }
+
+    // Backward shift the rest of the cluster so that no tombstones are needed.
+    slot_type* storage = this->GetStorage();
+    const unsigned mask = capacity() - 1u;
+    Destruct(storage[index]);
+    unsigned next = (index + 1u) & mask;
+    while (storage[next].probe > 1u) {
+      slot_type& from = storage[next];
+      slot_type& to = storage[index];
+      ::new (&to.key) K(EpMove(from.key));
+      ::new (&to.value) V(EpMove(from.value));
+      to.probe = from.probe - 1u;
+      Destruct(from);
+      index = next;
+      next = (next + 1u) & mask;
+    }
+    --m_size;
+    return true;
+  }
+
+  // Checks every probe distance against the hash.
+  void Validate() const {
+    const slot_type* storage = this->GetStorage();
+    const unsigned mask = capacity() - 1u;
+    unsigned count = 0u;
+    for (unsigned i = 0u; i < capacity(); ++i) {
+      if (storage[i].probe != 0u) {
+        unsigned home = Hash()(storage[i].key) & mask;
+        EpReleaseAssertMsg(((home + storage[i].probe - 1u) & mask) == i, "EpHashMap: probe corrupt at %u", i);
+        ++count;
+      }
+    }
+    EpReleaseAssertMsg(count == m_size, "EpHashMap: size corrupt");
+  }
+
+private:
+  EpHashMap(const EpHashMap&);
+  void operator=(const EpHashMap&);
+
+  enum { NOT_FOUND = ~0u };
+
+  EP_FORCEINLINE void MarkEmpty() {
+    slot_type* storage = this->GetStorage();
+    for (unsigned i = 0u; i < capacity(); ++i) {
+      storage[i].probe = 0u;
+    }
+  }
+
+  EP_FORCEINLINE unsigned Find(const K& key) const {
+    if (m_size == 0u) {
+      return NOT_FOUND;
+    }
+    const slot_type* storage = this->GetStorage();
+    const unsigned mask = capacity() - 1u;
+    unsigned index = Hash()(key) & mask;
+    // Robin Hood ordering ends the search at the first slot closer to home.
+    for (uint32_t probe = 1u; probe <= storage[index].probe; ++probe) {
+      if (storage[index].key == key) {
+        return index;
+      }
+      index = (index + 1u) & mask;
+    }
+    return NOT_FOUND;
+  }
+
+  // key must not be present.
+  EP_FORCEINLINE V* Insert(const K& key, const V& value) {
+    EpReleaseAssertMsg(m_size < capacity(), "EpHashMap: Overflowing capacity.");
+    slot_type* storage = this->GetStorage();
+    const unsigned mask = capacity() - 1u;
+    unsigned index = Hash()(key) & mask;
+    uint32_t probe = 1u;
+    ++m_size;
+
+    // Skip slots that are no further from home than the new key.
+    while (storage[index].probe >= probe) {
+      index = (index + 1u) & mask;
+      ++probe;
+    }
+
+    slot_type& slot = storage[index];
+    if (slot.probe == 0u) {
+      ::new (&slot.key) K(key);
+      ::new (&slot.value) V(value);
+      slot.probe = probe;
+      return &slot.value;
+    }
+
+    // Take the slot from a richer entry and carry it on to the next hole.
+    K carryKey(EpMove(slot.key));
+    V carryValue(EpMove(slot.value));
+    uint32_t carryProbe = slot.probe;
+    slot.key = key;
+    slot.value = value;
+    slot.probe = probe;
+    V* result = &slot.value;
+
+    for (;;) {
+      index = (index + 1u) & mask;
+      ++carryProbe;
+      slot_type& next = storage[index];
+      if (next.probe == 0u) {
+        ::new (&next.key) K(EpMove(carryKey));
+        ::new (&next.value) V(EpMove(carryValue));
+        next.probe = carryProbe;
+        return result;
+      }
+      if (next.probe < carryProbe) {
+        EpSwap(next.key, carryKey);
+        EpSwap(next.value, carryValue);
+        EpSwap(next.probe, carryProbe);
+      }
+    }
+  }
+
+  EP_FORCEINLINE void Destruct(slot_type& slot) {
+    slot.key.~K();
+    slot.value.~V();
+    if (EpIsDebug()) {
+      ::memset((void*)&slot, 0xab, sizeof slot);
+    }
+    slot.probe = 0u;
+  }
+
+  unsigned m_size;
+};
@@ -0,0 +1,107 @@
+#include "EmbeddedPlatform.h"
+#include "EpHashMap.h"
+#include "EpTest.h"
+
+class EpHashMapTest :
+  public testing::Test
+{
+public:
+  // Collides every key into a few home slots to exercise probing.
+  struct BadHash {
+    uint32_t operator()(int key) const { return (uint32_t)key & 3u; }
+  };
+};
+
+TEST_F(EpHashMapTest, Allocators) {
+  EpHashMap<int, float, 16u> fixed;
+  EpHashMap<int, float> dynamic;
+  ASSERT_EQ(dynamic.capacity(), 0u);
+  ASSERT_TRUE((dynamic.find(1) == NULL));
+  dynamic.reserve(20u);
+
+  ASSERT_EQ(fixed.capacity(), 16u);
+  ASSERT_EQ(dynamic.capacity(), 32u); // Rounded to a power of 2.
+  ASSERT_TRUE(fixed.empty());
+  ASSERT_TRUE(dynamic.empty());
+}
+
+TEST_F(EpHashMapTest, Modification) {
+  EpHashMap<int, int, 64u> map;
+  for (int i = 0; i < 48; ++i) {
+    bool isInserted = map.insert(i * 7, i);
+    ASSERT_TRUE(isInserted);
+  }
+  bool isInserted = map.insert(7, 100);
+  ASSERT_FALSE(isInserted); // Present
+  ASSERT_EQ(map.size(), 48u);
+  EpValidate(map);
+
+  for (int i = 0; i < 48; ++i) {
+    const int* value = map.find(i * 7);
+    ASSERT_TRUE((value != NULL));
+    ASSERT_EQ((value ? *value : -1), i);
+  }
+  ASSERT_FALSE(map.contains(8));
+
+  for (int i = 0; i < 48; i += 2) {
+    bool isErased = map.erase(i * 7);
+    ASSERT_TRUE(isErased);
+  }
+  bool isErased = map.erase(0);
+  ASSERT_FALSE(isErased);
+  ASSERT_EQ(map.size(), 24u);
+  EpValidate(map);
+
+  for (int i = 0; i < 48; ++i) {
+    ASSERT_EQ(map.contains(i * 7), ((i & 1) != 0));
+  }
+
+  map[1000] = 5;
+  map[1000] += 1;
+  ASSERT_EQ(map[1000], 6);
+
+  int count = 0;
+  for (EpHashMap<int, int, 64u>::iterator it = map.begin(); it != map.end(); ++it) {
+    ++count;
+  }
+  ASSERT_EQ(count, 25);
+
+  map.clear();
+  ASSERT_TRUE(map.empty());
+  ASSERT_FALSE(map.contains(7));
+}
+
+TEST_F(EpHashMapTest, Collisions) {
+  EpHashMap<int, int, 32u, BadHash> map;
+  for (int i = 0; i < 24; ++i) {
+    map.insert(i, -i);
+  }
+  EpValidate(map);
+
+  // Erasing from the middle of a cluster shifts the rest back.
+  for (int i = 0; i < 24; i += 3) {
+    map.erase(i);
+  }
+  EpValidate(map);
+
+  for (int i = 0; i < 24; ++i) {
+    const int* value = map.find(i);
+    ASSERT_EQ((value != NULL), ((i % 3) != 0));
+    if (value) {
+      ASSERT_EQ(*value, -i);
+    }
+  }
+}
+
+BENCHMARK_F(EpHashMapTest, FindBenchmark) {
+  EpHashMap<int, int> map;
+  map.reserve(2048u);
+  for (int i = 0; i < 1024; ++i) {
+    map[i * 7] = i;
+  }
+  int key = 0;
+  while (state.KeepRunning()) {
+    EpBenchmarkDoNotOptimize(map.find(key));
+    key = (key + 7) & 8191;
+  }
+}
@@ -0,0 +1,228 @@
+#include "EpJobSystem.h"
+#include "EpAllocatorScope.h"
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+// Failed attempts to find a job before a worker sleeps.
+#define EP_JOB_SPIN_COUNT 64
+
+// The job system the calling thread belongs to and its index in m_workers.
+static thread_local EpJobSystem* t_epJobSystem = 0;
+static thread_local unsigned t_epJobThreadIndex = 0u;
+
+struct EpParallelForState {
+  EpJobFunction function;
+  void* data;
+  unsigned end;
+  unsigned grainSize;
+  std::atomic<unsigned> next;
+};
+
+EpJobSystem::EpJobSystem() : m_isStopping(false), m_queuedCount(0), m_sleepingCount(0) {
+  m_workerCount = 0u;
+  m_isStarted = false;
+  for (unsigned i = 0u; i <= (unsigned)MAX_WORKERS; ++i) {
+    m_workers[i].temporaryStack = 0;
+  }
+}
+
+EpJobSystem::~EpJobSystem() {
+  Stop();
+}
+
+void EpJobSystem::Start(unsigned workerCount, size_t temporaryStackBytes) {
+  EpReleaseAssertMsg(!m_isStarted && t_epJobSystem == 0, "EpJobSystem: Already started");
+  if (workerCount == 0u) {
+    unsigned cores = std::thread::hardware_concurrency();
+    workerCount = cores > 1u ? cores - 1u : 0u;
+  }
+  m_workerCount = EpMin(workerCount, (unsigned)MAX_WORKERS);
+  m_isStarted = true;
+  m_isStopping = false;
+  t_epJobSystem = this;
+  t_epJobThreadIndex = 0u;
+
+  EpAllocatorScope heapScope(EpMemoryAllocatorId_Heap);
+  for (unsigned i = 1u; i <= m_workerCount; ++i) {
+    Worker& worker = m_workers[i];
+    worker.temporaryStack = EpMalloc(temporaryStackBytes);
+#if (EP_PROFILE==1)
+    worker.profilerData.m_records.reserve(EP_PROFILER_MAX_RECORDS);
+    worker.profilerData.m_isEnabled = true;
+#endif
+    worker.thread = std::thread(&EpJobSystem::WorkerMain, this, i, temporaryStackBytes);
+  }
+}
+
+void EpJobSystem::Stop() {
+  if (!m_isStarted) {
+    return;
+  }
+  EpReleaseAssertMsg(ThreadIndex() == 0u, "EpJobSystem: Stop from a worker");
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isStopping = true;
+  }
+  m_wake.notify_all();
+
+  for (unsigned i = 1u; i <= m_workerCount; ++i) {
+    Worker& worker = m_workers[i];
+    worker.thread.join();
+    EpFree(worker.temporaryStack);
+    worker.temporaryStack = 0;
+#if (EP_PROFILE==1)
+    EpArray<EpProfilerRecord> released(EpMove(worker.profilerData.m_records));
+#endif
+  }
+  m_workerCount = 0u;
+  m_isStarted = false;
+  t_epJobSystem = 0;
+}
+
+void EpJobSystem::Run(EpJob* jobs, unsigned count, EpJobCounter& counter) {
+  counter.m_count.fetch_add((int)count, std::memory_order_relaxed);
+  for (unsigned i = 0u; i < count; ++i) {
+    jobs[i].counter = &counter;
+  }
+  if (!m_isStarted) {
+    for (unsigned i = 0u; i < count; ++i) {
+      Execute(jobs + i);
+    }
+    return;
+  }
+
+  // Counted before they can be taken.
+  Worker& self = m_workers[ThreadIndex()];
+  m_queuedCount.fetch_add((int)count);
+  for (unsigned i = 0u; i < count; ++i) {
+    if (!self.deque.push(jobs + i)) {
+      m_queuedCount.fetch_sub(1);
+      Execute(jobs + i);
+    }
+  }
+
+  // Sleepers check m_queuedCount under the lock before waiting.
+  if (m_sleepingCount.load() > 0) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wake.notify_all();
+  }
+}
+
+void EpJobSystem::Wait(EpJobCounter& counter) {
+  if (!m_isStarted) {
+    EpAssert(counter.IsDone());
+    return;
+  }
+  unsigned index = ThreadIndex();
+  while (!counter.IsDone()) {
+    if (!RunOne(index)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void EpJobSystem::ParallelFor(unsigned begin, unsigned end, unsigned grainSize, EpJobFunction function, void* data) {
+  if (begin >= end) {
+    return;
+  }
+  EpParallelForState state;
+  state.function = function;
+  state.data = data;
+  state.end = end;
+  state.grainSize = EpMax(grainSize, 1u);
+  state.next.store(begin, std::memory_order_relaxed);
+
+  // The calling thread takes ranges too.
+  unsigned rangeCount = (end - begin - 1u) / state.grainSize + 1u;
+  unsigned jobCount = m_isStarted ? EpMin(rangeCount - 1u, m_workerCount) : 0u;
+  EpJob jobs[MAX_WORKERS];
+  for (unsigned i = 0u; i < jobCount; ++i) {
+    jobs[i].Set(&ParallelForJob, &state);
+  }
+  EpJobCounter counter;
+  Run(jobs, jobCount, counter);
+  ParallelForJob(&state, 0u, 0u);
+  Wait(counter);
+}
+
+void EpJobSystem::LogWorkerProfiles() {
+#if (EP_PROFILE==1)
+  for (unsigned i = 1u; i <= m_workerCount; ++i) {
+    EpLog("EpJobSystem worker %u:\n", i);
+    EpProfilerLog(m_workers[i].profilerData);
+  }
+#endif
+}
+
+void EpJobSystem::ParallelForJob(void* data, unsigned, unsigned) {
+  EpParallelForState& state = *(EpParallelForState*)data;
+  for (;;) {
+    unsigned begin = state.next.fetch_add(state.grainSize, std::memory_order_relaxed);
+    if (begin >= state.end) {
+      return;
+    }
+    EpAllocatorScope rangeScope(EpMemoryAllocatorId_TemporaryStack);
+    state.function(state.data, begin, state.end - begin > state.grainSize ? begin + state.grainSize : state.end);
+  }
+}
+
+void EpJobSystem::WorkerMain(unsigned index, size_t temporaryStackBytes) {
+  Worker& self = m_workers[index];
+  t_epJobSystem = this;
+  t_epJobThreadIndex = index;
+  EpMemoryManagementThreadInit(self.temporaryStack, temporaryStackBytes);
+  EpProfilerThreadInit(&self.profilerData);
+
+  int spinCount = 0;
+  while (!m_isStopping.load(std::memory_order_relaxed)) {
+    if (RunOne(index)) {
+      spinCount = 0;
+    } else if (++spinCount < EP_JOB_SPIN_COUNT) {
+      std::this_thread::yield();
+    } else {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_sleepingCount.fetch_add(1);
+      while (m_queuedCount.load() <= 0 && !m_isStopping.load()) {
+        m_wake.wait(lock);
+      }
+      m_sleepingCount.fetch_sub(1);
+      spinCount = 0;
+    }
+  }
+
+  EpProfilerThreadShutDown();
+  EpMemoryManagementThreadShutDown();
+  t_epJobSystem = 0;
+}
+
+// Pops the newest local job, or steals the oldest job of another thread
+// starting with the next one along.
+bool EpJobSystem::RunOne(unsigned index) {
+  EpJob* job = 0;
+  bool isFound = m_workers[index].deque.pop(job);
+  for (unsigned i = 1u; !isFound && i <= m_workerCount; ++i) {
+    isFound = m_workers[(index + i) % (m_workerCount + 1u)].deque.steal(job);
+  }
+  if (!isFound) {
+    return false;
+  }
+  m_queuedCount.fetch_sub(1, std::memory_order_relaxed);
+  Execute(job);
+  return true;
+}
+
+void EpJobSystem::Execute(EpJob* job) {
+  EpJobCounter* counter = job->counter;
+  {
+    EpAllocatorScope jobScope(EpMemoryAllocatorId_TemporaryStack);
+    job->function(job->data, job->begin, job->end);
+  }
+  counter->m_count.fetch_sub(1, std::memory_order_release); // The job may be freed after this.
+}
+
+unsigned EpJobSystem::ThreadIndex() const {
+  EpReleaseAssertMsg(t_epJobSystem == this, "EpJobSystem: Not a thread of this job system");
+  return t_epJobThreadIndex;
+}
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
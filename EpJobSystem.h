@@ -0,0 +1,133 @@
+#pragma once
+
+#include "EmbeddedPlatform.h"
+#include "EpProfiler.h"
+#include "EpQueue.h"
+
+// ----------------------------------------------------------------------------
+// EpJobSystem
+//
+// A fixed number of worker threads that run EpJobs.  Jobs and counters belong
+// to the caller and nothing is allocated after Start().  Each thread pushes the
+// jobs it submits onto its own EpWorkStealingDeque and idle threads steal from
+// the others.  Waiting threads run jobs until their counter reaches zero, so
+// jobs may submit and wait for other jobs.
+//
+// Workers have their own temporary stack, which is their only allocator and
+// is reset after each job, and their own profiler records.  Jobs may only be
+// submitted by the thread that called Start() and by jobs.  Requires C++11
+// threads.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define EP_JOB_TEMPORARY_STACK (64 * 1024) // Bytes per worker.
+
+typedef void (*EpJobFunction)(void* data, unsigned begin, unsigned end);
+
+// Counts unfinished jobs.  Must outlive the jobs counted.
+class EpJobCounter {
+public:
+  EpJobCounter() : m_count(0) { }
+  bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class EpJobSystem;
+  EpJobCounter(const EpJobCounter&);
+  void operator=(const EpJobCounter&);
+
+  std::atomic<int> m_count;
+};
+
+struct EpJob {
+  void Set(EpJobFunction function_, void* data_, unsigned begin_=0u, unsigned end_=0u) {
+    function = function_;
+    data = data_;
+    begin = begin_;
+    end = end_;
+  }
+
+  EpJobFunction function;
+  void* data;
+  unsigned begin;
+  unsigned end;
+  EpJobCounter* counter; // Set by Run().
+};
+
+class EpJobSystem {
+public:
+  enum { MAX_WORKERS = 15, DEQUE_CAPACITY = 256 };
+
+  EpJobSystem();
+  ~EpJobSystem(); // Calls Stop().
+
+  // workerCount 0 starts one worker per additional core.  Allocates the
+  // workers' temporary stacks and profiler records from the heap.
+  void Start(unsigned workerCount=0u, size_t temporaryStackBytes=EP_JOB_TEMPORARY_STACK);
+
+  // Waits for the workers to finish their current jobs.  Queued jobs are not
+  // run.
+  void Stop();
+
+  unsigned GetWorkerCount() const { return m_workerCount; }
+  bool IsStarted() const { return m_isStarted; }
+
+  // Adds count to counter and queues the jobs.  When not started, or when the
+  // deque is full, jobs run before returning.
+  void Run(EpJob* jobs, unsigned count, EpJobCounter& counter);
+
+  // Runs queued jobs until counter reaches zero.
+  void Wait(EpJobCounter& counter);
+
+  // Calls function(data, i, j) for consecutive ranges of at most grainSize
+  // covering [begin, end) and waits for them.  Ranges are claimed by all threads
+  // in turn, so smaller grains balance better and cost more.
+  void ParallelFor(unsigned begin, unsigned end, unsigned grainSize, EpJobFunction function, void* data);
+
+  // f(i, j) as above.
+  template<class Function>
+  void ParallelFor(unsigned begin, unsigned end, unsigned grainSize, const Function& f) {
+    ParallelFor(begin, end, grainSize, &CallRange<Function>, (void*)&f);
+  }
+
+  // Logs and clears each worker's profiler records.  Call while idle.
+  void LogWorkerProfiles();
+
+private:
+  EpJobSystem(const EpJobSystem&);
+  void operator=(const EpJobSystem&);
+
+  struct Worker {
+    EpWorkStealingDeque<EpJob*, DEQUE_CAPACITY> deque;
+    std::thread thread;
+    void* temporaryStack;
+#if (EP_PROFILE==1)
+    EpProfilerData profilerData;
+#endif
+  };
+
+  template<class Function>
+  static void CallRange(void* f, unsigned begin, unsigned end) { (*(const Function*)f)(begin, end); }
+
+  static void ParallelForJob(void* data, unsigned begin, unsigned end);
+
+  void WorkerMain(unsigned index, size_t temporaryStackBytes);
+  bool RunOne(unsigned index);
+  void Execute(EpJob* job);
+  unsigned ThreadIndex() const;
+
+  Worker m_workers[MAX_WORKERS + 1]; // [0] is the thread that called Start().
+  unsigned m_workerCount;
+  bool m_isStarted;
+  std::atomic<bool> m_isStopping;
+  std::atomic<int> m_queuedCount; // Jobs in all deques.
+  std::atomic<int> m_sleepingCount;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+};
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
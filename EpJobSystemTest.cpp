@@ -0,0 +1,165 @@
+#include "EmbeddedPlatform.h"
+#include "EpJobSystem.h"
+#include "EpAllocatorScope.h"
+#include "EpProfiler.h"
+#include "EpTest.h"
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+// Three workers are started whatever the core count, so the threads are also
+// exercised on a single core.
+
+class EpJobSystemTest :
+  public testing::Test
+{
+public:
+  enum { WORKER_COUNT = 3, ITEM_COUNT = 10000 };
+
+  EpJobSystemTest() {
+    s_jobSystem.Start(WORKER_COUNT);
+    for (int i = 0; i < (int)ITEM_COUNT; ++i) {
+      s_visits[i] = 0;
+    }
+  }
+
+  ~EpJobSystemTest() {
+    s_jobSystem.Stop();
+  }
+
+  static void Visit(void* data, unsigned begin, unsigned end) {
+    for (unsigned i = begin; i < end; ++i) {
+      ++((int*)data)[i];
+    }
+  }
+
+  static void ProfiledVisit(void* data, unsigned begin, unsigned end) {
+    EpProfileScope("EpJobSystemTest", 0u);
+    Visit(data, begin, end);
+  }
+
+  // Submits and waits for two more jobs, each with half the range.
+  static void Split(void* data, unsigned begin, unsigned end) {
+    if (end - begin <= 100u) {
+      Visit(data, begin, end);
+      return;
+    }
+    unsigned middle = begin + (end - begin) / 2u;
+    EpJob jobs[2];
+    jobs[0].Set(&Split, data, begin, middle);
+    jobs[1].Set(&Split, data, middle, end);
+    EpJobCounter counter;
+    s_jobSystem.Run(jobs, 2u, counter);
+    s_jobSystem.Wait(counter);
+  }
+
+  // Fills and checks temporary stack allocations.
+  static void Allocate(void* data, unsigned begin, unsigned end) {
+    for (unsigned i = begin; i < end; ++i) {
+      unsigned char* bytes = (unsigned char*)EpMalloc(1024u);
+      ::memset(bytes, (int)i, 1024u);
+      if (bytes[1023] == (unsigned char)i) {
+        ++((int*)data)[i];
+      }
+      EpFree(bytes);
+    }
+  }
+
+  bool IsEachVisitedOnce() const {
+    for (int i = 0; i < (int)ITEM_COUNT; ++i) {
+      if (s_visits[i] != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static EpJobSystem s_jobSystem;
+  static int s_visits[ITEM_COUNT];
+};
+
+EpJobSystem EpJobSystemTest::s_jobSystem;
+int EpJobSystemTest::s_visits[EpJobSystemTest::ITEM_COUNT];
+
+TEST_F(EpJobSystemTest, Run) {
+  ASSERT_EQ(s_jobSystem.GetWorkerCount(), (unsigned)WORKER_COUNT);
+
+  EpJob jobs[10];
+  for (unsigned i = 0u; i < 10u; ++i) {
+    jobs[i].Set(&ProfiledVisit, s_visits, i * 1000u, i * 1000u + 1000u);
+  }
+  EpJobCounter counter;
+  ASSERT_TRUE(counter.IsDone());
+  s_jobSystem.Run(jobs, 10u, counter);
+  s_jobSystem.Wait(counter);
+  ASSERT_TRUE(counter.IsDone());
+  ASSERT_TRUE(IsEachVisitedOnce());
+
+  s_jobSystem.LogWorkerProfiles();
+}
+
+// Jobs that wait on jobs they submit.
+TEST_F(EpJobSystemTest, Nested) {
+  EpJob job;
+  job.Set(&Split, s_visits, 0u, ITEM_COUNT);
+  EpJobCounter counter;
+  s_jobSystem.Run(&job, 1u, counter);
+  s_jobSystem.Wait(counter);
+  ASSERT_TRUE(IsEachVisitedOnce());
+}
+
+TEST_F(EpJobSystemTest, ParallelFor) {
+  const unsigned grainSizes[] = { 0u, 1u, 7u, 1000u, ITEM_COUNT * 2u };
+  for (unsigned i = 0u; i < sizeof grainSizes / sizeof *grainSizes; ++i) {
+    s_jobSystem.ParallelFor(0u, ITEM_COUNT, grainSizes[i], &Visit, s_visits);
+  }
+  s_jobSystem.ParallelFor(5u, 5u, 1u, &Visit, s_visits); // Empty
+
+  int visitCounts[ITEM_COUNT];
+  std::atomic<unsigned> rangeCount(0u);
+  s_jobSystem.ParallelFor(0u, ITEM_COUNT, 64u, [&](unsigned begin, unsigned end) {
+    ++rangeCount;
+    for (unsigned j = begin; j < end; ++j) {
+      visitCounts[j] = s_visits[j];
+    }
+  });
+
+  bool isEachVisited = true;
+  for (unsigned i = 0u; i < ITEM_COUNT; ++i) {
+    isEachVisited = isEachVisited && visitCounts[i] == 5;
+  }
+  ASSERT_TRUE(isEachVisited);
+  ASSERT_EQ(rangeCount.load(), (ITEM_COUNT + 63u) / 64u);
+}
+
+// 10 MB of 1 KB allocations from the workers' 64 KB temporary stacks, which are
+// reset after each range.
+TEST_F(EpJobSystemTest, TemporaryStack) {
+  s_jobSystem.ParallelFor(0u, ITEM_COUNT, 16u, &Allocate, s_visits);
+  ASSERT_TRUE(IsEachVisitedOnce());
+}
+
+// Without workers everything runs on the calling thread.
+TEST_F(EpJobSystemTest, NotStarted) {
+  s_jobSystem.Stop();
+  ASSERT_FALSE(s_jobSystem.IsStarted());
+
+  EpJob job;
+  job.Set(&Split, s_visits, 0u, ITEM_COUNT);
+  EpJobCounter counter;
+  s_jobSystem.Run(&job, 1u, counter);
+  ASSERT_TRUE(counter.IsDone());
+  s_jobSystem.Wait(counter);
+  s_jobSystem.ParallelFor(0u, ITEM_COUNT, 10u, &Visit, s_visits);
+  ASSERT_EQ(s_visits[0], 2);
+  ASSERT_EQ(s_visits[ITEM_COUNT - 1], 2);
+}
+
+// Reports the cost of a ParallelFor call with a little work per range.
+BENCHMARK_F(EpJobSystemTest, ParallelForBenchmark) {
+  while (state.KeepRunning()) {
+    s_jobSystem.ParallelFor(0u, 1024u, 256u, &Visit, s_visits);
+  }
+  ASSERT_GE(s_visits[0], 1);
+}
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
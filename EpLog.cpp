@@ -0,0 +1,373 @@
+#include "EmbeddedPlatform.h"
+#include "EpSettings.h"
+
+// ----------------------------------------------------------------------------
+// Deferred logging
+//
+// When g_epSettings.platform_isLogDeferred is set EpLog() stores the format
+// pointer and its arguments in a ring owned by the calling thread instead of
+// formatting.  EpLogFlush(), called at frame end or from the thread started by
+// EpLogStartFlushThread(), formats the records and writes them with writev().
+// Formats must be string literals.  %s arguments are copied, truncated to
+// fit the record.  Order is preserved per thread only.  Warnings and asserts
+// flush and then log synchronously.  Each logging thread holds one of
+// EP_LOG_MAX_THREADS rings until it exits.  Threads beyond that log
+// synchronously.
+
+#if defined(EP_BUILD_SOFTWARE) && (defined(__unix__) || defined(__APPLE__))
+#define EP_LOG_DEFERRED 1
+#else
+#define EP_LOG_DEFERRED 0
+#endif
+
+#if (EP_LOG_DEFERRED==1)
+
+#include "EpQueue.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#define EP_LOG_MAX_THREADS 16
+#define EP_LOG_RING_RECORDS 128u
+#define EP_LOG_RECORD_ARGS 8
+#define EP_LOG_RECORD_STRINGS 96
+#define EP_LOG_FLUSH_BUFFER (16 * 1024)
+#define EP_LOG_FLUSH_IOVECS 64
+#define EP_LOG_LINE_MAX 512 // As EpLogHandlerV().
+
+enum EpLogArg {
+  EpLogArg_Int,
+  EpLogArg_Double,
+  EpLogArg_String, // Offset into strings.
+  EpLogArg_Pointer
+};
+
+struct EpLogRecord {
+  const char* format;
+  uint32_t argCount;
+  uint32_t stringBytes;
+  uint64_t args[EP_LOG_RECORD_ARGS]; // Integers sign extended, doubles by bits.
+  char strings[EP_LOG_RECORD_STRINGS];
+};
+
+typedef EpSpscQueue<EpLogRecord, EP_LOG_RING_RECORDS> EpLogRing;
+
+static EpLogRing s_epLogRings[EP_LOG_MAX_THREADS];
+static std::atomic<bool> s_epLogRingClaimed[EP_LOG_MAX_THREADS];
+static std::atomic<bool> s_epLogRingWarned(false);
+
+// Releases the thread's ring when the thread exits.  Records still in the ring
+// are written by the next EpLogFlush().
+struct EpLogRingOwner {
+  EpLogRingOwner() : ring(0), isUnavailable(false) { }
+  ~EpLogRingOwner() {
+    if (ring) {
+      s_epLogRingClaimed[ring - s_epLogRings].store(false, std::memory_order_release);
+      ring = 0;
+    }
+    isUnavailable = true; // Logging from later thread_local destructors.
+  }
+
+  EpLogRing* ring;
+  bool isUnavailable;
+};
+
+static thread_local EpLogRingOwner t_epLogRingOwner;
+
+static std::mutex s_epLogFlushMutex;
+static std::thread* s_epLogFlushThread = 0;
+static std::atomic<bool> s_epLogFlushThreadStop(false);
+static unsigned char s_epLogFlushThreadStorage[sizeof(std::thread)];
+
+// Holds the flush mutex across fork() so that a child is never forked while
+// another thread is flushing, which would leave the mutex locked in the child.
+struct EpLogForkHandlers {
+  EpLogForkHandlers() { ::pthread_atfork(Prepare, Parent, Child); }
+
+  static void Prepare() { s_epLogFlushMutex.lock(); }
+  static void Parent() { s_epLogFlushMutex.unlock(); }
+  static void Child() {
+    s_epLogFlushMutex.unlock();
+    s_epLogFlushThread = 0; // Threads are not forked.
+  }
+};
+
+static EpLogForkHandlers s_epLogForkHandlers;
+
+// Steps past a printf conversion specification.  Sets the conversion and
+// length modifier, where 'L' is long double and 'q' is long long.
+static const char* EpLogParseSpec(const char* it, char* conversion, char* length, int* starCount) {
+  *starCount = 0;
+  while (*it && ::strchr("-+ #0'", *it)) { ++it; }
+  if (*it == '*') { ++*starCount; ++it; }
+  while (*it >= '0' && *it <= '9') { ++it; }
+  if (*it == '.') {
+    ++it;
+    if (*it == '*') { ++*starCount; ++it; }
+    while (*it >= '0' && *it <= '9') { ++it; }
+  }
+  *length = 0;
+  if (it[0] == 'l' && it[1] == 'l') { *length = 'q'; it += 2; }
+  else if (it[0] == 'h' && it[1] == 'h') { *length = 'H'; it += 2; }
+  else if (*it && ::strchr("hlLzjt", *it)) { *length = *it++; }
+  *conversion = *it;
+  return *it ? it + 1 : it;
+}
+
+// Copies the arguments described by format.  Returns false if they do not fit.
+static bool EpLogCapture(EpLogRecord& record, const char* format, va_list args) {
+  record.format = format;
+  record.argCount = 0u;
+  record.stringBytes = 0u;
+  for (const char* it = format; *it;) {
+    if (*it++ != '%') {
+      continue;
+    }
+    if (*it == '%') {
+      ++it;
+      continue;
+    }
+    char conversion, length;
+    int starCount;
+    it = EpLogParseSpec(it, &conversion, &length, &starCount);
+    if (record.argCount + (unsigned)starCount + 1u > (unsigned)EP_LOG_RECORD_ARGS) {
+      return false;
+    }
+    for (int i = 0; i < starCount; ++i) {
+      record.args[record.argCount++] = (uint64_t)(int64_t)va_arg(args, int);
+    }
+
+    uint64_t& arg = record.args[record.argCount++];
+    switch (conversion) {
+    case 'd': case 'i':
+      arg = (length == 'q') ? (uint64_t)va_arg(args, long long)
+        : (length == 'l') ? (uint64_t)(int64_t)va_arg(args, long)
+        : (length == 'z' || length == 't') ? (uint64_t)(int64_t)va_arg(args, ptrdiff_t)
+        : (length == 'j') ? (uint64_t)va_arg(args, intmax_t)
+        : (uint64_t)(int64_t)va_arg(args, int);
+      break;
+    case 'u': case 'x': case 'X': case 'o': case 'c':
+      arg = (length == 'q') ? (uint64_t)va_arg(args, unsigned long long)
+        : (length == 'l') ? (uint64_t)va_arg(args, unsigned long)
+        : (length == 'z' || length == 't') ? (uint64_t)va_arg(args, size_t)
+        : (length == 'j') ? (uint64_t)va_arg(args, uintmax_t)
+        : (uint64_t)va_arg(args, unsigned);
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+      double d = (length == 'L') ? (double)va_arg(args, long double) : va_arg(args, double);
+      ::memcpy(&arg, &d, sizeof d);
+      break;
+    }
+    case 's': {
+      const char* s = va_arg(args, const char*);
+      s = s ? s : "(null)";
+      size_t available = EP_LOG_RECORD_STRINGS - record.stringBytes;
+      size_t bytes = EpMin(::strlen(s), available - 1u);
+      if (available == 0u) {
+        return false;
+      }
+      ::memcpy(record.strings + record.stringBytes, s, bytes);
+      record.strings[record.stringBytes + bytes] = '\0';
+      arg = record.stringBytes;
+      record.stringBytes += (uint32_t)bytes + 1u;
+      break;
+    }
+    case 'p':
+      arg = (uint64_t)(uintptr_t)va_arg(args, void*);
+      break;
+    default:
+      return false; // %n or unknown.
+    }
+  }
+  return true;
+}
+
+// Formats one conversion specification of at most 32 characters.
+static int EpLogFormatSpec(char* buf, size_t size, const char* spec, size_t specLength, char conversion, char length,
+                           const EpLogRecord& record, uint32_t& argIndex) {
+  char format[40];
+  size_t at = 0u;
+  for (size_t i = 0u; i < specLength && at + 12u < sizeof format; ++i) {
+    if (spec[i] == '*') {
+      // Substitute the captured width or precision.
+      at += (size_t)::snprintf(format + at, sizeof format - at, "%d", (int)(int64_t)record.args[argIndex++]);
+    } else {
+      format[at++] = spec[i];
+    }
+  }
+  format[at] = '\0';
+
+  uint64_t arg = record.args[argIndex++];
+  switch (conversion) {
+  case 'd': case 'i':
+    return (length == 'q' || length == 'j') ? ::snprintf(buf, size, format, (long long)arg)
+      : (length == 'l' || length == 'z' || length == 't') ? ::snprintf(buf, size, format, (long)arg)
+      : ::snprintf(buf, size, format, (int)arg);
+  case 'u': case 'x': case 'X': case 'o': case 'c':
+    return (length == 'q' || length == 'j') ? ::snprintf(buf, size, format, (unsigned long long)arg)
+      : (length == 'l' || length == 'z' || length == 't') ? ::snprintf(buf, size, format, (unsigned long)arg)
+      : ::snprintf(buf, size, format, (unsigned)arg);
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+    double d;
+    ::memcpy(&d, &arg, sizeof d);
+    if (length == 'L') {
+      return ::snprintf(buf, size, format, (long double)d);
+    }
+    return ::snprintf(buf, size, format, d);
+  }
+  case 's':
+    return ::snprintf(buf, size, format, record.strings + arg);
+  default: // 'p'
+    return ::snprintf(buf, size, format, (void*)(uintptr_t)arg);
+  }
+}
+
+// Returns the number of characters written to buf, truncating at size - 1.
+static size_t EpLogFormat(char* buf, size_t size, const EpLogRecord& record) {
+  size_t at = 0u;
+  uint32_t argIndex = 0u;
+  for (const char* it = record.format; *it && at + 1u < size;) {
+    if (*it != '%') {
+      buf[at++] = *it++;
+      continue;
+    }
+    if (it[1] == '%') {
+      buf[at++] = '%';
+      it += 2;
+      continue;
+    }
+    char conversion, length;
+    int starCount;
+    const char* end = EpLogParseSpec(it + 1, &conversion, &length, &starCount);
+    int written = EpLogFormatSpec(buf + at, size - at, it, (size_t)(end - it), conversion, length, record, argIndex);
+    if (written > 0) {
+      at += EpMin((size_t)written, size - at - 1u);
+    }
+    it = end;
+  }
+  buf[at] = '\0';
+  return at;
+}
+
+static EpLogRing* EpLogThreadRing() {
+  EpLogRingOwner& owner = t_epLogRingOwner;
+  if (owner.ring == 0 && !owner.isUnavailable) {
+    for (unsigned i = 0u; i < EP_LOG_MAX_THREADS && owner.ring == 0; ++i) {
+      bool isClaimed = false;
+      if (s_epLogRingClaimed[i].compare_exchange_strong(isClaimed, true, std::memory_order_acquire)) {
+        owner.ring = &s_epLogRings[i];
+      }
+    }
+    if (owner.ring == 0) {
+      owner.isUnavailable = true; // Log synchronously.
+      if (!s_epLogRingWarned.exchange(true)) {
+        EpLogHandler(EpLogLevel_Warning, "EpLog: More than %d threads logging, the rest log synchronously", EP_LOG_MAX_THREADS);
+      }
+    }
+  }
+  return owner.ring;
+}
+
+// Returns false if the message must be logged synchronously.
+bool EpLogDeferV(EpLogLevel level, const char* format, va_list args) {
+  if (level != EpLogLevel_Log) {
+    EpLogFlush();
+    return false;
+  }
+  EpLogRing* ring = EpLogThreadRing();
+  if (ring == 0) {
+    return false;
+  }
+
+  EpLogRecord record;
+  va_list copy;
+  va_copy(copy, args);
+  bool isCaptured = EpLogCapture(record, format, copy);
+  va_end(copy);
+  if (!isCaptured) {
+    EpLogFlush(); // Keep this thread's messages in order.
+    return false;
+  }
+
+  if (!ring->try_push(record)) {
+    EpLogFlush();
+    if (!ring->try_push(record)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void EpLogFlush(int fd) {
+  std::lock_guard<std::mutex> lock(s_epLogFlushMutex);
+  static char buffer[EP_LOG_FLUSH_BUFFER];
+  struct iovec iov[EP_LOG_FLUSH_IOVECS];
+  int iovCount = 0;
+  size_t used = 0u;
+
+  ::fflush(stderr);
+  for (unsigned i = 0u; i < EP_LOG_MAX_THREADS; ++i) {
+    EpLogRecord record;
+    while (s_epLogRings[i].try_pop(record)) {
+      if (iovCount == EP_LOG_FLUSH_IOVECS || EP_LOG_FLUSH_BUFFER - used < EP_LOG_LINE_MAX) {
+        ssize_t result = ::writev(fd, iov, iovCount); (void)result;
+        iovCount = 0;
+        used = 0u;
+      }
+      size_t length = EpLogFormat(buffer + used, EP_LOG_LINE_MAX, record);
+      iov[iovCount].iov_base = buffer + used;
+      iov[iovCount].iov_len = length;
+      ++iovCount;
+      used += length;
+    }
+  }
+  if (iovCount) {
+    ssize_t result = ::writev(fd, iov, iovCount); (void)result;
+  }
+}
+
+static void EpLogFlushThread(unsigned periodMicroseconds) {
+  while (!s_epLogFlushThreadStop.load()) {
+    EpLogFlush();
+    std::this_thread::sleep_for(std::chrono::microseconds(periodMicroseconds));
+  }
+  EpLogFlush();
+}
+
+void EpLogStartFlushThread(unsigned periodMicroseconds) {
+  if (s_epLogFlushThread) {
+    return;
+  }
+  s_epLogFlushThreadStop.store(false);
+  s_epLogFlushThread = ::new (s_epLogFlushThreadStorage) std::thread(EpLogFlushThread, periodMicroseconds);
+}
+
+void EpLogStopFlushThread() {
+  if (!s_epLogFlushThread) {
+    return;
+  }
+  s_epLogFlushThreadStop.store(true);
+  s_epLogFlushThread->join();
+  s_epLogFlushThread->~thread();
+  s_epLogFlushThread = 0;
+}
+
+#else // !EP_LOG_DEFERRED
+
+bool EpLogDeferV(EpLogLevel level, const char* format, va_list args) { return false; }
+
+void EpLogFlush(int fd) { }
+
+void EpLogStartFlushThread(unsigned periodMicroseconds) { }
+
+void EpLogStopFlushThread() { }
+
+#endif // !EP_LOG_DEFERRED
@@ -0,0 +1,139 @@
+#include "EmbeddedPlatform.h"
+#include "EpSettings.h"
+#include "EpProfiler.h"
+#include "EpTest.h"
+
+#if defined(EP_BUILD_SOFTWARE) && (defined(__unix__) || defined(__APPLE__))
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+
+class EpLogTest :
+  public testing::Test
+{
+public:
+  enum { BENCHMARK_COUNT = 1 << 12 };
+
+  EpLogTest() {
+    m_file = ::tmpfile();
+    m_isLogDeferred = g_epSettings.platform_isLogDeferred;
+    g_epSettings.platform_isLogDeferred = true;
+  }
+
+  ~EpLogTest() {
+    g_epSettings.platform_isLogDeferred = m_isLogDeferred;
+    ::fclose(m_file);
+  }
+
+  // Returns what EpLogFlush() wrote.
+  const char* Flush() {
+    EpLogFlush(::fileno(m_file));
+    long length = ::lseek(::fileno(m_file), 0, SEEK_CUR);
+    ::lseek(::fileno(m_file), 0, SEEK_SET);
+    ssize_t bytes = ::read(::fileno(m_file), m_buffer, EpMin((size_t)length, sizeof m_buffer - 1u));
+    m_buffer[bytes > 0 ? bytes : 0] = '\0';
+    ::lseek(::fileno(m_file), 0, SEEK_SET);
+    return m_buffer;
+  }
+
+  FILE* m_file;
+  bool m_isLogDeferred;
+  char m_buffer[1024];
+};
+
+TEST_F(EpLogTest, Deferred) {
+  char expected[512];
+  char str[16];
+  ::strcpy(str, "abc");
+  int x = -7;
+
+  int length = ::snprintf(expected, sizeof expected, "%d %u %5.2f %s %x %lld %c\n",
+    x, 3u, 1.5, str, 255u, -(1ll << 40), 'q');
+  ::snprintf(expected + length, sizeof expected - length, "%*d %.*s %% %p\n", 4, 12, 2, "xyz", (void*)&x);
+  EpLog("%d %u %5.2f %s %x %lld %c\n", x, 3u, 1.5, str, 255u, -(1ll << 40), 'q');
+  EpLog("%*d %.*s %% %p\n", 4, 12, 2, "xyz", (void*)&x);
+
+  // The string was copied when logged.
+  ::strcpy(str, "changed");
+  EpLog("second %s\n", "line");
+
+  const char* output = Flush();
+  ASSERT_EQ(::strncmp(output, expected, ::strlen(expected)), 0);
+  ASSERT_EQ(::strcmp(output + ::strlen(expected), "second line\n"), 0);
+
+  // Nothing is written twice.
+  output = Flush();
+  ASSERT_EQ(output[0], '\0');
+}
+
+// Disabled EpLogAt() sites do not evaluate their arguments.
+TEST_F(EpLogTest, Categories) {
+  int evaluations = 0;
+  EpLogAt(App, Info, "EpLogTest %d\n", ++evaluations);
+  EpLogAt(App, Trace, "EpLogTest %d\n", ++evaluations); // Compiled out.
+
+  unsigned categories = g_epLogCategories;
+  g_epLogCategories &= ~(1u << EpLogCategory_App);
+  EpLogAt(App, Info, "EpLogTest %d\n", ++evaluations);
+  g_epLogCategories = categories;
+
+  ASSERT_EQ(evaluations, 1);
+  const char* output = Flush();
+  ASSERT_EQ(::strcmp(output, "EpLogTest 1\n"), 0);
+}
+
+// Messages with too many arguments are written synchronously to stderr after
+// flushing the earlier deferred messages there.
+TEST_F(EpLogTest, Fallback) {
+  EpLog("EpLogTest deferred\n");
+  EpLog("EpLogTest %d%d%d%d%d%d%d%d%d\n", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+
+  const char* output = Flush();
+  ASSERT_EQ(output[0], '\0');
+}
+
+static void EpLogTestThread(int index) {
+  EpLog("EpLogTest thread %d\n", index);
+}
+
+// Exiting threads release their rings, so more threads than there are rings
+// may log in turn.
+TEST_F(EpLogTest, ThreadExit) {
+  enum { THREAD_COUNT = 40 };
+  for (int i = 0; i < (int)THREAD_COUNT; ++i) {
+    std::thread thread(EpLogTestThread, i);
+    thread.join();
+  }
+
+  const char* output = Flush();
+  int lines = 0;
+  for (const char* it = output; (it = ::strstr(it, "EpLogTest thread ")) != NULL; ++it) {
+    ++lines;
+  }
+  ASSERT_EQ(lines, (int)THREAD_COUNT);
+  ASSERT_TRUE((::strstr(output, "EpLogTest thread 39\n") != NULL));
+}
+
+// Logs cycles per deferred call.  Records are flushed between batches and the
+// flush is not timed.
+TEST_F(EpLogTest, DeferredBenchmark) {
+  unsigned cycles = 0u;
+  const char* output = "";
+  for (int batch = 0; batch < (int)BENCHMARK_COUNT; batch += 64) {
+    unsigned t0 = EpProfilerSample();
+    for (int i = batch; i < batch + 64; ++i) {
+      EpLog("EpLogTest %d %f\n", i, 0.5);
+    }
+    cycles += EpProfilerSample() - t0;
+    output = Flush();
+  }
+  g_epSettings.platform_isLogDeferred = false;
+
+  EpLog("EpLog deferred: %.1f cycles per call\n", (double)cycles / (double)BENCHMARK_COUNT);
+  ASSERT_EQ(::strncmp(output, "EpLogTest 4032 0.500000\n", 24), 0);
+}
+
+#endif
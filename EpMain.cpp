@@ -14,6 +14,8 @@ void EpMain() {
   // EP_BUILD_SOFTWARE uses GoogleTest instead.
   if (g_epSettings.platform_runTestsInMain) {
     //  EpTestRunner::Singleton().SetFilterStaticString("EpArrayTest");
+    //  EpTestRunner::Singleton().SetWorkerCount(0); // One per core.
+    //  EpTestRunner::Singleton().SetBenchmarkFilesStaticString("benchmark_baseline.txt", "benchmark.txt");
 
     // All tests already registered by global constructors.
     EpTestRunner::Singleton().ExecuteAllTests();
@@ -21,9 +23,17 @@ void EpMain() {
 }
 
 extern "C" {
+#if defined(EP_BUILD_SOFTWARE)
+int main(int argc, char** argv) {
+  EpTestRunner::Singleton().ParseCommandLine(argc, argv);
+  EpMain();
+  return 0;
+}
+#else
 void main() {
   EpMain();
 }
+#endif
 
 } // extern "C"
 #endif // !EP_USING_GOOGLE_TEST
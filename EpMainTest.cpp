@@ -3,6 +3,10 @@
 #include "EpAllocatorScope.h"
 #include "EpSettings.h"
 
+#if defined(EP_BUILD_SOFTWARE) && defined(__linux__)
+#include <unistd.h>
+#endif
+
 
 class EpMainTest :
   public testing::Test
@@ -142,3 +146,41 @@ TEST_F(EpMainTest, Execute) {
     EpMemoryManagementShutDown();
   }
 }
+
+#if defined(EP_BUILD_SOFTWARE) && defined(__linux__)
+// Runs a filtered set of tests in worker processes of a second copy of this
+// executable.
+TEST_F(EpMainTest, Workers) {
+  char path[512];
+  ssize_t pathLength = ::readlink("/proc/self/exe", path, sizeof path - 1u);
+  ASSERT_TRUE(pathLength > 0);
+  path[pathLength] = '\0';
+  char command[1024];
+  ::snprintf(command, sizeof command, "EP_TEST_FILTER='EpArrayTest.SmallBuffer:EpPoolTest.PoolPtr:EpSoaArrayTest.Columns' "
+    "EP_TEST_WORKERS=2 EP_TEST_SHARD_COUNT=1 '%s' 2>&1 </dev/null", path);
+  FILE* child = ::popen(command, "r");
+  ASSERT_TRUE((child != NULL));
+  static char output[32 * 1024];
+  size_t length = ::fread(output, 1, sizeof output - 1u, child);
+  output[length] = '\0';
+  int status = ::pclose(child);
+
+  ASSERT_EQ(status, 0);
+  ASSERT_TRUE((::strstr(output, "EpArrayTest.SmallBuffer...\n") != NULL));
+  ASSERT_TRUE((::strstr(output, "EpPoolTest.PoolPtr...\n") != NULL));
+  ASSERT_TRUE((::strstr(output, "EpSoaArrayTest.Columns...\n") != NULL));
+  ASSERT_TRUE((::strstr(output, "Skipping EpMainTest.Workers..\n") != NULL));
+  ASSERT_TRUE((::strstr(output, "EpTestRunner: All 3 tests PASSED SUCCESSFULLY.\n") != NULL));
+}
+#endif
+
+// Logs the cost of a temporary stack scope with one allocation.  The scope
+// releases the allocation.
+BENCHMARK_F(EpMainTest, TempStackBenchmark) {
+  while (state.KeepRunning()) {
+    EpAllocatorScope tempScope(EpMemoryAllocatorId_TemporaryStack);
+    void* ptr = EpMalloc(64);
+    EpBenchmarkDoNotOptimize(ptr);
+    EpFree(ptr);
+  }
+}
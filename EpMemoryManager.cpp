@@ -1,4 +1,5 @@
 #include "EmbeddedPlatform.h"
+#include "EpAllocator.h"
 #include "EpAllocatorScope.h"
 #include "EpSettings.h"
 
@@ -6,6 +7,15 @@
 #include <string.h>
 #include <new>
 
+#if (EP_ALLOCATOR_VIRTUAL==1)
+#include <sys/mman.h>
+#endif
+
+#if defined(EP_BUILD_SOFTWARE) && defined(__GLIBC__)
+#define EP_ALLOCATION_BACKTRACE 1
+#include <execinfo.h>
+#endif
+
 #define EP_KB 1024
 #define EP_MB (1024*1024)
 
@@ -451,6 +461,26 @@ protected:
   Section m_sections[c_nSections];
 };
 
+// ----------------------------------------------------------------------------
+// EpMemoryThreadState
+//
+// Each thread has its own current allocator.  Threads set up with
+// EpMemoryManagementThreadInit() also have their own temporary stack.  The
+// other allocators are only used by the main thread.
+
+extern EpMemoryAllocatorTempStack g_epMemoryAllocatorTemporaryStack;
+
+struct EpMemoryThreadState {
+  EpMemoryAllocatorId currentId;
+  EpMemoryAllocatorTempStack* temporaryStack;
+  uintptr_t allocationsMade; // Never decremented.
+  EpAllocationTracker* tracker; // Innermost.  Checked once per allocation.
+};
+
+static EP_THREAD_LOCAL EpMemoryThreadState t_epMemoryThread = {
+  EpMemoryAllocatorId_Heap, &g_epMemoryAllocatorTemporaryStack, 0u, 0
+};
+
 // ----------------------------------------------------------------------------
 // EpMemoryManager
 
@@ -463,24 +493,31 @@ public:
   EpMemoryAllocatorId BeginAllocationScope(EpAllocatorScope* scope, EpMemoryAllocatorId newId);
   void EndAllocationScope(EpAllocatorScope* scope, EpMemoryAllocatorId previousId);
 
-  EpMemoryAllocatorId CurrentAllocatorId() { return m_currentMemoryAllocator; }
+  EpMemoryAllocatorId CurrentAllocatorId() { return t_epMemoryThread.currentId; }
+  uintptr_t AllocationsMade() const { return t_epMemoryThread.allocationsMade; }
 
+  // The temporary stack is the calling thread's.
   EpMemoryAllocatorBase& GetAllocator(EpMemoryAllocatorId id) {
     EpAssert(m_isInitialized && id >= 0 && id < EpMemoryAllocatorId_MAX);
-    return *m_memoryAllocators[id];
+    return id == EpMemoryAllocatorId_TemporaryStack ? *t_epMemoryThread.temporaryStack : *m_memoryAllocators[id];
   }
 
+  bool IsMainThread() const { return t_epMemoryThread.temporaryStack == &g_epMemoryAllocatorTemporaryStack; }
+
   void* Allocate(size_t size);
   void* AllocateExtended(size_t size, uintptr_t alignmentMask, EpMemoryAllocatorId id);
   void Free(void* ptr);
+  void FreeExtended(void* ptr, EpMemoryAllocatorId id);
 
 private:
   friend class EpAllocatorScope;
   EpMemoryAllocatorBase* m_memoryAllocators[EpMemoryAllocatorId_MAX];
-  EpMemoryAllocatorId m_currentMemoryAllocator;
   bool m_isInitialized; // Statically initialized to zero.
 };
 
+#define EP_ALLOCATION_TRACK(id, size) \
+  do { if (t_epMemoryThread.tracker) { EpAllocationTracker::OnAllocate((id), (size)); } } while (0)
+
 // For g_epMemoryAllocatorScratch:
 EP_LINK_SCRATCHPAD EpScratchpad<EP_MEMORY_BUDGET_SCRATCH> g_epScratchpadObject;
 
@@ -492,8 +529,8 @@ EP_LINK_SCRATCHPAD EpScratchpad<EP_MEMORY_BUDGET_SCRATCH> g_epScratchpadObject;
 EpMemoryAllocatorLocked    g_epMemoryAllocatorLocked;
  EpMemoryAllocatorScratchpad g_epMemoryAllocatorScratch;
 
-// Must be explicitly constructed by first global constructor that allocates.  m_currentMemoryAllocator
-// will be set to 0/EpMemoryAllocatorId_Heap by virtue of being in the static section.
+// Must be explicitly constructed by first global constructor that allocates.  t_epMemoryThread.currentId
+// is initialized to EpMemoryAllocatorId_Heap.
  EpMemoryManager s_epMemoryManager;
 
 void EpMemoryManager::Construct() {
@@ -509,7 +546,7 @@ void EpMemoryManager::Construct() {
 
   EpLog("EpMemoryManager.Construct...\n");
 
-  EpAssert(m_currentMemoryAllocator == EpMemoryAllocatorId_Heap); // Static variables set to 0.
+  EpAssert(t_epMemoryThread.currentId == EpMemoryAllocatorId_Heap);
 
   m_memoryAllocators[EpMemoryAllocatorId_Heap] =           &g_epMemoryAllocatorHeap;
   m_memoryAllocators[EpMemoryAllocatorId_Permanent] =      &g_epMemoryAllocatorPermanent;
@@ -576,34 +613,38 @@ EpMemoryAllocatorId EpMemoryManager::BeginAllocationScope(EpAllocatorScope* scop
     Construct();
   }
 
-  EpAssertMsg(m_currentMemoryAllocator != EpMemoryAllocatorId_Locked, "Begin scope while locked");
+  EpAssertMsg(t_epMemoryThread.currentId != EpMemoryAllocatorId_Locked, "Begin scope while locked");
 
-  EpMemoryAllocatorId previousId = m_currentMemoryAllocator;
-  m_currentMemoryAllocator = newId;
-  m_memoryAllocators[m_currentMemoryAllocator]->BeginAllocationScope(scope, newId);
+  EpMemoryAllocatorId previousId = t_epMemoryThread.currentId;
+  t_epMemoryThread.currentId = newId;
+  GetAllocator(newId).BeginAllocationScope(scope, newId);
   return previousId;
 }
 
 void EpMemoryManager::EndAllocationScope(EpAllocatorScope* scope, EpMemoryAllocatorId previousId) {
   EpAssert(m_isInitialized && previousId >= 0 && previousId < EpMemoryAllocatorId_MAX);
 
-  m_memoryAllocators[m_currentMemoryAllocator]->EndAllocationScope(scope, previousId);
-  m_currentMemoryAllocator = previousId;
+  GetAllocator(t_epMemoryThread.currentId).EndAllocationScope(scope, previousId);
+  t_epMemoryThread.currentId = previousId;
 }
 
 void* EpMemoryManager::Allocate(size_t size) {
   EpInit();
+  ++t_epMemoryThread.allocationsMade;
 #if (EP_MEM_DIAGNOSTIC_LEVEL>=1)
   if (g_epSettings.platform_disableMemoryManager) {
+    EP_ALLOCATION_TRACK(EpMemoryAllocatorId_Heap, size);
     return EpMallocChecked(size);
   }
 #endif
 
-  // Having a default value for m_currentMemoryAllocator enables a fast path.
-  EpAssert(m_isInitialized || m_currentMemoryAllocator == EpMemoryAllocatorId_Heap);
-  if (m_currentMemoryAllocator == EpMemoryAllocatorId_TemporaryStack) {
-    void* ptr = g_epMemoryAllocatorTemporaryStack.AllocateNonVirtual(size, EP_ALIGNMENT_MASK);
+  // Having a default value for the current allocator enables a fast path.
+  EpMemoryAllocatorId id = t_epMemoryThread.currentId;
+  EpAssert(m_isInitialized || id == EpMemoryAllocatorId_Heap);
+  if (id == EpMemoryAllocatorId_TemporaryStack) {
+    void* ptr = t_epMemoryThread.temporaryStack->AllocateNonVirtual(size, EP_ALIGNMENT_MASK);
     if (ptr) {
+      EP_ALLOCATION_TRACK(EpMemoryAllocatorId_TemporaryStack, size);
       return ptr; // This is the fast path.
     }
   }
@@ -612,22 +653,30 @@ void* EpMemoryManager::Allocate(size_t size) {
     Construct();
   }
 
-  EpAssert(m_currentMemoryAllocator >= 0 && m_currentMemoryAllocator < EpMemoryAllocatorId_MAX);
-  void* ptr = m_memoryAllocators[m_currentMemoryAllocator]->Allocate(size, EP_ALIGNMENT_MASK);
-  EpReleaseAssertMsg(((uintptr_t)ptr & EP_ALIGNMENT_MASK) == 0, "Alignment wrong %x, al %d", (unsigned)(uintptr_t)ptr, m_currentMemoryAllocator);
-  if (ptr) { return ptr; }
-  EpReleaseWarning(false, "%s is overflowing to heap, size %d", m_memoryAllocators[m_currentMemoryAllocator]->Label(), (int)size);
+  EpAssert(id >= 0 && id < EpMemoryAllocatorId_MAX);
+  EpAssertMsg(IsMainThread() || id == EpMemoryAllocatorId_TemporaryStack, "Allocator %d used off the main thread", id);
+  void* ptr = GetAllocator(id).Allocate(size, EP_ALIGNMENT_MASK);
+  EpReleaseAssertMsg(((uintptr_t)ptr & EP_ALIGNMENT_MASK) == 0, "Alignment wrong %x, al %d", (unsigned)(uintptr_t)ptr, id);
+  if (ptr) {
+    EP_ALLOCATION_TRACK(id, size);
+    return ptr;
+  }
+  EpReleaseAssertMsg(IsMainThread(), "%s overflowed off the main thread, size %d", GetAllocator(id).Label(), (int)size);
+  EpReleaseWarning(false, "%s is overflowing to heap, size %d", GetAllocator(id).Label(), (int)size);
   ptr = g_epMemoryAllocatorHeap.Allocate(size, EP_ALIGNMENT_MASK); // May be null.
   EpReleaseAssertMsg(ptr, "Out of memory.");
+  EP_ALLOCATION_TRACK(EpMemoryAllocatorId_Heap, size);
   EpReleaseAssertMsg(((uintptr_t)ptr & EP_ALIGNMENT_MASK) == 0, "Alignment wrong %x, al-heap", (unsigned)(uintptr_t)ptr);
   return ptr;
 }
 
 void* EpMemoryManager::AllocateExtended(size_t size, uintptr_t alignmentMask, EpMemoryAllocatorId id) {
   EpInit();
+  ++t_epMemoryThread.allocationsMade;
 #if (EP_MEM_DIAGNOSTIC_LEVEL>=1)
   if (g_epSettings.platform_disableMemoryManager) {
     EpAssert(alignmentMask == alignmentMask); // No support for alignment when disabled.
+    EP_ALLOCATION_TRACK(EpMemoryAllocatorId_Heap, size);
     return EpMallocChecked(size);
   }
 #endif
@@ -636,18 +685,25 @@ void* EpMemoryManager::AllocateExtended(size_t size, uintptr_t alignmentMask, Ep
     Construct();
   }
   if(id == EpMemoryAllocatorId_UNSPECIFIED) {
-    id = m_currentMemoryAllocator;
+    id = t_epMemoryThread.currentId;
   }
 
   EpAssert(((alignmentMask+1) & (alignmentMask)) == 0u);
   EpAssert(id >= 0 && id < EpMemoryAllocatorId_MAX);
 
-  void* ptr = m_memoryAllocators[id]->Allocate(size, alignmentMask);
+  EpAssertMsg(IsMainThread() || id == EpMemoryAllocatorId_TemporaryStack, "Allocator %d used off the main thread", id);
+
+  void* ptr = GetAllocator(id).Allocate(size, alignmentMask);
   EpReleaseAssertMsg(((uintptr_t)ptr & alignmentMask) == 0, "Alignment wrong %x, al %d", (unsigned)(uintptr_t)ptr, id);
-  if (ptr) { return ptr; }
-  EpReleaseWarning(false, "%s is overflowing to heap, size %d", m_memoryAllocators[id]->Label(), (int)size);
+  if (ptr) {
+    EP_ALLOCATION_TRACK(id, size);
+    return ptr;
+  }
+  EpReleaseAssertMsg(IsMainThread(), "%s overflowed off the main thread, size %d", GetAllocator(id).Label(), (int)size);
+  EpReleaseWarning(false, "%s is overflowing to heap, size %d", GetAllocator(id).Label(), (int)size);
   ptr = g_epMemoryAllocatorHeap.Allocate(size, alignmentMask); // May be null.
   EpReleaseAssertMsg(ptr, "Out of memory.");
+  EP_ALLOCATION_TRACK(EpMemoryAllocatorId_Heap, size);
   EpReleaseAssertMsg(((uintptr_t)ptr & alignmentMask) == 0, "Alignment wrong %x, al-heap", (unsigned)(uintptr_t)ptr);
   return ptr;
 }
@@ -662,8 +718,8 @@ void EpMemoryManager::Free(void* ptr) {
 #endif
 
   EpAssert(m_isInitialized);
-  if (g_epMemoryAllocatorTemporaryStack.Contains(ptr)) {
-    g_epMemoryAllocatorTemporaryStack.OnFreeNonVirtual(ptr);
+  if (t_epMemoryThread.temporaryStack->Contains(ptr)) {
+    t_epMemoryThread.temporaryStack->OnFreeNonVirtual(ptr);
     return; // This is the fast path.
   }
 
@@ -678,6 +734,37 @@ void EpMemoryManager::Free(void* ptr) {
   g_epMemoryAllocatorHeap.Free(ptr);
 }
 
+void EpMemoryManager::FreeExtended(void* ptr, EpMemoryAllocatorId id) {
+  EpInit();
+#if (EP_MEM_DIAGNOSTIC_LEVEL>=1)
+  if (g_epSettings.platform_disableMemoryManager) {
+    ::free(ptr);
+    return;
+  }
+#endif
+
+  EpAssert(m_isInitialized && id >= 0 && id < EpMemoryAllocatorId_MAX);
+  if (id == EpMemoryAllocatorId_Heap) {
+    g_epMemoryAllocatorHeap.Free(ptr);
+    return;
+  }
+  if (id == EpMemoryAllocatorId_TemporaryStack && t_epMemoryThread.temporaryStack->Contains(ptr)) {
+    t_epMemoryThread.temporaryStack->OnFreeNonVirtual(ptr);
+    return;
+  }
+
+  if (m_memoryAllocators[id]->Contains(ptr)) {
+    // The permanent and resource stacks never release memory.
+    if (id != EpMemoryAllocatorId_Permanent && id != EpMemoryAllocatorId_Resource) {
+      m_memoryAllocators[id]->Free(ptr);
+    }
+    return;
+  }
+
+  // Allocations overflow to the heap when id was full.
+  Free(ptr);
+}
+
 // ----------------------------------------------------------------------------
 // EpAllocatorScope
 
@@ -690,10 +777,13 @@ EpAllocatorScope::EpAllocatorScope(EpMemoryAllocatorId id)
     m_previousId = EpMemoryAllocatorId_UNSPECIFIED;
     m_previousAllocationCount = 0;
     m_previousBytesAllocated = 0;
+    m_previousAllocationsMade = s_epMemoryManager.AllocationsMade();
     return;
   }
 #endif
 
+  m_previousAllocationsMade = s_epMemoryManager.AllocationsMade();
+
   // Sets CurrentAllocator():
   m_thisId = id;
   m_previousId = s_epMemoryManager.BeginAllocationScope(this, id);
@@ -758,6 +848,89 @@ uintptr_t EpAllocatorScope::GetScopeBytesAllocated() const {
   return s_epMemoryManager.GetAllocator(m_thisId).GetBytesAllocated(m_thisId) - m_previousBytesAllocated;
 }
 
+uintptr_t EpAllocatorScope::GetScopeAllocationsMade() const {
+  return s_epMemoryManager.AllocationsMade() - m_previousAllocationsMade;
+}
+
+// ----------------------------------------------------------------------------
+// EpAllocationTracker
+
+EpAllocationTracker::EpAllocationTracker() {
+  ::memset(m_allocationCounts, 0, sizeof m_allocationCounts);
+  ::memset(m_bytesAllocated, 0, sizeof m_bytesAllocated);
+  m_callSiteCount = 0u;
+  m_previous = t_epMemoryThread.tracker;
+  t_epMemoryThread.tracker = this;
+}
+
+EpAllocationTracker::~EpAllocationTracker() {
+  EpAssertMsg(t_epMemoryThread.tracker == this, "EpAllocationTracker destroyed out of order");
+  t_epMemoryThread.tracker = m_previous;
+}
+
+uintptr_t EpAllocationTracker::GetAllocationCount() const {
+  uintptr_t count = 0u;
+  for (int i = 0; i < (int)EpMemoryAllocatorId_MAX; ++i) {
+    count += m_allocationCounts[i];
+  }
+  return count;
+}
+
+uintptr_t EpAllocationTracker::GetBytesAllocated() const {
+  uintptr_t bytes = 0u;
+  for (int i = 0; i < (int)EpMemoryAllocatorId_MAX; ++i) {
+    bytes += m_bytesAllocated[i];
+  }
+  return bytes;
+}
+
+void EpAllocationTracker::LogCallSites() const {
+  for (unsigned i = 0u; i < m_callSiteCount; ++i) {
+    const CallSite& site = m_callSites[i];
+    EpLog("Allocation %u: %s, size %d\n", i, s_epMemoryManager.GetAllocator(site.id).Label(), (int)site.size);
+#if (EP_ALLOCATION_BACKTRACE==1)
+    ::backtrace_symbols_fd(const_cast<void* const*>(site.frames), site.frameCount, 2);
+#else
+    for (int j = 0; j < site.frameCount; ++j) {
+      EpLog("  %p\n", site.frames[j]);
+    }
+#endif
+  }
+  uintptr_t count = GetAllocationCount();
+  if (count > m_callSiteCount) {
+    EpLog("%d more allocations not recorded\n", (int)(count - m_callSiteCount));
+  }
+}
+
+void EpAllocationTracker::OnAllocate(EpMemoryAllocatorId id, size_t size) {
+  CallSite* site = 0;
+  for (EpAllocationTracker* tracker = t_epMemoryThread.tracker; tracker; tracker = tracker->m_previous) {
+    ++tracker->m_allocationCounts[id];
+    tracker->m_bytesAllocated[id] += size;
+    if (tracker->m_callSiteCount == MAX_CALL_SITES) {
+      continue;
+    }
+
+    // The call stack is captured once and copied to the outer trackers.
+    CallSite& record = tracker->m_callSites[tracker->m_callSiteCount++];
+    if (site) {
+      record = *site;
+      continue;
+    }
+    site = &record;
+    site->id = id;
+    site->size = size;
+#if (EP_ALLOCATION_BACKTRACE==1)
+    site->frameCount = ::backtrace(site->frames, MAX_FRAMES);
+#elif defined(__GNUC__)
+    site->frames[0] = __builtin_return_address(0);
+    site->frameCount = 1;
+#else
+    site->frameCount = 0;
+#endif
+  }
+}
+
 // ----------------------------------------------------------------------------
 // new, delete and C API
 
@@ -773,6 +946,10 @@ void EpFree(void *ptr) {
   s_epMemoryManager.Free(ptr);
 }
 
+void EpFreeExtended(void *ptr, int memoryAllocatorId) {
+  s_epMemoryManager.FreeExtended(ptr, (EpMemoryAllocatorId)memoryAllocatorId);
+}
+
 void EpMemoryManagementInit() {
   // Contains platform_disableMemoryManager checks
   s_epMemoryManager.Construct();
@@ -788,6 +965,27 @@ void EpMemoryManagementLog() {
   s_epMemoryManager.LogAllocations();
 }
 
+void EpMemoryManagementThreadInit(void* temporaryStack, size_t size) {
+  EpAssertMsg(s_epMemoryManager.IsMainThread() && t_epMemoryThread.currentId == EpMemoryAllocatorId_Heap, "Thread already initialized");
+
+  // The allocator is kept at the start of its own buffer.
+  const size_t header = (sizeof(EpMemoryAllocatorTempStack) + EP_ALIGNMENT_MASK) & ~(size_t)EP_ALIGNMENT_MASK;
+  EpReleaseAssertMsg(((uintptr_t)temporaryStack & EP_ALIGNMENT_MASK) == 0 && size > header, "Bad thread temporary stack");
+  EpMemoryAllocatorTempStack* stack = (EpMemoryAllocatorTempStack*)temporaryStack;
+  stack->Construct((char*)temporaryStack + header, size - header, "thread temp");
+
+  t_epMemoryThread.temporaryStack = stack;
+  t_epMemoryThread.currentId = EpMemoryAllocatorId_TemporaryStack;
+}
+
+void EpMemoryManagementThreadShutDown() {
+  EpAssertMsg(t_epMemoryThread.currentId == EpMemoryAllocatorId_TemporaryStack, "Allocator scope open at thread shut down");
+  EpAssertMsg(t_epMemoryThread.temporaryStack->GetAllocationCount(EpMemoryAllocatorId_TemporaryStack) == 0, "Leaked thread temporary allocation");
+
+  t_epMemoryThread.temporaryStack = &g_epMemoryAllocatorTemporaryStack;
+  t_epMemoryThread.currentId = EpMemoryAllocatorId_Heap;
+}
+
 bool EpIsScratchpad(void * ptr) {
   return g_epMemoryAllocatorScratch.Contains(ptr);
 }
@@ -799,6 +997,7 @@ EpAllocatorScope::EpAllocatorScope(EpMemoryAllocatorId id)
   m_previousId = EpMemoryAllocatorId_Heap;
   m_previousAllocationCount = 0;
   m_previousBytesAllocated = 0;
+  m_previousAllocationsMade = 0;
 }
 
 EpAllocatorScope::~EpAllocatorScope() { }
@@ -811,6 +1010,25 @@ uintptr_t EpAllocatorScope::GetScopeAllocationCount() const { return 0; }
 
 uintptr_t EpAllocatorScope::GetScopeBytesAllocated() const { return 0; }
 
+uintptr_t EpAllocatorScope::GetScopeAllocationsMade() const { return 0; }
+
+EpAllocationTracker::EpAllocationTracker() {
+  ::memset(m_allocationCounts, 0, sizeof m_allocationCounts);
+  ::memset(m_bytesAllocated, 0, sizeof m_bytesAllocated);
+  m_previous = 0;
+  m_callSiteCount = 0u;
+}
+
+EpAllocationTracker::~EpAllocationTracker() { }
+
+uintptr_t EpAllocationTracker::GetAllocationCount() const { return 0; }
+
+uintptr_t EpAllocationTracker::GetBytesAllocated() const { return 0; }
+
+void EpAllocationTracker::LogCallSites() const { }
+
+void EpAllocationTracker::OnAllocate(EpMemoryAllocatorId id, size_t size) { }
+
 // ----------------------------------------------------------------------------
 
 void* EpMalloc(size_t size) { return EpMallocChecked(size); }
@@ -819,6 +1037,8 @@ void* EpMalloc(size_t size) { return EpMallocChecked(size); }
 
 void EpFree(void *ptr) { ::free(ptr); }
 
+void EpFreeExtended(void *ptr, int memoryAllocatorId) { ::free(ptr); }
+
 void EpMemoryManagementInit() { }
 
 void EpMemoryManagementShutDown() { }
@@ -827,6 +1047,30 @@ void EpMemoryManagementLog() { }
 
 bool EpIsScratchpad(void * ptr) { return false; }
 
+void EpMemoryManagementThreadInit(void* temporaryStack, size_t size) { }
+
+void EpMemoryManagementThreadShutDown() { }
+
 #endif // (EP_MEM_DIAGNOSTIC_LEVEL == -1)
 
+// ----------------------------------------------------------------------------
+// Virtual memory for EpAllocatorMode_Virtual.  Independent of the memory
+// manager.
+
+#if (EP_ALLOCATOR_VIRTUAL==1)
+void* EpVirtualReserve(size_t bytes) {
+  void* ptr = ::mmap(0, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr != MAP_FAILED ? ptr : NULL;
+}
 
+void EpVirtualCommit(void* ptr, size_t bytes) {
+  if (bytes != 0u) {
+    int result = ::mprotect(ptr, bytes, PROT_READ | PROT_WRITE);
+    EpReleaseAssertMsg(result == 0, "EpVirtualCommit: commit failure"); (void)result;
+  }
+}
+
+void EpVirtualRelease(void* ptr, size_t bytes) {
+  ::munmap(ptr, bytes);
+}
+#endif
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "EpAllocator.h"
+
+#include <new>
+
+// ----------------------------------------------------------------------------
+// EpPoolHandle
+//
+// A 32-bit reference to an object in an EpPool.  The low EP_POOL_INDEX_BITS
+// select the slot and the rest hold the slot's generation when the object was
+// created, so handles to destroyed objects are detected.  0 is never issued.
+
+#define EP_POOL_INDEX_BITS 20u
+#define EP_POOL_INDEX_MASK ((1u << EP_POOL_INDEX_BITS) - 1u)
+
+struct EpPoolHandle {
+  EP_FORCEINLINE EpPoolHandle() : value(0u) { }
+  EP_FORCEINLINE explicit EpPoolHandle(uint32_t v) : value(v) { }
+  EP_FORCEINLINE bool operator==(const EpPoolHandle& rhs) const { return value == rhs.value; }
+  EP_FORCEINLINE bool operator!=(const EpPoolHandle& rhs) const { return value != rhs.value; }
+  EP_FORCEINLINE bool IsNull() const { return value == 0u; }
+  EP_FORCEINLINE uint32_t GetIndex() const { return value & EP_POOL_INDEX_MASK; }
+  EP_FORCEINLINE uint32_t GetGeneration() const { return value >> EP_POOL_INDEX_BITS; }
+  uint32_t value;
+};
+
+// ----------------------------------------------------------------------------
+// EpPoolSlot
+//
+// generation is odd while the slot holds an object.  A free slot stores the
+// index of the next free slot in its object storage.
+
+template<class T>
+struct EpPoolSlot {
+  EP_FORCEINLINE T* Get() { return (T*)(unsigned*)storage; }
+  EP_FORCEINLINE uint32_t& Next() { return *(uint32_t*)storage; }
+  uint32_t generation;
+  // Force 32-bit alignment
+  unsigned storage[(sizeof(T) + 3) >> 2];
+};
+
+// ----------------------------------------------------------------------------
+// EpPool
+//
+// Fixed size object pool with O(1) Create() and Destroy() through an intrusive
+// free list.  Storage comes from EpAllocator, either fixed or allocated once by
+// reserve() from the current allocator scope, and never moves.  Objects are
+// referenced by EpPoolHandle, with Get() returning NULL for stale handles.
+
+template<class T, unsigned Capacity=EpAllocatorMode_Dynamic>
+class EpPool : private EpAllocator<EpPoolSlot<T>, Capacity> {
+public:
+  typedef EpPoolSlot<T> slot_type;
+
+  static_assert(Capacity <= EP_POOL_INDEX_MASK + 1u, "EpPool: Capacity exceeds handle index");
+
+  EP_FORCEINLINE EpPool() {
+    m_size = 0u;
+    m_freeHead = NONE;
+    if (Capacity != EpAllocatorMode_Dynamic) {
+      InitSlots();
+    }
+  }
+
+  EP_FORCEINLINE ~EpPool() {
+    slot_type* slots = this->GetStorage();
+    for (unsigned i = 0u; i < capacity() && m_size != 0u; ++i) {
+      if (slots[i].generation & 1u) {
+        slots[i].Get()->~T();
+        --m_size;
+      }
+    }
+  }
+
+  EP_FORCEINLINE unsigned size() const { return m_size; }
+  EP_FORCEINLINE unsigned capacity() const { return this->GetCapacity(); }
+  EP_FORCEINLINE bool empty() const { return m_size == 0u; }
+  EP_FORCEINLINE bool full() const { return m_freeHead == NONE; }
+
+  // Only allocates once when dynamic.
+  EP_FORCEINLINE void reserve(unsigned c) {
+    if (c <= capacity()) {
+      return;
+    }
+    EpReleaseAssertMsg(c <= EP_POOL_INDEX_MASK + 1u, "EpPool: Capacity exceeds handle index.");
+    this->Reserve(c);
+    InitSlots();
+  }
+
+  EP_FORCEINLINE EpPoolHandle Create() {
+    slot_type& slot = Allocate();
+    ::new (slot.Get()) T;
+    return Issue(slot);
+  }
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+  template <class... Args>
+  EP_FORCEINLINE EpPoolHandle Create(Args&&... args) {
+    slot_type& slot = Allocate();
+    ::new (slot.Get()) T(EpForward<Args>(args)...);
+    return Issue(slot);
+  }
+#endif
+
+  // Ignores null handles.  Asserts on stale handles.
+  EP_FORCEINLINE void Destroy(EpPoolHandle handle) {
+    if (handle.IsNull()) {
+      return;
+    }
+    slot_type* slot = Find(handle);
+    EpReleaseAssertMsg(slot != NULL, "EpPool: Destroying stale handle 0x%x", (unsigned)handle.value);
+    slot->Get()->~T();
+    if (EpIsDebug()) {
+      ::memset((void*)slot->storage, 0xab, sizeof slot->storage);
+    }
+    ++slot->generation;
+    slot->Next() = m_freeHead;
+    m_freeHead = handle.GetIndex();
+    --m_size;
+  }
+
+  // Returns NULL for null and stale handles.
+  EP_FORCEINLINE T* Get(EpPoolHandle handle) const {
+    slot_type* slot = Find(handle);
+    return slot ? slot->Get() : NULL;
+  }
+
+  EP_FORCEINLINE bool IsValid(EpPoolHandle handle) const {
+    return Find(handle) != NULL;
+  }
+
+private:
+  EpPool(const EpPool&);
+  void operator=(const EpPool&);
+
+  enum { NONE = ~0u, GENERATION_MASK = (1u << (32u - EP_POOL_INDEX_BITS)) - 1u };
+
+  EP_FORCEINLINE void InitSlots() {
+    slot_type* slots = this->GetStorage();
+    for (unsigned i = 0u; i < capacity(); ++i) {
+      slots[i].generation = 0u;
+      slots[i].Next() = (i + 1u < capacity()) ? i + 1u : (uint32_t)NONE;
+    }
+    m_freeHead = capacity() ? 0u : (uint32_t)NONE;
+  }
+
+  EP_FORCEINLINE slot_type& Allocate() {
+    EpReleaseAssertMsg(m_freeHead != NONE, "EpPool: Overflowing capacity.");
+    slot_type& slot = this->GetStorage()[m_freeHead];
+    m_freeHead = slot.Next();
+    ++m_size;
+    return slot;
+  }
+
+  EP_FORCEINLINE EpPoolHandle Issue(slot_type& slot) {
+    ++slot.generation; // Now odd, so the handle is never 0.
+    uint32_t index = (uint32_t)(&slot - this->GetStorage());
+    return EpPoolHandle(((slot.generation & GENERATION_MASK) << EP_POOL_INDEX_BITS) | index);
+  }
+
+  EP_FORCEINLINE slot_type* Find(EpPoolHandle handle) const {
+    uint32_t index = handle.GetIndex();
+    if (handle.IsNull() || index >= capacity()) {
+      return NULL;
+    }
+    slot_type* slot = this->GetStorage() + index;
+    return ((slot->generation & GENERATION_MASK) == handle.GetGeneration() && (slot->generation & 1u)) ? slot : NULL;
+  }
+
+  unsigned m_size;
+  uint32_t m_freeHead;
+};
+
+// ----------------------------------------------------------------------------
+// EpPoolPtr
+//
+// Destroys the referenced object on destruction, like EpUniquePtr.  Costs a
+// pool pointer and a handle.
+
+template<class T, unsigned Capacity=EpAllocatorMode_Dynamic>
+struct EpPoolPtr {
+public:
+  typedef EpPool<T, Capacity> pool_type;
+
+  EpPoolPtr() { m_pool = 0; }
+
+  EpPoolPtr(pool_type& pool, EpPoolHandle handle) { m_pool = &pool; m_handle = handle; }
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+  EpPoolPtr(EpPoolPtr&& rhs) { m_pool = rhs.m_pool; m_handle = rhs.release(); }
+
+  void operator=(EpPoolPtr&& rhs) { Take(rhs); }
+
+  EpPoolPtr(const EpPoolPtr&) = delete;
+  void operator=(const EpPoolPtr&) = delete;
+#else
+  EpPoolPtr(EpPoolPtr& rhs) { m_pool = rhs.m_pool; m_handle = rhs.release(); } // move semantics
+
+  void operator=(EpPoolPtr& rhs) { Take(rhs); } // move semantics
+#endif
+
+  ~EpPoolPtr() {
+    reset();
+  }
+
+  T* operator->() const { EpAssert(get()); return get(); }
+  T& operator*() const { EpAssert(get()); return *get(); }
+
+  operator bool() const { return get() != 0; }
+
+  T* get() const { return m_pool ? m_pool->Get(m_handle) : 0; }
+
+  EpPoolHandle handle() const { return m_handle; }
+
+  EpPoolHandle release() {
+    EpPoolHandle t = m_handle;
+    m_handle = EpPoolHandle();
+    return t;
+  }
+
+  void reset() {
+    if (m_pool) {
+      m_pool->Destroy(m_handle);
+    }
+    m_handle = EpPoolHandle();
+  }
+
+  void reset(pool_type& pool, EpPoolHandle handle) {
+    reset();
+    m_pool = &pool;
+    m_handle = handle;
+  }
+
+private:
+  // rhs may be empty, with no pool.
+  void Take(EpPoolPtr& rhs) {
+    if (this != &rhs) {
+      reset();
+      m_pool = rhs.m_pool;
+      m_handle = rhs.release();
+    }
+  }
+
+  pool_type* m_pool;
+  EpPoolHandle m_handle;
+};
@@ -0,0 +1,92 @@
+#include "EmbeddedPlatform.h"
+#include "EpPool.h"
+#include "EpTest.h"
+
+class EpPoolTest :
+  public testing::Test
+{
+public:
+  struct TestObject {
+    TestObject() { id = -1; ++s_live; }
+    explicit TestObject(int x) { id = x; ++s_live; }
+    ~TestObject() { --s_live; }
+    int id;
+  };
+
+  EpPoolTest() { s_live = 0; }
+
+  static int s_live;
+};
+
+int EpPoolTest::s_live = 0;
+
+TEST_F(EpPoolTest, Handles) {
+  {
+    EpPool<TestObject, 4u> pool;
+    ASSERT_EQ(pool.capacity(), 4u);
+    ASSERT_TRUE(sizeof(EpPoolHandle) == 4u);
+
+    EpPoolHandle a = pool.Create();
+    EpPoolHandle b = pool.Create();
+    ASSERT_FALSE(a.IsNull());
+    ASSERT_TRUE((a != b));
+    ASSERT_EQ(pool.size(), 2u);
+    ASSERT_EQ(s_live, 2);
+    ASSERT_EQ(pool.Get(a)->id, -1);
+
+    pool.Get(b)->id = 5;
+    pool.Destroy(a);
+    ASSERT_EQ(s_live, 1);
+    ASSERT_TRUE((pool.Get(a) == NULL)); // Stale
+    ASSERT_FALSE(pool.IsValid(a));
+    ASSERT_EQ(pool.Get(b)->id, 5);
+
+    // The slot is reused with a new generation.
+    EpPoolHandle c = pool.Create();
+    ASSERT_EQ(c.GetIndex(), a.GetIndex());
+    ASSERT_TRUE((c != a));
+    ASSERT_FALSE(pool.IsValid(a));
+    ASSERT_TRUE(pool.IsValid(c));
+    ASSERT_TRUE((pool.Get(EpPoolHandle()) == NULL));
+
+    pool.Create();
+    pool.Create();
+    ASSERT_TRUE(pool.full());
+  }
+
+  ASSERT_EQ(s_live, 0); // Pool destroyed the remaining objects.
+}
+
+TEST_F(EpPoolTest, PoolPtr) {
+  EpPool<TestObject> pool;
+  pool.reserve(8u);
+  {
+    EpPoolPtr<TestObject> p0(pool, pool.Create());
+    ASSERT_EQ(p0->id, -1);
+    ASSERT_EQ(s_live, 1);
+
+    EpPoolPtr<TestObject> p1(EpMove(p0));
+    ASSERT_FALSE(p0);
+    ASSERT_TRUE(p1);
+
+    p1.reset();
+    ASSERT_EQ(s_live, 0);
+    ASSERT_EQ(pool.size(), 0u);
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+    p1.reset(pool, pool.Create(42));
+    ASSERT_EQ(p1->id, 42);
+#endif
+
+    // Assigning an empty pointer destroys the object.
+    EpPoolPtr<TestObject> empty;
+    p0 = EpMove(empty);
+    ASSERT_FALSE(p0);
+    p1 = EpMove(p0);
+    ASSERT_FALSE(p1);
+    ASSERT_EQ(s_live, 0);
+  }
+
+  ASSERT_EQ(s_live, 0);
+  ASSERT_TRUE(pool.empty());
+}
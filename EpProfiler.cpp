@@ -6,6 +6,7 @@
 #if (EP_PROFILE==1)
 
  EpProfilerData ep_sProfilerData;
+EP_THREAD_LOCAL EpProfilerData* ep_tProfilerData = &ep_sProfilerData;
 
 // C++11 version
 #ifndef EP_BUILD_SOME_EMBEDDED_COMPILER
@@ -43,28 +44,39 @@ void EpProfilerShutdown() {
 }
 
 void EpProfilerLog() {
-  EpProfilerData& data = ep_sProfilerData;
-  if (!data.m_isEnabled) {
+  if (!ep_sProfilerData.m_isEnabled) {
     EpProfilerInit();
     EpDebugWarning(false, "Error unexpected profiler init... ");
   }
+  EpProfilerLog(*ep_tProfilerData);
+}
 
+void EpProfilerLog(EpProfilerData& data) {
   for (unsigned i = 0; i < data.m_records.size(); ++i) {
     const EpProfilerRecord& rec = data.m_records[i];
 
     unsigned delta = rec.m_end - rec.m_begin;
-    EpLog("EpProfiler %s: %u cycles %f ms\n", EpBasename(rec.m_label), delta, (float)delta / (EP_CYCLES_PER_MICROSECOND * 1000.0f));
+    EpLogAt(Profiler, Info, "EpProfiler %s: %u cycles %f ms\n", EpBasename(rec.m_label), delta, (float)delta / (EP_CYCLES_PER_MICROSECOND * 1000.0f));
   }
 
   if(data.m_records.empty()) {
-    EpLog("EpProfiler no samples\n");
+    EpLogAt(Profiler, Info, "EpProfiler no samples\n");
   }
 
   data.m_records.clear();
 }
 
+void EpProfilerThreadInit(EpProfilerData* data) {
+  EpAssert(ep_tProfilerData == &ep_sProfilerData && data->m_records.capacity() != 0u);
+  ep_tProfilerData = data;
+}
+
+void EpProfilerThreadShutDown() {
+  ep_tProfilerData = &ep_sProfilerData;
+}
+
 unsigned EpProfilerQuery(EpProfilerRecordExternal* buf, unsigned maxSize) {
-  EpProfilerData& data = ep_sProfilerData;
+  EpProfilerData& data = *ep_tProfilerData;
 
   if (!data.m_isEnabled) {
     EpProfilerInit();
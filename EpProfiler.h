@@ -48,6 +48,10 @@ public:
 
 extern EpProfilerData ep_sProfilerData;
 
+// The calling thread's records.  ep_sProfilerData unless EpProfilerThreadInit()
+// was called.
+extern EP_THREAD_LOCAL EpProfilerData* ep_tProfilerData;
+
 // EpProfilerSample
 static EP_FORCEINLINE unsigned EpProfilerSample() {
 #if defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
@@ -67,7 +71,7 @@ public:
   EP_FORCEINLINE ~EpProfiler() {
     unsigned t1 = EpProfilerSample();
     unsigned delta = (t1 - m_t0);
-    EpProfilerData& data = ep_sProfilerData;
+    EpProfilerData& data = *ep_tProfilerData;
     if (data.m_isEnabled && !data.m_records.full() && delta >= m_minCycles) {
       new (data.m_records.emplace_back_raw()) EpProfilerRecord(m_t0, t1, m_label);
     }
@@ -85,6 +89,12 @@ private:
 void EpProfilerInit();
 void EpProfilerShutdown();
 void EpProfilerLog(); // clears buffer
+void EpProfilerLog(EpProfilerData& data); // For other threads when they are idle.
+
+// Threads other than the main thread that profile need their own records.
+// data.m_records must be reserved before the thread starts.
+void EpProfilerThreadInit(EpProfilerData* data);
+void EpProfilerThreadShutDown();
 unsigned EpProfilerQuery(EpProfilerRecordExternal* buf, unsigned maxSize); // clears buffer, returns count
 
 #define EpProfileScope(...)  EpProfiler EP_CONCATENATE(epProfiler_,__LINE__)(__VA_ARGS__)
@@ -94,5 +104,7 @@ unsigned EpProfilerQuery(EpProfilerRecordExternal* buf, unsigned maxSize); // cl
 #define EpProfilerInit(...) ((void)0)
 #define EpProfilerShutdown(...) ((void)0)
 #define EpProfilerLog(...) ((void)0)
+#define EpProfilerThreadInit(...) ((void)0)
+#define EpProfilerThreadShutDown(...) ((void)0)
 #define EpProfileScope(...) ((void)0)
 #endif
@@ -0,0 +1,325 @@
+#pragma once
+
+#include "EpAllocator.h"
+
+#include <new>
+
+// ----------------------------------------------------------------------------
+// EpSpscQueue, EpMpmcQueue, EpWorkStealingDeque
+//
+// Bounded lock-free queues for handing work between threads or cores.  As with
+// EpArray the storage is fixed or allocated once by reserve() from the current
+// allocator scope.  reserve() must be called before the queue is shared.
+// Capacity must be a power of 2.  Indices are free running 32-bit counters that
+// are masked into the ring.  Requires C++11 atomics.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+#include <atomic>
+#include <type_traits>
+
+// Head and tail are padded apart so the producer and consumer do not share a
+// cache line.
+#define EP_CACHE_LINE_SIZE 64
+
+// ----------------------------------------------------------------------------
+// EpSpscQueue
+//
+// One producer thread calls try_push() and one consumer thread calls try_pop().
+// Each side caches the other's index and only rereads it when the queue
+// appears full or empty.
+
+template<class T, unsigned Capacity=EpAllocatorMode_Dynamic>
+class EpSpscQueue : private EpAllocator<T, Capacity> {
+public:
+  static_assert((Capacity & (Capacity - 1u)) == 0u, "EpSpscQueue: Capacity must be a power of 2");
+
+  EP_FORCEINLINE EpSpscQueue() : m_tail(0u), m_head(0u) {
+    m_cachedHead = 0u;
+    m_cachedTail = 0u;
+  }
+
+  EP_FORCEINLINE ~EpSpscQueue() {
+    T* storage = this->GetStorage();
+    const unsigned mask = capacity() - 1u;
+    for (unsigned i = m_head.load(std::memory_order_relaxed); i != m_tail.load(std::memory_order_relaxed); ++i) {
+      storage[i & mask].~T();
+    }
+  }
+
+  EP_FORCEINLINE unsigned capacity() const { return this->GetCapacity(); }
+
+  // Approximate when called concurrently.
+  EP_FORCEINLINE unsigned size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+  EP_FORCEINLINE bool empty() const { return size() == 0u; }
+
+  // Rounds up to a power of 2.  Only allocates once when dynamic.
+  EP_FORCEINLINE void reserve(unsigned c) {
+    if (c <= capacity()) {
+      return;
+    }
+    unsigned slots = 1u;
+    while (slots < c) {
+      slots <<= 1;
+    }
+    this->Reserve(slots);
+  }
+
+  // Producer only.  Returns false when full.
+  EP_FORCEINLINE bool try_push(const T& t) {
+    const unsigned tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_cachedHead == capacity()) {
+      m_cachedHead = m_head.load(std::memory_order_acquire);
+      if (tail - m_cachedHead == capacity()) {
+        return false;
+      }
+    }
+    ::new (this->GetStorage() + (tail & (capacity() - 1u))) T(t);
+    m_tail.store(tail + 1u, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only.  Returns false when empty.
+  EP_FORCEINLINE bool try_pop(T& t) {
+    const unsigned head = m_head.load(std::memory_order_relaxed);
+    if (head == m_cachedTail) {
+      m_cachedTail = m_tail.load(std::memory_order_acquire);
+      if (head == m_cachedTail) {
+        return false;
+      }
+    }
+    T* it = this->GetStorage() + (head & (capacity() - 1u));
+    t = EpMove(*it);
+    it->~T();
+    m_head.store(head + 1u, std::memory_order_release);
+    return true;
+  }
+
+private:
+  EpSpscQueue(const EpSpscQueue&);
+  void operator=(const EpSpscQueue&);
+
+  char m_pad0[EP_CACHE_LINE_SIZE];
+  std::atomic<unsigned> m_tail; // Written by the producer.
+  unsigned m_cachedHead;
+  char m_pad1[EP_CACHE_LINE_SIZE - sizeof(unsigned) * 2u];
+  std::atomic<unsigned> m_head; // Written by the consumer.
+  unsigned m_cachedTail;
+  char m_pad2[EP_CACHE_LINE_SIZE - sizeof(unsigned) * 2u];
+};
+
+// ----------------------------------------------------------------------------
+// EpMpmcQueue
+//
+// Any number of threads may call try_push() and try_pop().  Each cell carries a
+// sequence number recording whether it is ready to be written or read for a
+// given lap of the ring, so claiming a cell is a single compare-and-swap.
+
+template<class T>
+struct EpMpmcQueueCell {
+  std::atomic<unsigned> sequence;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+  EP_FORCEINLINE T* Get() { return (T*)&value; }
+};
+
+template<class T, unsigned Capacity=EpAllocatorMode_Dynamic>
+class EpMpmcQueue : private EpAllocator<EpMpmcQueueCell<T>, Capacity> {
+public:
+  static_assert((Capacity & (Capacity - 1u)) == 0u, "EpMpmcQueue: Capacity must be a power of 2");
+
+  typedef EpMpmcQueueCell<T> cell_type;
+
+  EP_FORCEINLINE EpMpmcQueue() : m_tail(0u), m_head(0u) {
+    if (Capacity != EpAllocatorMode_Dynamic) {
+      InitCells();
+    }
+  }
+
+  EP_FORCEINLINE ~EpMpmcQueue() {
+    cell_type* cells = this->GetStorage();
+    const unsigned mask = capacity() - 1u;
+    for (unsigned i = m_head.load(std::memory_order_relaxed); i != m_tail.load(std::memory_order_relaxed); ++i) {
+      cells[i & mask].Get()->~T();
+    }
+    for (unsigned i = 0u; i < capacity(); ++i) {
+      cells[i].sequence.~atomic();
+    }
+  }
+
+  EP_FORCEINLINE unsigned capacity() const { return this->GetCapacity(); }
+
+  // Approximate when called concurrently.
+  EP_FORCEINLINE unsigned size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+  EP_FORCEINLINE bool empty() const { return size() == 0u; }
+
+  // Rounds up to a power of 2.  Only allocates once when dynamic.
+  EP_FORCEINLINE void reserve(unsigned c) {
+    if (c <= capacity()) {
+      return;
+    }
+    unsigned slots = 1u;
+    while (slots < c) {
+      slots <<= 1;
+    }
+    this->Reserve(slots);
+    InitCells();
+  }
+
+  // Returns false when full.
+  EP_FORCEINLINE bool try_push(const T& t) {
+    const unsigned mask = capacity() - 1u;
+    unsigned tail = m_tail.load(std::memory_order_relaxed);
+    cell_type* cell;
+    for (;;) {
+      cell = this->GetStorage() + (tail & mask);
+      int lap = (int)(cell->sequence.load(std::memory_order_acquire) - tail);
+      if (lap == 0) {
+        if (m_tail.compare_exchange_weak(tail, tail + 1u, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (lap < 0) {
+        return false; // Not yet consumed from the previous lap.
+      } else {
+        tail = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+    ::new (cell->Get()) T(t);
+    cell->sequence.store(tail + 1u, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false when empty.
+  EP_FORCEINLINE bool try_pop(T& t) {
+    const unsigned mask = capacity() - 1u;
+    unsigned head = m_head.load(std::memory_order_relaxed);
+    cell_type* cell;
+    for (;;) {
+      cell = this->GetStorage() + (head & mask);
+      int lap = (int)(cell->sequence.load(std::memory_order_acquire) - (head + 1u));
+      if (lap == 0) {
+        if (m_head.compare_exchange_weak(head, head + 1u, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (lap < 0) {
+        return false; // Not yet produced.
+      } else {
+        head = m_head.load(std::memory_order_relaxed);
+      }
+    }
+    t = EpMove(*cell->Get());
+    cell->Get()->~T();
+    cell->sequence.store(head + mask + 1u, std::memory_order_release);
+    return true;
+  }
+
+private:
+  EpMpmcQueue(const EpMpmcQueue&);
+  void operator=(const EpMpmcQueue&);
+
+  EP_FORCEINLINE void InitCells() {
+    cell_type* cells = this->GetStorage();
+    for (unsigned i = 0u; i < capacity(); ++i) {
+      ::new (&cells[i].sequence) std::atomic<unsigned>(i);
+    }
+  }
+
+  char m_pad0[EP_CACHE_LINE_SIZE];
+  std::atomic<unsigned> m_tail;
+  char m_pad1[EP_CACHE_LINE_SIZE - sizeof(unsigned)];
+  std::atomic<unsigned> m_head;
+  char m_pad2[EP_CACHE_LINE_SIZE - sizeof(unsigned)];
+};
+
+// ----------------------------------------------------------------------------
+// EpWorkStealingDeque
+//
+// Chase-Lev deque.  The owning thread calls push() and pop() at the bottom and
+// any thread may steal() from the top, so the owner works depth first while
+// thieves take the oldest work.  Elements are held in atomics and so must be
+// trivially copyable, typically pointers.  Fixed size: push() fails when full.
+
+template<class T, unsigned Capacity=EpAllocatorMode_Dynamic>
+class EpWorkStealingDeque : private EpAllocator<std::atomic<T>, Capacity> {
+public:
+  static_assert((Capacity & (Capacity - 1u)) == 0u, "EpWorkStealingDeque: Capacity must be a power of 2");
+
+  EP_FORCEINLINE EpWorkStealingDeque() : m_top(0), m_bottom(0) { }
+
+  EP_FORCEINLINE unsigned capacity() const { return this->GetCapacity(); }
+
+  // Approximate when called concurrently.
+  EP_FORCEINLINE unsigned size() const {
+    int64_t n = m_bottom.load(std::memory_order_acquire) - m_top.load(std::memory_order_acquire);
+    return n > 0 ? (unsigned)n : 0u;
+  }
+  EP_FORCEINLINE bool empty() const { return size() == 0u; }
+
+  // Rounds up to a power of 2.  Only allocates once when dynamic.
+  EP_FORCEINLINE void reserve(unsigned c) {
+    if (c <= capacity()) {
+      return;
+    }
+    unsigned slots = 1u;
+    while (slots < c) {
+      slots <<= 1;
+    }
+    this->Reserve(slots);
+  }
+
+  // Owner only.  Returns false when full.
+  EP_FORCEINLINE bool push(T t) {
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    const int64_t top = m_top.load(std::memory_order_acquire);
+    if (bottom - top >= (int64_t)capacity()) {
+      return false;
+    }
+    this->GetStorage()[bottom & (capacity() - 1u)].store(t, std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, std::memory_order_release); // Publishes what t points to.
+    return true;
+  }
+
+  // Owner only.  Returns false when empty or the last element was stolen.
+  EP_FORCEINLINE bool pop(T& t) {
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      m_bottom.store(bottom + 1, std::memory_order_relaxed); // Was empty.
+      return false;
+    }
+    t = this->GetStorage()[bottom & (capacity() - 1u)].load(std::memory_order_relaxed);
+    if (top < bottom) {
+      return true;
+    }
+
+    // Last element.  Race thieves for it.
+    bool isWon = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    return isWon;
+  }
+
+  // Any thread.  Returns false when empty or another thread won the element.
+  EP_FORCEINLINE bool steal(T& t) {
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return false;
+    }
+    t = this->GetStorage()[top & (capacity() - 1u)].load(std::memory_order_relaxed);
+    return m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  }
+
+private:
+  EpWorkStealingDeque(const EpWorkStealingDeque&);
+  void operator=(const EpWorkStealingDeque&);
+
+  char m_pad0[EP_CACHE_LINE_SIZE];
+  std::atomic<int64_t> m_top; // Advanced by thieves and the owner's last pop.
+  char m_pad1[EP_CACHE_LINE_SIZE - sizeof(int64_t)];
+  std::atomic<int64_t> m_bottom; // Written by the owner.
+  char m_pad2[EP_CACHE_LINE_SIZE - sizeof(int64_t)];
+};
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
@@ -0,0 +1,231 @@
+#include "EmbeddedPlatform.h"
+#include "EpQueue.h"
+#include "EpProfiler.h"
+#include "EpTest.h"
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+#include <thread>
+
+// Worker threads only touch the queues.  The memory manager, profiler and
+// logging stay on the test thread.  Waiting threads yield so the benchmarks
+// also complete on a single core.
+
+class EpQueueTest :
+  public testing::Test
+{
+public:
+  enum { BENCHMARK_COUNT = 1 << 20, PING_COUNT = 1 << 12 };
+
+  typedef EpSpscQueue<unsigned, 1024u> Spsc;
+  typedef EpMpmcQueue<unsigned, 1024u> Mpmc;
+
+  template<class Queue>
+  static void Produce(Queue* queue, unsigned begin, unsigned end) {
+    for (unsigned i = begin; i < end; ++i) {
+      while (!queue->try_push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  template<class Queue>
+  static void Consume(Queue* queue, unsigned count, uint64_t* sum) {
+    uint64_t total = 0u;
+    unsigned value;
+    for (unsigned i = 0u; i < count; ++i) {
+      while (!queue->try_pop(value)) {
+        std::this_thread::yield();
+      }
+      total += value;
+    }
+    *sum = total;
+  }
+
+  // Returns each value to the sender.
+  static void Echo(Spsc* in, Spsc* out, unsigned count) {
+    unsigned value;
+    for (unsigned i = 0u; i < count; ++i) {
+      while (!in->try_pop(value)) { std::this_thread::yield(); }
+      while (!out->try_push(value)) { std::this_thread::yield(); }
+    }
+  }
+};
+
+TEST_F(EpQueueTest, Spsc) {
+  EpSpscQueue<int> queue;
+  queue.reserve(3u);
+  ASSERT_EQ(queue.capacity(), 4u);
+  ASSERT_TRUE(queue.empty());
+
+  for (int i = 0; i < 4; ++i) {
+    bool isPushed = queue.try_push(i);
+    ASSERT_TRUE(isPushed);
+  }
+  bool isPushed = queue.try_push(4);
+  ASSERT_FALSE(isPushed); // Full
+  ASSERT_EQ(queue.size(), 4u);
+
+  // Wrap around the ring several times.
+  int value = -1;
+  for (int i = 0; i < 12; ++i) {
+    bool isPopped = queue.try_pop(value);
+    ASSERT_TRUE(isPopped);
+    ASSERT_EQ(value, i);
+    isPushed = queue.try_push(i + 4);
+    ASSERT_TRUE(isPushed);
+  }
+  ASSERT_EQ(queue.size(), 4u);
+}
+
+TEST_F(EpQueueTest, Mpmc) {
+  EpMpmcQueue<int, 4u> queue;
+  for (int i = 0; i < 4; ++i) {
+    bool isPushed = queue.try_push(i);
+    ASSERT_TRUE(isPushed);
+  }
+  bool isPushed = queue.try_push(4);
+  ASSERT_FALSE(isPushed); // Full
+
+  int value = -1;
+  for (int i = 0; i < 4; ++i) {
+    bool isPopped = queue.try_pop(value);
+    ASSERT_TRUE(isPopped);
+    ASSERT_EQ(value, i);
+  }
+  bool isPopped = queue.try_pop(value);
+  ASSERT_FALSE(isPopped); // Empty
+}
+
+TEST_F(EpQueueTest, WorkStealingDeque) {
+  EpWorkStealingDeque<int*, 4u> deque;
+  int values[5] = { 0, 1, 2, 3, 4 };
+  for (int i = 0; i < 4; ++i) {
+    bool isPushed = deque.push(values + i);
+    ASSERT_TRUE(isPushed);
+  }
+  bool isPushed = deque.push(values + 4);
+  ASSERT_FALSE(isPushed); // Full
+
+  // The owner takes the newest and thieves the oldest.
+  int* value = NULL;
+  bool isPopped = deque.pop(value);
+  ASSERT_TRUE(isPopped && value == values + 3);
+  bool isStolen = deque.steal(value);
+  ASSERT_TRUE(isStolen && value == values + 0);
+  isStolen = deque.steal(value);
+  ASSERT_TRUE(isStolen && value == values + 1);
+  isPopped = deque.pop(value);
+  ASSERT_TRUE(isPopped && value == values + 2);
+  isPopped = deque.pop(value);
+  ASSERT_FALSE(isPopped); // Empty
+  isStolen = deque.steal(value);
+  ASSERT_FALSE(isStolen);
+  ASSERT_TRUE(deque.empty());
+}
+
+// The owner pushes and pops while two threads steal.  Each item is taken once.
+TEST_F(EpQueueTest, WorkStealingDequeThreads) {
+  typedef EpWorkStealingDeque<unsigned*, 256u> Deque;
+  static Deque deque;
+  static unsigned items[PING_COUNT];
+  static std::atomic<bool> isDone;
+  isDone = false;
+
+  struct Thief {
+    static void Steal(uint64_t* sum) {
+      uint64_t total = 0u;
+      unsigned* item;
+      while (!isDone.load() || !deque.empty()) {
+        if (deque.steal(item)) {
+          total += *item;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      *sum = total;
+    }
+  };
+
+  uint64_t sums[3] = { 0u, 0u, 0u };
+  std::thread thief0(Thief::Steal, &sums[1]);
+  std::thread thief1(Thief::Steal, &sums[2]);
+  unsigned* item;
+  for (unsigned i = 0u; i < (unsigned)PING_COUNT; ++i) {
+    items[i] = i;
+    while (!deque.push(items + i)) {
+      std::this_thread::yield();
+    }
+    if ((i & 3u) == 0u && deque.pop(item)) {
+      sums[0] += *item;
+    }
+  }
+  while (deque.pop(item)) {
+    sums[0] += *item;
+  }
+  isDone = true;
+  thief0.join();
+  thief1.join();
+
+  ASSERT_TRUE(sums[0] + sums[1] + sums[2] == (uint64_t)PING_COUNT * (PING_COUNT - 1) / 2u);
+  ASSERT_TRUE(deque.empty());
+}
+
+// Logs cycles per item from one producer to one consumer.
+TEST_F(EpQueueTest, SpscThroughput) {
+  static Spsc queue;
+  uint64_t sum = 0u;
+
+  unsigned t0 = EpProfilerSample();
+  std::thread consumer(Consume<Spsc>, &queue, (unsigned)BENCHMARK_COUNT, &sum);
+  Produce(&queue, 0u, (unsigned)BENCHMARK_COUNT);
+  consumer.join();
+  unsigned t1 = EpProfilerSample();
+
+  EpLog("EpSpscQueue: %u items in %u cycles, %.1f cycles per item\n",
+    (unsigned)BENCHMARK_COUNT, t1 - t0, (double)(t1 - t0) / (double)BENCHMARK_COUNT);
+  ASSERT_TRUE(sum == (uint64_t)BENCHMARK_COUNT * (BENCHMARK_COUNT - 1) / 2u);
+}
+
+// Logs the round trip latency of two queues in opposite directions.
+TEST_F(EpQueueTest, SpscLatency) {
+  static Spsc ping;
+  static Spsc pong;
+
+  std::thread echo(Echo, &ping, &pong, (unsigned)PING_COUNT);
+  unsigned t0 = EpProfilerSample();
+  unsigned value = 0u;
+  for (unsigned i = 0u; i < (unsigned)PING_COUNT; ++i) {
+    while (!ping.try_push(i)) { std::this_thread::yield(); }
+    while (!pong.try_pop(value)) { std::this_thread::yield(); }
+  }
+  unsigned t1 = EpProfilerSample();
+  echo.join();
+
+  EpLog("EpSpscQueue: %.1f cycles per round trip\n", (double)(t1 - t0) / (double)PING_COUNT);
+  ASSERT_EQ(value, (unsigned)PING_COUNT - 1u);
+}
+
+// Logs cycles per item with two producers and two consumers.
+TEST_F(EpQueueTest, MpmcThroughput) {
+  static Mpmc queue;
+  const unsigned half = (unsigned)BENCHMARK_COUNT / 2u;
+  uint64_t sums[2] = { 0u, 0u };
+
+  unsigned t0 = EpProfilerSample();
+  std::thread consumer0(Consume<Mpmc>, &queue, half, &sums[0]);
+  std::thread consumer1(Consume<Mpmc>, &queue, half, &sums[1]);
+  std::thread producer(Produce<Mpmc>, &queue, half, (unsigned)BENCHMARK_COUNT);
+  Produce(&queue, 0u, half);
+  producer.join();
+  consumer0.join();
+  consumer1.join();
+  unsigned t1 = EpProfilerSample();
+
+  EpLog("EpMpmcQueue: %u items in %u cycles, %.1f cycles per item\n",
+    (unsigned)BENCHMARK_COUNT, t1 - t0, (double)(t1 - t0) / (double)BENCHMARK_COUNT);
+  ASSERT_TRUE(sums[0] + sums[1] == (uint64_t)BENCHMARK_COUNT * (BENCHMARK_COUNT - 1) / 2u);
+  ASSERT_TRUE(queue.empty());
+}
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
@@ -8,6 +8,7 @@ void EpSettings::Construct() {
   platform_runTestsInMain = true; // Must disable before EpMain().
   platform_isShuttingDown = false;
   platform_assertsAllowed = 0;
+  platform_isLogDeferred = false;
 #if defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
   platform_isLogging = false; // Logging from constructors was crashing.
   platform_disableMemoryManager = true;
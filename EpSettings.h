@@ -12,6 +12,7 @@ public:
   bool platform_runTestsInMain;
   bool platform_isShuttingDown; // Allows destruction of permanent resources
   bool platform_isLogging;
+  bool platform_isLogDeferred; // EpLog() is formatted later by EpLogFlush().
   int platform_assertsAllowed;
   bool platform_disableMemoryManager;
 };
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "EpAllocator.h"
+
+// ----------------------------------------------------------------------------
+// EpSoaArray
+//
+// A structure-of-arrays version of EpArray.  EpSoaArray<MaxDim, Fields...>
+// stores each field in its own contiguous column of the same fixed or
+// dynamically allocated block, so loops touching a few fields only stream
+// those columns.  The capacity comes first because it cannot follow a pack.
+// Like EpArray the storage is never reallocated.  Fields must be trivially
+// copyable and are left uninitialized by resize().  Requires C++11.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+// Alignment of each column.  Suitable for 128-bit SIMD loads.
+#define EP_SOA_ALIGNMENT ((size_t)16)
+#define EpSoaAlign(x) (((size_t)(x) + EP_SOA_ALIGNMENT - (size_t)1) & ~(EP_SOA_ALIGNMENT - (size_t)1))
+
+// A column of an EpSoaArray.  EP_RESTRICT as columns never overlap.
+template<class T>
+struct EpSoaSpan {
+  EP_FORCEINLINE EpSoaSpan(T* d, unsigned s) : data(d), count(s) { }
+
+  EP_FORCEINLINE T* begin() const { return data; }
+  EP_FORCEINLINE T* end() const { return data + count; }
+  EP_FORCEINLINE unsigned size() const { return count; }
+  EP_FORCEINLINE T& operator[](unsigned index) const { EpAssert(index < count); return data[index]; }
+
+  T* EP_RESTRICT data;
+  unsigned count;
+};
+
+// Type of field I.
+template<unsigned I, class F, class... Fs>
+struct EpSoaField { typedef typename EpSoaField<I - 1u, Fs...>::type type; };
+
+template<class F, class... Fs>
+struct EpSoaField<0u, F, Fs...> { typedef F type; };
+
+// Bytes required for Count rows, excluding alignment of the block itself.
+template<unsigned Count, class... Fs>
+struct EpSoaBytes { enum { value = 0 }; };
+
+template<unsigned Count, class F, class... Fs>
+struct EpSoaBytes<Count, F, Fs...> {
+  enum { value = EpSoaAlign(sizeof(F) * Count) + EpSoaBytes<Count, Fs...>::value };
+};
+
+template<class... Fs>
+struct EpSoaIsTriviallyCopyable { enum { value = 1 }; };
+
+template<class F, class... Fs>
+struct EpSoaIsTriviallyCopyable<F, Fs...> {
+  enum { value = EpIsTriviallyCopyable<F>::value && EpSoaIsTriviallyCopyable<Fs...>::value };
+};
+
+template<unsigned MaxDim, class... Fields>
+class EpSoaArray {
+public:
+  static_assert(sizeof...(Fields) > 0u, "EpSoaArray requires fields");
+  static_assert(EpSoaIsTriviallyCopyable<Fields...>::value, "EpSoaArray fields must be trivially copyable");
+
+  enum { FIELD_COUNT = sizeof...(Fields) };
+
+  // Allocates a byte block with room to align the first column.
+  typedef EpAllocator<char, (MaxDim == EpAllocatorMode_Dynamic) ? EpAllocatorMode_Dynamic
+    : (unsigned)(EpSoaBytes<MaxDim, Fields...>::value + EP_SOA_ALIGNMENT - 1u)> allocator_type;
+
+  EP_FORCEINLINE EpSoaArray() {
+    m_size = 0u;
+    m_capacity = 0u;
+    if (MaxDim != EpAllocatorMode_Dynamic) {
+      Layout(MaxDim);
+    }
+  }
+
+  EP_FORCEINLINE unsigned size() const { return m_size; }
+  EP_FORCEINLINE unsigned capacity() const { return m_capacity; }
+  EP_FORCEINLINE bool empty() const { return m_size == 0u; }
+  EP_FORCEINLINE bool full() const { return m_size == m_capacity; }
+  EP_FORCEINLINE void clear() { m_size = 0u; }
+
+  // Only allocates once when dynamic.
+  EP_FORCEINLINE void reserve(unsigned c) {
+    if (c <= m_capacity) {
+      return;
+    }
+    EpReleaseAssertMsg(MaxDim == EpAllocatorMode_Dynamic, "EpSoaArray: Overflowing fixed capacity.");
+    Layout(c);
+  }
+
+  // New rows are uninitialized.
+  EP_FORCEINLINE void resize(unsigned sz) {
+    reserve(sz);
+    m_size = sz;
+  }
+
+  EP_FORCEINLINE void push_back(const Fields&... values) {
+    EpAssert(m_size < m_capacity);
+    Set<0u>(m_size++, values...);
+  }
+
+  EP_FORCEINLINE void pop_back() {
+    EpAssert(m_size);
+    --m_size;
+  }
+
+  // Moves the end row down as needed.
+  EP_FORCEINLINE void erase_unordered(unsigned index) {
+    EpAssert(index < m_size);
+    if (index != --m_size) {
+      const size_t sizes[] = { sizeof(Fields)... };
+      for (unsigned i = 0u; i < (unsigned)FIELD_COUNT; ++i) {
+        char* column = (char*)m_columns[i];
+        ::memcpy(column + sizes[i] * index, column + sizes[i] * m_size, sizes[i]);
+      }
+    }
+  }
+
+  template<unsigned I>
+  EP_FORCEINLINE typename EpSoaField<I, Fields...>::type* column() const {
+    static_assert(I < sizeof...(Fields), "EpSoaArray field index");
+    return (typename EpSoaField<I, Fields...>::type*)m_columns[I];
+  }
+
+  template<unsigned I>
+  EP_FORCEINLINE EpSoaSpan<typename EpSoaField<I, Fields...>::type> span() const {
+    return EpSoaSpan<typename EpSoaField<I, Fields...>::type>(column<I>(), m_size);
+  }
+
+  template<unsigned I>
+  EP_FORCEINLINE typename EpSoaField<I, Fields...>::type& at(unsigned index) const {
+    EpAssert(index < m_size);
+    return column<I>()[index];
+  }
+
+  EP_FORCEINLINE const allocator_type& get_allocator() const { return m_allocator; }
+
+private:
+  // Columns point into m_allocator, which may be inline.
+  EpSoaArray(const EpSoaArray&);
+  void operator=(const EpSoaArray&);
+
+  EP_FORCEINLINE void Layout(unsigned c) {
+    const size_t sizes[] = { sizeof(Fields)... };
+    size_t bytes = EP_SOA_ALIGNMENT - 1u;
+    for (unsigned i = 0u; i < (unsigned)FIELD_COUNT; ++i) {
+      bytes += EpSoaAlign(sizes[i] * c);
+    }
+    EpReleaseAssertMsg(bytes == (unsigned)bytes, "EpSoaArray: Capacity overflow.");
+    m_allocator.Reserve((unsigned)bytes);
+
+    char* it = (char*)EpSoaAlign((uintptr_t)m_allocator.GetStorage());
+    for (unsigned i = 0u; i < (unsigned)FIELD_COUNT; ++i) {
+      m_columns[i] = it;
+      it += EpSoaAlign(sizes[i] * c);
+    }
+    m_capacity = c;
+  }
+
+  template<unsigned I>
+  EP_FORCEINLINE void Set(unsigned) { }
+
+  template<unsigned I, class F, class... Fs>
+  EP_FORCEINLINE void Set(unsigned index, const F& value, const Fs&... values) {
+    ((F*)m_columns[I])[index] = value;
+    Set<I + 1u>(index, values...);
+  }
+
+  allocator_type m_allocator;
+  void* m_columns[FIELD_COUNT];
+  unsigned m_size;
+  unsigned m_capacity;
+};
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
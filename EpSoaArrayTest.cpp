@@ -0,0 +1,88 @@
+#include "EmbeddedPlatform.h"
+#include "EpSoaArray.h"
+#include "EpTest.h"
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+
+class EpSoaArrayTest :
+  public testing::Test
+{
+public:
+  enum { X, Y, ID };
+  typedef EpSoaArray<EpAllocatorMode_Dynamic, float, float, int32_t> DynamicParticles;
+  typedef EpSoaArray<10u, float, float, int32_t> FixedParticles;
+
+  template<class Particles>
+  static void Fill(Particles& particles, unsigned count) {
+    for (unsigned i = 0u; i < count; ++i) {
+      particles.push_back((float)i, (float)i * 2.0f, (int32_t)i);
+    }
+  }
+
+  template<class Particles>
+  static bool IsAligned(const Particles& particles) {
+    return ((uintptr_t)particles.template column<X>() & (EP_SOA_ALIGNMENT - 1u)) == 0u
+      && ((uintptr_t)particles.template column<Y>() & (EP_SOA_ALIGNMENT - 1u)) == 0u
+      && ((uintptr_t)particles.template column<ID>() & (EP_SOA_ALIGNMENT - 1u)) == 0u;
+  }
+};
+
+TEST_F(EpSoaArrayTest, Columns) {
+  DynamicParticles dynamic;
+  ASSERT_EQ(dynamic.capacity(), 0u);
+  dynamic.reserve(7u);
+  FixedParticles fixed;
+
+  ASSERT_EQ(dynamic.capacity(), 7u);
+  ASSERT_EQ(fixed.capacity(), 10u);
+  ASSERT_TRUE(IsAligned(dynamic));
+  ASSERT_TRUE(IsAligned(fixed));
+
+  Fill(dynamic, 7u);
+  Fill(fixed, 10u);
+  ASSERT_TRUE(dynamic.full());
+  ASSERT_TRUE(fixed.full());
+
+  // Columns are contiguous and do not overlap.
+  ASSERT_TRUE(((char*)dynamic.column<Y>() >= (char*)(dynamic.column<X>() + 7)));
+  ASSERT_TRUE(((char*)fixed.column<ID>() >= (char*)(fixed.column<Y>() + 10)));
+
+  ASSERT_EQ(dynamic.at<X>(6u), 6.0f);
+  ASSERT_EQ(dynamic.at<Y>(6u), 12.0f);
+  ASSERT_EQ(fixed.at<ID>(9u), 9);
+
+  // Field-wise kernel over one column.
+  EpSoaSpan<float> ys = fixed.span<Y>();
+  ASSERT_EQ(ys.size(), 10u);
+  float sum = 0.0f;
+  for (float* it = ys.begin(); it != ys.end(); ++it) {
+    sum += *it;
+  }
+  ASSERT_EQ(sum, 90.0f);
+}
+
+TEST_F(EpSoaArrayTest, Modification) {
+  FixedParticles particles;
+  Fill(particles, 5u);
+
+  particles.erase_unordered(1u);
+  ASSERT_EQ(particles.size(), 4u);
+  ASSERT_EQ(particles.at<X>(1u), 4.0f);
+  ASSERT_EQ(particles.at<Y>(1u), 8.0f);
+  ASSERT_EQ(particles.at<ID>(1u), 4);
+
+  particles.erase_unordered(3u);
+  particles.pop_back();
+  ASSERT_EQ(particles.size(), 2u);
+  ASSERT_EQ(particles.at<ID>(0u), 0);
+  ASSERT_EQ(particles.at<ID>(1u), 4);
+
+  particles.resize(6u);
+  particles.at<ID>(5u) = 55;
+  ASSERT_EQ(particles.span<ID>()[5u], 55);
+
+  particles.clear();
+  ASSERT_TRUE(particles.empty());
+}
+
+#endif // !EP_BUILD_SOME_EMBEDDED_COMPILER
@@ -0,0 +1,159 @@
+#include "EpTask.h"
+
+// Each coroutine frame starts with a header holding its scheduler.
+#define EP_TASK_FRAME_HEADER EP_TASK_FRAME_ALIGNMENT
+
+EpTaskScheduler::EpTaskScheduler() {
+  m_waitCount = 0u;
+#if (EP_TASK_COROUTINES==1)
+  m_frames = 0;
+  m_freeFrames = 0;
+  m_frameBytes = 0u;
+  m_memoryAllocatorId = EpMemoryAllocatorId_UNSPECIFIED;
+  m_frameCount = 0u;
+  m_freeFrameCount = 0u;
+#endif
+}
+
+EpTaskScheduler::~EpTaskScheduler() {
+  ShutDown();
+}
+
+void EpTaskScheduler::Init(unsigned frameCount, size_t frameBytes, int memoryAllocatorId) {
+#if (EP_TASK_COROUTINES==1)
+  EpReleaseAssertMsg(m_frames == 0 && frameCount != 0u, "EpTaskScheduler: Bad Init");
+  m_frameBytes = (frameBytes + EP_TASK_FRAME_HEADER + EP_TASK_FRAME_ALIGNMENT - 1u) & ~(size_t)(EP_TASK_FRAME_ALIGNMENT - 1u);
+  m_frames = EpMallocExtended(frameCount * m_frameBytes, EP_TASK_FRAME_ALIGNMENT - 1u, memoryAllocatorId);
+  m_memoryAllocatorId = memoryAllocatorId;
+  m_freeFrames = 0;
+  for (unsigned i = frameCount; i-- != 0u;) {
+    void** frame = (void**)((char*)m_frames + i * m_frameBytes);
+    *frame = m_freeFrames;
+    m_freeFrames = frame;
+  }
+  m_frameCount = frameCount;
+  m_freeFrameCount = frameCount;
+#else
+  (void)frameCount; (void)frameBytes; (void)memoryAllocatorId;
+#endif
+}
+
+void EpTaskScheduler::ShutDown() {
+  EpReleaseAssertMsg(m_tasks.empty(), "EpTaskScheduler: ShutDown with %u tasks", m_tasks.size());
+#if (EP_TASK_COROUTINES==1)
+  if (m_frames) {
+    EpReleaseAssertMsg(m_freeFrameCount == m_frameCount, "EpTaskScheduler: ShutDown with frames in use");
+    if (m_memoryAllocatorId == EpMemoryAllocatorId_UNSPECIFIED) {
+      EpFree(m_frames); // Searches for the allocator that was current.
+    } else {
+      EpFreeExtended(m_frames, m_memoryAllocatorId);
+    }
+    m_frames = 0;
+    m_freeFrames = 0;
+    m_frameCount = 0u;
+    m_freeFrameCount = 0u;
+  }
+#endif
+}
+
+void EpTaskScheduler::Spawn(EpTaskMachine& machine) {
+  EpReleaseAssertMsg(!m_tasks.full(), "EpTaskScheduler: Too many tasks");
+  Task task;
+  task.machine = &machine;
+  task.barrier = 0;
+  task.waitOrder = 0u;
+  m_tasks.push_back(task);
+}
+
+void EpTaskScheduler::Run() {
+  while (!m_tasks.empty()) {
+    bool isAnyReady = false;
+    for (unsigned i = 0u; i < m_tasks.size();) {
+      Task& task = m_tasks[i];
+      if (task.barrier) {
+        ++i;
+        continue;
+      }
+      isAnyReady = true;
+      if (Resume(task)) {
+        m_tasks.erase_unordered(i);
+      } else {
+        EpAssertMsg(task.barrier, "EpTaskScheduler: Task suspended without a barrier");
+        task.waitOrder = m_waitCount++;
+        ++i;
+      }
+    }
+    if (isAnyReady) {
+      continue;
+    }
+
+    Task* oldest = m_tasks.begin();
+    for (Task* it = m_tasks.begin() + 1; it != m_tasks.end(); ++it) {
+      if ((int)(it->waitOrder - oldest->waitOrder) < 0) {
+        oldest = it;
+      }
+    }
+    EpDmaAwaitBarrier(*oldest->barrier);
+    oldest->barrier = 0;
+  }
+}
+
+bool EpTaskScheduler::Resume(Task& task) {
+#if (EP_TASK_COROUTINES==1)
+  if (!task.machine) {
+    task.coroutine.resume();
+    if (task.coroutine.done()) {
+      task.coroutine.destroy();
+      return true;
+    }
+    EpTaskPromise& promise = task.coroutine.promise();
+    task.barrier = promise.m_barrier;
+    promise.m_barrier = 0;
+    return false;
+  }
+#endif
+  if (task.machine->Resume()) {
+    return true;
+  }
+  task.barrier = task.machine->m_awaiting;
+  task.machine->m_awaiting = 0;
+  return false;
+}
+
+// ----------------------------------------------------------------------------
+#if (EP_TASK_COROUTINES==1)
+
+void EpTaskScheduler::Spawn(EpTask&& task) {
+  EpReleaseAssertMsg(!m_tasks.full(), "EpTaskScheduler: Too many tasks");
+  Task entry;
+  entry.machine = 0;
+  entry.coroutine = task.m_coroutine;
+  entry.barrier = 0;
+  entry.waitOrder = 0u;
+  task.m_coroutine = nullptr;
+  m_tasks.push_back(entry);
+}
+
+void* EpTaskScheduler::AllocateFrame(size_t size) {
+  EpReleaseAssertMsg(size + EP_TASK_FRAME_HEADER <= m_frameBytes, "EpTask: %u byte frame exceeds arena slots", (unsigned)size);
+  EpReleaseAssertMsg(m_freeFrames != 0, "EpTask: Out of frames");
+  void** frame = (void**)m_freeFrames;
+  m_freeFrames = *frame;
+  --m_freeFrameCount;
+  *(EpTaskScheduler**)frame = this;
+  return (char*)frame + EP_TASK_FRAME_HEADER;
+}
+
+void EpTaskScheduler::FreeFrame(void* frame) {
+  void** header = (void**)((char*)frame - EP_TASK_FRAME_HEADER);
+  *header = m_freeFrames;
+  m_freeFrames = header;
+  ++m_freeFrameCount;
+}
+
+void EpTaskPromise::operator delete(void* frame, size_t) {
+  EpTaskScheduler* scheduler = *(EpTaskScheduler**)((char*)frame - EP_TASK_FRAME_HEADER);
+  scheduler->FreeFrame(frame);
+}
+
+#endif // EP_TASK_COROUTINES
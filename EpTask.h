@@ -0,0 +1,194 @@
+#pragma once
+
+#include "EmbeddedPlatform.h"
+#include "EpArray.h"
+#include "EpDma.h"
+
+// ----------------------------------------------------------------------------
+// EpTask
+//
+// Tasks that wait on DMA barriers without blocking the thread.  A task issues
+// its transfers, awaits a barrier and is resumed by EpTaskScheduler::Run()
+// once the barrier is reached, so many streaming tasks overlap their transfers
+// with each other's work.  Single threaded.
+//
+// With C++20 coroutines a task is a coroutine returning EpTask whose first
+// parameter is the scheduler:
+//
+//   EpTask Stream(EpTaskScheduler& scheduler, ...) {
+//     EpDmaStart(dst, src, bytes);
+//     EpDmaAddBarrier(barrier);
+//     co_await EpDmaAwaitable(barrier);
+//   }
+//
+// Coroutine frames come from the scheduler's frame arena, never the heap.
+// Elsewhere, including the embedded build, a task is an EpTaskMachine whose
+// Resume() is written with EP_TASK_BEGIN(), EP_TASK_AWAIT_DMA() and
+// EP_TASK_END().  Its locals do not survive an await, so keep state in
+// members.  Both kinds may be mixed on one scheduler.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER) && defined(__cpp_impl_coroutine)
+#define EP_TASK_COROUTINES 1
+#include <coroutine>
+#else
+#define EP_TASK_COROUTINES 0
+#endif
+
+#define EP_TASK_MAX_FRAMES 16
+#define EP_TASK_FRAME_BYTES 1024
+#define EP_TASK_FRAME_ALIGNMENT 16 // Coroutine frames need operator new alignment.
+
+class EpTaskScheduler;
+
+// ----------------------------------------------------------------------------
+// EpTaskMachine
+
+class EpTaskMachine {
+public:
+  EpTaskMachine() : m_resumePoint(0), m_awaiting(0) { }
+  virtual ~EpTaskMachine() { }
+
+  // Runs until the task awaits a barrier or finishes.  Returns true when done.
+  virtual bool Resume() = 0;
+
+protected:
+  friend class EpTaskScheduler;
+
+  int m_resumePoint; // Line of the last await.
+  EpDmaBarrier* m_awaiting; // Barrier awaited by the last Resume().
+};
+
+// A switch on m_resumePoint, so awaits may not appear inside another switch.
+#define EP_TASK_BEGIN() switch (m_resumePoint) { case 0:
+#define EP_TASK_AWAIT_DMA(barrier) do { m_awaiting = &(barrier); m_resumePoint = __LINE__; return false; case __LINE__:; } while (0)
+#define EP_TASK_END() } m_resumePoint = -1; return true
+
+// ----------------------------------------------------------------------------
+// EpTask
+
+#if (EP_TASK_COROUTINES==1)
+
+struct EpTaskPromise;
+
+class EpTask {
+public:
+  typedef EpTaskPromise promise_type;
+
+  EpTask(EpTask&& rhs) : m_coroutine(rhs.m_coroutine) { rhs.m_coroutine = nullptr; }
+  ~EpTask() {
+    if (m_coroutine) {
+      m_coroutine.destroy(); // Never spawned.
+    }
+  }
+
+private:
+  friend class EpTaskScheduler;
+  friend struct EpTaskPromise;
+  explicit EpTask(std::coroutine_handle<EpTaskPromise> coroutine) : m_coroutine(coroutine) { }
+  EpTask(const EpTask&);
+  void operator=(const EpTask&);
+
+  std::coroutine_handle<EpTaskPromise> m_coroutine;
+};
+
+struct EpTaskPromise {
+  EpTaskPromise() : m_barrier(0) { }
+
+  // The frame is allocated from the scheduler passed as the first argument.
+  template<class... Args>
+  static void* operator new(size_t size, EpTaskScheduler& scheduler, Args&...);
+  static void operator delete(void* frame, size_t size);
+
+  EpTask get_return_object() { return EpTask(std::coroutine_handle<EpTaskPromise>::from_promise(*this)); }
+  std::suspend_always initial_suspend() noexcept { return std::suspend_always(); } // Started by Run().
+  std::suspend_always final_suspend() noexcept { return std::suspend_always(); } // Destroyed by Run().
+  void return_void() { }
+  void unhandled_exception() { EpReleaseAssertMsg(false, "EpTask: unhandled exception"); }
+
+  EpDmaBarrier* m_barrier; // Awaited by the last resume.
+};
+
+// co_await EpDmaAwaitable(barrier) suspends the task until barrier is reached.
+class EpDmaAwaitable {
+public:
+  explicit EpDmaAwaitable(EpDmaBarrier& barrier) : m_barrier(&barrier) { }
+
+  bool await_ready() const { return false; }
+  void await_suspend(std::coroutine_handle<EpTaskPromise> coroutine) { coroutine.promise().m_barrier = m_barrier; }
+  void await_resume() const { }
+
+private:
+  EpDmaBarrier* m_barrier;
+};
+
+#endif // EP_TASK_COROUTINES
+
+// ----------------------------------------------------------------------------
+// EpTaskScheduler
+//
+// Run() resumes each ready task in turn.  When every task is waiting it
+// awaits the barrier that has been waited on longest and resumes its task.
+
+class EpTaskScheduler {
+public:
+  enum { MAX_TASKS = 32 };
+
+  EpTaskScheduler();
+  ~EpTaskScheduler();
+
+  // Allocates frameCount coroutine frames of up to frameBytes each with
+  // EpMallocExtended().  Coroutines must not be called before Init().
+  void Init(unsigned frameCount=EP_TASK_MAX_FRAMES, size_t frameBytes=EP_TASK_FRAME_BYTES, int memoryAllocatorId=-1);
+  void ShutDown(); // Expects no tasks or unspawned coroutines.
+
+  // machine must outlive the task.
+  void Spawn(EpTaskMachine& machine);
+#if (EP_TASK_COROUTINES==1)
+  void Spawn(EpTask&& task);
+#endif
+
+  // Runs until every task has finished.
+  void Run();
+
+  unsigned GetTaskCount() const { return m_tasks.size(); }
+#if (EP_TASK_COROUTINES==1)
+  unsigned GetFreeFrameCount() const { return m_freeFrameCount; }
+
+  // Used by EpTaskPromise.
+  void* AllocateFrame(size_t size);
+  void FreeFrame(void* frame);
+#endif
+
+private:
+  EpTaskScheduler(const EpTaskScheduler&);
+  void operator=(const EpTaskScheduler&);
+
+  struct Task {
+    EpTaskMachine* machine; // Null for a coroutine.
+#if (EP_TASK_COROUTINES==1)
+    std::coroutine_handle<EpTaskPromise> coroutine;
+#endif
+    EpDmaBarrier* barrier; // Null when ready.
+    unsigned waitOrder;
+  };
+
+  bool Resume(Task& task);
+
+  EpArray<Task, MAX_TASKS> m_tasks;
+  unsigned m_waitCount; // Waits started, for ordering them.
+#if (EP_TASK_COROUTINES==1)
+  void* m_frames;
+  void* m_freeFrames; // Each free frame points to the next.
+  size_t m_frameBytes;
+  int m_memoryAllocatorId; // As passed to Init().
+  unsigned m_frameCount;
+  unsigned m_freeFrameCount;
+#endif
+};
+
+#if (EP_TASK_COROUTINES==1)
+template<class... Args>
+void* EpTaskPromise::operator new(size_t size, EpTaskScheduler& scheduler, Args&...) {
+  return scheduler.AllocateFrame(size);
+}
+#endif
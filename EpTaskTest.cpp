@@ -0,0 +1,146 @@
+#include "EmbeddedPlatform.h"
+#include "EpTask.h"
+#include "EpAllocatorScope.h"
+#include "EpTest.h"
+
+#include <string.h>
+
+// Each task streams its own source through a small buffer and sums it.  The
+// trace records the order in which chunks are summed.
+
+enum { TASK_COUNT = 3, CHUNK_COUNT = 4, CHUNK_SIZE = 64, TRACE_SIZE = TASK_COUNT * CHUNK_COUNT };
+
+static unsigned s_epTaskTestSources[TASK_COUNT][CHUNK_COUNT * CHUNK_SIZE];
+static unsigned s_epTaskTestTrace[TRACE_SIZE];
+static unsigned s_epTaskTestTraceSize;
+
+class EpTaskTest :
+  public testing::Test
+{
+public:
+  EpTaskTest() {
+    for (unsigned i = 0u; i < (unsigned)TASK_COUNT; ++i) {
+      for (unsigned j = 0u; j < (unsigned)(CHUNK_COUNT * CHUNK_SIZE); ++j) {
+        s_epTaskTestSources[i][j] = i * 1000u + j;
+      }
+    }
+    s_epTaskTestTraceSize = 0u;
+  }
+
+  static unsigned ExpectedSum(unsigned task) {
+    unsigned sum = 0u;
+    for (unsigned j = 0u; j < (unsigned)(CHUNK_COUNT * CHUNK_SIZE); ++j) {
+      sum += s_epTaskTestSources[task][j];
+    }
+    return sum;
+  }
+
+  static void Trace(unsigned task) {
+    EpAssert(s_epTaskTestTraceSize < (unsigned)TRACE_SIZE);
+    s_epTaskTestTrace[s_epTaskTestTraceSize++] = task;
+  }
+
+  // The first chunk of every task is summed before any task sums its second.
+  static bool IsInterleaved() {
+    for (unsigned i = 0u; i < (unsigned)TASK_COUNT; ++i) {
+      for (unsigned j = 0u; j < i; ++j) {
+        if (s_epTaskTestTrace[i] == s_epTaskTestTrace[j]) {
+          return false;
+        }
+      }
+    }
+    return s_epTaskTestTraceSize == (unsigned)TRACE_SIZE;
+  }
+};
+
+class EpTaskTestStream : public EpTaskMachine {
+public:
+  EpTaskTestStream(unsigned task) : m_task(task), m_sum(0u) { }
+
+  virtual bool Resume() {
+    EP_TASK_BEGIN();
+    for (m_chunk = 0u; m_chunk < (unsigned)CHUNK_COUNT; ++m_chunk) {
+      EpDmaStart(m_buffer, s_epTaskTestSources[m_task] + m_chunk * CHUNK_SIZE, sizeof m_buffer);
+      EpDmaAddBarrier(m_barrier);
+      EP_TASK_AWAIT_DMA(m_barrier);
+      for (unsigned i = 0u; i < (unsigned)CHUNK_SIZE; ++i) {
+        m_sum += m_buffer[i];
+      }
+      EpTaskTest::Trace(m_task);
+    }
+    EP_TASK_END();
+  }
+
+  unsigned m_task;
+  unsigned m_sum;
+  unsigned m_chunk;
+  unsigned m_buffer[CHUNK_SIZE];
+  EpDmaBarrier m_barrier;
+};
+
+TEST_F(EpTaskTest, Machine) {
+  EpTaskScheduler scheduler;
+  scheduler.Init();
+  EpTaskTestStream stream0(0u), stream1(1u), stream2(2u);
+  scheduler.Spawn(stream0);
+  scheduler.Spawn(stream1);
+  scheduler.Spawn(stream2);
+  ASSERT_EQ(scheduler.GetTaskCount(), 3u);
+  scheduler.Run();
+  scheduler.ShutDown();
+
+  ASSERT_EQ(scheduler.GetTaskCount(), 0u);
+  ASSERT_EQ(stream0.m_sum, ExpectedSum(0u));
+  ASSERT_EQ(stream1.m_sum, ExpectedSum(1u));
+  ASSERT_EQ(stream2.m_sum, ExpectedSum(2u));
+  ASSERT_TRUE(IsInterleaved());
+}
+
+// ----------------------------------------------------------------------------
+#if (EP_TASK_COROUTINES==1)
+
+// The scheduler is only used by EpTaskPromise::operator new.
+static EpTask EpTaskTestStreamTask(EpTaskScheduler&, unsigned task, unsigned& sum) {
+  unsigned buffer[CHUNK_SIZE];
+  EpDmaBarrier barrier;
+  for (unsigned chunk = 0u; chunk < (unsigned)CHUNK_COUNT; ++chunk) {
+    EpDmaStart(buffer, s_epTaskTestSources[task] + chunk * CHUNK_SIZE, sizeof buffer);
+    EpDmaAddBarrier(barrier);
+    co_await EpDmaAwaitable(barrier);
+    for (unsigned i = 0u; i < (unsigned)CHUNK_SIZE; ++i) {
+      sum += buffer[i];
+    }
+    EpTaskTest::Trace(task);
+  }
+}
+
+TEST_F(EpTaskTest, Coroutine) {
+  EpTaskScheduler scheduler;
+  scheduler.Init(4u, EP_TASK_FRAME_BYTES, EpMemoryAllocatorId_Heap);
+  unsigned sums[TASK_COUNT] = { 0u };
+  {
+    EpExpectNoAllocations();
+    scheduler.Spawn(EpTaskTestStreamTask(scheduler, 0u, sums[0]));
+    scheduler.Spawn(EpTaskTestStreamTask(scheduler, 1u, sums[1]));
+    EpTaskTestStream stream2(2u); // Mixed with a machine.
+    scheduler.Spawn(stream2);
+    ASSERT_EQ(scheduler.GetFreeFrameCount(), 2u);
+    scheduler.Run();
+    sums[2] = stream2.m_sum;
+  }
+  ASSERT_EQ(scheduler.GetFreeFrameCount(), 4u);
+  for (unsigned i = 0u; i < (unsigned)TASK_COUNT; ++i) {
+    ASSERT_EQ(sums[i], ExpectedSum(i));
+  }
+  ASSERT_TRUE(IsInterleaved());
+
+  // A task that is never spawned returns its frame.
+  {
+    EpTask unused = EpTaskTestStreamTask(scheduler, 0u, sums[0]);
+    ASSERT_EQ(scheduler.GetFreeFrameCount(), 3u);
+  }
+  ASSERT_EQ(scheduler.GetFreeFrameCount(), 4u);
+  scheduler.ShutDown();
+}
+
+#endif // EP_TASK_COROUTINES
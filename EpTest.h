@@ -1,9 +1,27 @@
 #pragma once
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "EpAllocatorScope.h"
 #include "EpProfiler.h"
 
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+#include <chrono>
+#endif
+
+// Parallel test execution forks worker processes.
+#if defined(EP_BUILD_SOFTWARE) && (defined(__unix__) || defined(__APPLE__))
+#define EP_TEST_FORK 1
+#include <atomic>
+#include <new>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#define EP_TEST_FORK 0
+#endif
+
 // Enable this to use GoogleTest
 #if 0 //def EP_BUILD_SOFTWARE
 #include <gtest/gtest.h>
@@ -16,6 +34,88 @@ class Test {
 };
 } // namespace testing
 
+// ----------------------------------------------------------------------------
+// EpBenchmarkState
+//
+// Passed to BENCHMARK_F bodies, which must loop on KeepRunning().  Only the
+// loop is timed and only its allocations are counted.
+
+#ifndef EP_BENCHMARK_MIN_NANOSECONDS
+#define EP_BENCHMARK_MIN_NANOSECONDS 20000000u // Per sample.
+#endif
+
+#define EP_BENCHMARK_SAMPLES 5
+#define EP_BENCHMARK_NAME_SIZE 64
+
+inline uint64_t EpBenchmarkNanoseconds() {
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+  return (uint64_t)EpProfilerSample() * 1000u / EP_CYCLES_PER_MICROSECOND;
+#endif
+}
+
+// Keeps the compiler from discarding a result that is otherwise unused.
+template<class T> inline void EpBenchmarkDoNotOptimize(const T& t) {
+#if defined(__GNUC__) || defined(__clang__)
+  __asm__ __volatile__("" : : "r,m"(t) : "memory");
+#else
+  static const volatile void* s_sink;
+  s_sink = &t;
+#endif
+}
+
+class EpBenchmarkState {
+public:
+  EpBenchmarkState(unsigned iterations, const EpAllocatorScope& scope) : m_scope(scope) {
+    m_iterations = m_remaining = iterations;
+    m_bytesPerIteration = 0u;
+    m_begin = m_end = 0u;
+    m_allocationsBegin = m_allocationsEnd = 0u;
+    m_isDone = false;
+  }
+
+  bool KeepRunning() {
+    if (m_remaining == m_iterations) {
+      m_allocationsBegin = m_scope.GetScopeAllocationsMade();
+      m_begin = EpBenchmarkNanoseconds();
+    }
+    if (m_remaining != 0u) {
+      --m_remaining;
+      return true;
+    }
+    m_end = EpBenchmarkNanoseconds();
+    m_allocationsEnd = m_scope.GetScopeAllocationsMade();
+    m_isDone = true;
+    return false;
+  }
+
+  unsigned iterations() const { return m_iterations; }
+
+  // Reported as bytes per second.
+  void SetBytesPerIteration(uint64_t bytes) { m_bytesPerIteration = bytes; }
+
+  uint64_t GetBytesPerIteration() const { return m_bytesPerIteration; }
+  uint64_t GetNanoseconds() const { return m_end - m_begin; }
+  uint64_t GetAllocationsMade() const { return m_allocationsEnd - m_allocationsBegin; }
+  bool IsDone() const { return m_isDone; }
+
+private:
+  EpBenchmarkState(const EpBenchmarkState&);
+  void operator=(const EpBenchmarkState&);
+
+  const EpAllocatorScope& m_scope;
+  unsigned m_iterations;
+  unsigned m_remaining;
+  uint64_t m_bytesPerIteration;
+  uint64_t m_begin;
+  uint64_t m_end;
+  uintptr_t m_allocationsBegin;
+  uintptr_t m_allocationsEnd;
+  bool m_isDone;
+};
+
 // ----------------------------------------------------------------------------
 struct EpTestRunner {
 public:
@@ -23,7 +123,8 @@ public:
     TEST_NOTHING_ASSERTED,
     TEST_PASS,
     TEST_FAIL,
-    MAX_TESTS = 256
+    MAX_BASELINE_RESULTS = 256,
+    MAX_WORKERS = 64
   };
 
   struct FactoryBase {
@@ -32,25 +133,107 @@ public:
     virtual const char* EpTest_FunctionName(void) = 0;
     virtual const char* EpTest_File(void) = 0;
     virtual int EpTest_Line(void) = 0;
+
+    FactoryBase* mNextFactory; // Registration order.
+    bool mIsSelected;
+  };
+
+  struct BenchmarkBase {
+    virtual void EpBenchmark_Execute(EpBenchmarkState& state) = 0;
+  };
+
+  struct BenchmarkResult {
+    char name[EP_BENCHMARK_NAME_SIZE];
+    double median; // ns/op
+    double mad;
   };
 
   // Ensure this constructor runs before tests are registered by other global constructors.
   static EpTestRunner& Singleton();
 
   void Construct() {
-    mNumFactories = 0;
+    mFirstFactory = mLastFactory = NULL;
     mCurrentTest = 0;
-    mFilterClassName = NULL;
+    mFilter = NULL;
+    mShardIndex = 0;
+    mShardCount = 0;
+    mBenchmarkMinNanoseconds = EP_BENCHMARK_MIN_NANOSECONDS;
+    mBenchmarkTolerance = 0.1;
+    mBenchmarkBaselinePath = NULL;
+    mBenchmarkOutputPath = NULL;
+    mBenchmarkOutput = NULL;
+    mBaselineCount = 0;
+    mWorkerCount = -1;
+    mTestTracker = NULL;
+  }
+
+  // Runs the tests where Class.Function or Class matches a glob pattern.  '*'
+  // matches any characters and '?' one.  Patterns are separated by ':' and
+  // those after a '-' exclude tests, e.g. "EpArrayTest:EpHashMapTest.*-*Benchmark".
+  void SetFilterStaticString(const char* filter) { mFilter = filter; }
+
+  // Runs every count'th selected test starting from index.
+  void SetShard(int index, int count) {
+    EpReleaseAssertMsg(index >= 0 && index < count, "EpTestRunner: Bad shard %d of %d", index, count);
+    mShardIndex = index;
+    mShardCount = count;
+  }
+
+  // Reads --filter=, --shard-index=, --shard-count= and --workers=.  Settings
+  // not on the command line or set otherwise are read from EP_TEST_FILTER,
+  // EP_TEST_SHARD_INDEX, EP_TEST_SHARD_COUNT and EP_TEST_WORKERS.  Host builds
+  // call this from main().
+  void ParseCommandLine(int argc, char** argv) {
+    int shardIndex = mShardIndex;
+    int shardCount = mShardCount;
+    for (int i = 1; i < argc; ++i) {
+      const char* value;
+      if ((value = ArgumentValue(argv[i], "--filter="))) {
+        mFilter = value;
+      } else if ((value = ArgumentValue(argv[i], "--shard-index="))) {
+        shardIndex = ::atoi(value);
+      } else if ((value = ArgumentValue(argv[i], "--shard-count="))) {
+        shardCount = ::atoi(value);
+      } else if ((value = ArgumentValue(argv[i], "--workers="))) {
+        mWorkerCount = ::atoi(value);
+      }
+    }
+    if (shardCount > 0) {
+      SetShard(shardIndex, shardCount);
+    }
   }
 
-  void SetFilterStaticString(const char* className) { mFilterClassName = className; }
-  void AddTest(const char* className, FactoryBase* fn) {
-    if(mNumFactories < MAX_TESTS) {
-      mFactories[mNumFactories++] = fn;
+  // Runs tests in this many forked worker processes, each with its own memory
+  // manager and profiler state.  0 is one per core.  Logs and results are
+  // reported in registration order.  Ignored where fork() is unavailable.
+  void SetWorkerCount(int count) { mWorkerCount = count; }
+
+  // Each of the EP_BENCHMARK_SAMPLES samples of a benchmark runs for at least
+  // this long.
+  void SetBenchmarkMinNanoseconds(uint64_t ns) { mBenchmarkMinNanoseconds = ns; }
+
+  // A benchmark regresses when its median exceeds the baseline by this
+  // fraction and by 3 MADs.  Regressions are logged and do not fail.
+  void SetBenchmarkTolerance(double fraction) { mBenchmarkTolerance = fraction; }
+
+  // Results are compared against baselinePath and written to outputPath in the
+  // same format.  Either may be NULL.
+  void SetBenchmarkFilesStaticString(const char* baselinePath, const char* outputPath) {
+    mBenchmarkBaselinePath = baselinePath;
+    mBenchmarkOutputPath = outputPath;
+  }
+
+  void AddTest(const char*, FactoryBase* fn) {
+    fn->mNextFactory = NULL;
+    if (mLastFactory) {
+      mLastFactory->mNextFactory = fn;
+    } else {
+      mFirstFactory = fn;
     }
+    mLastFactory = fn;
   }
 
-  void Assert(const char* file, int line, bool condition, const char* format, ... ) {
+  EP_PRINTF_FORMAT(5, 6) void Assert(const char* file, int line, bool condition, const char* format, ... ) {
     mTestState = (condition && mTestState != TEST_FAIL) ? TEST_PASS : TEST_FAIL;
     if (!condition) {
       EpLog("ASSERT FAIL: %s.%s\n", mCurrentTest->EpTest_ClassName(), mCurrentTest->EpTest_FunctionName());
@@ -63,39 +246,46 @@ public:
     }
   }
 
+  // Checks the allocations made since the current test started.
+  void AssertAllocationsLE(const char* file, int line, uintptr_t maxCount, uintptr_t maxBytes) {
+    EpReleaseAssertMsg(mTestTracker, "ASSERT_ALLOCATIONS_LE outside of a test");
+    uintptr_t count = mTestTracker->GetAllocationCount();
+    uintptr_t bytes = mTestTracker->GetBytesAllocated();
+    bool condition = count <= maxCount && bytes <= maxBytes;
+    Assert(file, line, condition, "allocations %d <= %d, bytes %d <= %d",
+      (int)count, (int)maxCount, (int)bytes, (int)maxBytes);
+    if (!condition) {
+      mTestTracker->LogCallSites();
+    }
+  }
+
   void ExecuteAllTests() {
     EpReleaseWarning(EP_DEBUG, "Running tests with EP_DEBUG off");
     EpProfilerInit();
 
     mPassCount = mFailCount = 0;
-    EpLog("EpTestRunner: %s...\n", (mFilterClassName ? mFilterClassName : "All"));
+    mBenchmarkRegressionCount = 0;
+    OpenBenchmarkFiles();
+    ReadEnvironment();
+    int selectedCount = SelectTests();
+    EpLog("EpTestRunner: %s...\n", (mFilter ? mFilter : "All"));
+    if (mShardCount > 1) {
+      EpLog("EpTestRunner: Shard %d of %d\n", mShardIndex, mShardCount);
+    }
     EpLog("--------\n");
-    for (FactoryBase** it = mFactories; it != (mFactories+mNumFactories); ++it) {
-      if (mFilterClassName == NULL || ::strcmp(mFilterClassName, (*it)->EpTest_ClassName()) == 0) {
-        EpLog("%s.%s...\n", (*it)->EpTest_ClassName(), (*it)->EpTest_FunctionName());
-
-        mTestState = TEST_NOTHING_ASSERTED;
-        mCurrentTest = *it;
-
-        {
-          // Tests should have no side effects.  Therefore all allocations should be safe to reset.
-          EpProfileScope((*it)->EpTest_FunctionName());
-          EpAllocatorScope testTempScope(EpMemoryAllocatorId_TemporaryStack);
-          (*it)->EpTest_ConstructAndExecute();
-        }
-
-        if (mTestState == TEST_NOTHING_ASSERTED) {
-          Assert((*it)->EpTest_File(), (*it)->EpTest_Line(), false, "Nothing was asserted!");
-        }
-        if (mTestState == TEST_PASS) {
-          ++mPassCount;
-        } else {
-          ++mFailCount;
-        }
-
-        EpProfilerLog();
+    int workerCount = 1;
+#if (EP_TEST_FORK==1)
+    workerCount = mWorkerCount ? mWorkerCount : (int)::sysconf(_SC_NPROCESSORS_ONLN);
+    if (workerCount > 1) {
+      ExecuteTestsInWorkers(selectedCount, EpMin(workerCount, (int)MAX_WORKERS));
+    }
+#endif
+    (void)selectedCount;
+    for (FactoryBase* it = mFirstFactory; workerCount <= 1 && it; it = it->mNextFactory) {
+      if (it->mIsSelected) {
+        RecordResult(ExecuteTest(it));
       } else {
-        EpLog("Skipping %s.%s..\n", (*it)->EpTest_ClassName(), (*it)->EpTest_FunctionName());
+        EpLog("Skipping %s.%s..\n", it->EpTest_ClassName(), it->EpTest_FunctionName());
       }
     }
     EpLog("--------\n");
@@ -104,17 +294,443 @@ public:
     } else {
       EpLog("EpTestRunner TESTS FAILED: %d tests FAILED out of %d.\n", mFailCount, mFailCount+mPassCount);
     }
+    if (mBenchmarkRegressionCount > 0) {
+      EpLog("EpTestRunner: %d benchmarks REGRESSED.\n", mBenchmarkRegressionCount);
+    }
+    if (mBenchmarkOutput) {
+      ::fclose(mBenchmarkOutput);
+      mBenchmarkOutput = NULL;
+    }
     EpProfilerShutdown(); // Logs cycle count for comparison with timing in kernel logs.
   }
 
+  // Calibrates the iteration count on the first batches, then logs the median
+  // and median absolute deviation of EP_BENCHMARK_SAMPLES batches.
+  void RunBenchmark(BenchmarkBase& body, const char* name) {
+    unsigned iterations = 1u;
+    uint64_t ns = RunBenchmarkBatch(body, iterations, NULL, NULL);
+    while (ns < mBenchmarkMinNanoseconds && iterations < MAX_BENCHMARK_ITERATIONS) {
+      uint64_t scale = ns ? mBenchmarkMinNanoseconds * 6u / (ns * 5u) + 1u : 10u; // Overshoot by 20%
+      scale = EpClamp(scale, (uint64_t)2u, (uint64_t)10u);
+      iterations = (unsigned)EpMin((uint64_t)iterations * scale, (uint64_t)MAX_BENCHMARK_ITERATIONS);
+      ns = RunBenchmarkBatch(body, iterations, NULL, NULL);
+    }
+
+    double samples[EP_BENCHMARK_SAMPLES];
+    uint64_t allocations = 0u;
+    uint64_t bytesPerIteration = 0u;
+    for (int i = 0; i < EP_BENCHMARK_SAMPLES; ++i) {
+      samples[i] = (double)RunBenchmarkBatch(body, iterations, &allocations, &bytesPerIteration) / (double)iterations;
+    }
+    double median = Median(samples, EP_BENCHMARK_SAMPLES);
+    for (int i = 0; i < EP_BENCHMARK_SAMPLES; ++i) {
+      samples[i] = EpAbs(samples[i] - median);
+    }
+    double mad = Median(samples, EP_BENCHMARK_SAMPLES);
+
+    EpLog("EpBenchmark %s: %.2f ns/op, MAD %.2f, %u iterations, %.2f allocations/op", name, median, mad, iterations,
+      (double)allocations / ((double)iterations * EP_BENCHMARK_SAMPLES));
+    if (bytesPerIteration != 0u && median > 0.0) {
+      EpLog(", %.1f MB/s", (double)bytesPerIteration * 1000.0 / median);
+    }
+    const BenchmarkResult* baseline = FindBaseline(name);
+    if (baseline) {
+      EpLog(", baseline %.2f (%+.1f%%)", baseline->median, (median / baseline->median - 1.0) * 100.0);
+    }
+    EpLog("\n");
+
+    mHasBenchmarkResult = true;
+    ::strncpy(mBenchmarkResult.name, name, EP_BENCHMARK_NAME_SIZE - 1);
+    mBenchmarkResult.name[EP_BENCHMARK_NAME_SIZE - 1] = '\0';
+    mBenchmarkResult.median = median;
+    mBenchmarkResult.mad = mad;
+    mIsBenchmarkRegression = baseline && median > baseline->median * (1.0 + mBenchmarkTolerance)
+      && median - baseline->median > 3.0 * mad;
+    if (mIsBenchmarkRegression) {
+      EpLog("EpBenchmark REGRESSION: %s\n", name);
+    }
+    if (mTestState == TEST_NOTHING_ASSERTED) {
+      mTestState = TEST_PASS; // Completing is passing.
+    }
+  }
+
 private:
-  FactoryBase* mFactories[MAX_TESTS];
-  int mNumFactories;
+  enum { MAX_BENCHMARK_ITERATIONS = 1 << 30 };
+
+  static const char* ArgumentValue(const char* argument, const char* prefix) {
+    size_t length = ::strlen(prefix);
+    return ::strncmp(argument, prefix, length) == 0 ? argument + length : NULL;
+  }
+
+  void ReadEnvironment() {
+#if defined(EP_BUILD_SOFTWARE)
+    const char* value;
+    if (mFilter == NULL && (value = ::getenv("EP_TEST_FILTER"))) {
+      mFilter = value;
+    }
+    if (mShardCount == 0 && (value = ::getenv("EP_TEST_SHARD_COUNT"))) {
+      const char* index = ::getenv("EP_TEST_SHARD_INDEX");
+      SetShard(index ? ::atoi(index) : 0, ::atoi(value));
+    }
+    if (mWorkerCount < 0 && (value = ::getenv("EP_TEST_WORKERS"))) {
+      mWorkerCount = ::atoi(value);
+    }
+#endif
+    if (mShardCount == 0) {
+      mShardCount = 1;
+    }
+    if (mWorkerCount < 0) {
+      mWorkerCount = 1;
+    }
+  }
+
+  // Sets mIsSelected from the filter and shard.  Returns the selected count.
+  int SelectTests() {
+    int matchCount = 0;
+    int selectedCount = 0;
+    for (FactoryBase* it = mFirstFactory; it; it = it->mNextFactory) {
+      it->mIsSelected = IsFilterMatch(it) && (matchCount++ % mShardCount) == mShardIndex;
+      selectedCount += it->mIsSelected ? 1 : 0;
+    }
+    return selectedCount;
+  }
+
+  bool IsFilterMatch(FactoryBase* factory) const {
+    if (mFilter == NULL) {
+      return true;
+    }
+    char name[256];
+    ::snprintf(name, sizeof name, "%s.%s", factory->EpTest_ClassName(), factory->EpTest_FunctionName());
+    const char* className = factory->EpTest_ClassName();
+    const char* negative = ::strchr(mFilter, '-');
+    const char* positiveEnd = negative ? negative : mFilter + ::strlen(mFilter);
+    bool isIncluded = positiveEnd == mFilter || IsAnyMatch(mFilter, positiveEnd, name, className);
+    return isIncluded && !(negative && IsAnyMatch(negative + 1, negative + ::strlen(negative), name, className));
+  }
+
+  // Matches ':' separated patterns against either name.
+  static bool IsAnyMatch(const char* patterns, const char* end, const char* name, const char* className) {
+    while (patterns < end) {
+      const char* separator = patterns;
+      while (separator != end && *separator != ':') {
+        ++separator;
+      }
+      if (IsGlobMatch(patterns, separator, name) || IsGlobMatch(patterns, separator, className)) {
+        return true;
+      }
+      patterns = separator + 1;
+    }
+    return false;
+  }
+
+  // Backtracks to the most recent '*' on a mismatch.
+  static bool IsGlobMatch(const char* pattern, const char* end, const char* text) {
+    const char* star = NULL;
+    const char* starText = NULL;
+    while (*text) {
+      if (pattern != end && (*pattern == '?' || *pattern == *text)) {
+        ++pattern;
+        ++text;
+      } else if (pattern != end && *pattern == '*') {
+        star = pattern++;
+        starText = text;
+      } else if (star) {
+        pattern = star + 1;
+        text = ++starText;
+      } else {
+        return false;
+      }
+    }
+    while (pattern != end && *pattern == '*') {
+      ++pattern;
+    }
+    return pattern == end;
+  }
+
+  // Returns TEST_PASS or TEST_FAIL.
+  TestState ExecuteTest(FactoryBase* factory) {
+    EpLog("%s.%s...\n", factory->EpTest_ClassName(), factory->EpTest_FunctionName());
+
+    mTestState = TEST_NOTHING_ASSERTED;
+    mCurrentTest = factory;
+    mHasBenchmarkResult = false;
+    mIsBenchmarkRegression = false;
+
+    {
+      // Tests should have no side effects.  Therefore all allocations should be safe to reset.
+      EpProfileScope(factory->EpTest_FunctionName());
+      EpAllocatorScope testTempScope(EpMemoryAllocatorId_TemporaryStack);
+      EpAllocationTracker testTracker;
+      mTestTracker = &testTracker;
+      factory->EpTest_ConstructAndExecute();
+      mTestTracker = NULL;
+    }
+
+    if (mTestState == TEST_NOTHING_ASSERTED) {
+      Assert(factory->EpTest_File(), factory->EpTest_Line(), false, "Nothing was asserted!");
+    }
+
+    EpProfilerLog();
+    return mTestState;
+  }
+
+  // Counts a test executed here or by a worker.
+  void RecordResult(TestState state) {
+    if (state == TEST_PASS) {
+      ++mPassCount;
+    } else {
+      ++mFailCount;
+    }
+    if (mIsBenchmarkRegression) {
+      ++mBenchmarkRegressionCount;
+    }
+    if (mHasBenchmarkResult && mBenchmarkOutput) {
+      ::fprintf(mBenchmarkOutput, "%s %.3f %.3f\n", mBenchmarkResult.name, mBenchmarkResult.median, mBenchmarkResult.mad);
+    }
+  }
+
+#if (EP_TEST_FORK==1)
+  struct WorkerRecord {
+    FactoryBase* factory;
+    int worker; // -1 until claimed.
+    int state; // -1 until complete.
+    long logBegin;
+    long logEnd;
+    bool hasBenchmarkResult;
+    bool isBenchmarkRegression;
+    BenchmarkResult benchmarkResult;
+  };
+
+  // Followed by a WorkerRecord for each selected test.
+  struct WorkerShared {
+    std::atomic<int> next;
+    int count;
+    WorkerRecord* Records() { return (WorkerRecord*)(this + 1); }
+  };
+
+  // Workers claim the next selected test and log to their own file.  The
+  // logs are copied to stderr in registration order once all workers exit.
+  void ExecuteTestsInWorkers(int selectedCount, int workerCount) {
+    size_t sharedSize = sizeof(WorkerShared) + (size_t)selectedCount * sizeof(WorkerRecord);
+    WorkerShared* shared = (WorkerShared*)::mmap(NULL, sharedSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    EpReleaseAssertMsg(shared != (WorkerShared*)MAP_FAILED, "EpTestRunner: mmap failed");
+    ::new (&shared->next) std::atomic<int>(0);
+    shared->count = 0;
+    for (FactoryBase* it = mFirstFactory; it; it = it->mNextFactory) {
+      if (it->mIsSelected) {
+        WorkerRecord& record = shared->Records()[shared->count++];
+        record.factory = it;
+        record.worker = record.state = -1;
+      }
+    }
+    workerCount = EpMin(workerCount, EpMax(shared->count, 1));
+
+    EpLogFlush();
+    ::fflush(stdout);
+    ::fflush(stderr);
+    if (mBenchmarkOutput) {
+      ::fflush(mBenchmarkOutput);
+    }
+
+    FILE* logs[MAX_WORKERS];
+    pid_t pids[MAX_WORKERS];
+    for (int w = 0; w < workerCount; ++w) {
+      logs[w] = ::tmpfile();
+      EpReleaseAssertMsg(logs[w], "EpTestRunner: tmpfile failed");
+      pids[w] = ::fork();
+      EpReleaseAssertMsg(pids[w] >= 0, "EpTestRunner: fork failed");
+      if (pids[w] == 0) {
+        ::dup2(::fileno(logs[w]), 2);
+        ExecuteWorker(shared, w);
+        ::_exit(0);
+      }
+    }
+    for (int w = 0; w < workerCount; ++w) {
+      int status = 0;
+      ::waitpid(pids[w], &status, 0);
+      EpReleaseWarning(WIFEXITED(status) && WEXITSTATUS(status) == 0, "EpTestRunner: Worker %d exited abnormally", w);
+    }
+
+    const WorkerRecord* records = shared->Records();
+    for (FactoryBase* factory = mFirstFactory; factory; factory = factory->mNextFactory) {
+      if (!factory->mIsSelected) {
+        EpLog("Skipping %s.%s..\n", factory->EpTest_ClassName(), factory->EpTest_FunctionName());
+        continue;
+      }
+      const WorkerRecord& record = *records++;
+      if (record.worker >= 0) {
+        CopyLog(logs[record.worker], record.logBegin, record.state >= 0 ? record.logEnd : -1L);
+      }
+      if (record.state < 0) {
+        EpLog("ASSERT FAIL: %s.%s did not complete\n", factory->EpTest_ClassName(), factory->EpTest_FunctionName());
+      }
+      mHasBenchmarkResult = record.hasBenchmarkResult;
+      mIsBenchmarkRegression = record.isBenchmarkRegression;
+      mBenchmarkResult = record.benchmarkResult;
+      RecordResult(record.state < 0 ? TEST_FAIL : (TestState)record.state);
+    }
+
+    for (int w = 0; w < workerCount; ++w) {
+      ::fclose(logs[w]);
+    }
+    ::munmap(shared, sharedSize);
+  }
+
+  void ExecuteWorker(WorkerShared* shared, int worker) {
+    for (;;) {
+      int k = shared->next.fetch_add(1);
+      if (k >= shared->count) {
+        return;
+      }
+      WorkerRecord& record = shared->Records()[k];
+      record.worker = worker;
+      record.logBegin = (long)::lseek(2, 0, SEEK_CUR);
+      TestState state = ExecuteTest(record.factory);
+      EpLogFlush();
+      record.logEnd = (long)::lseek(2, 0, SEEK_CUR);
+      record.hasBenchmarkResult = mHasBenchmarkResult;
+      record.isBenchmarkRegression = mIsBenchmarkRegression;
+      record.benchmarkResult = mBenchmarkResult;
+      record.state = (int)state;
+    }
+  }
+
+  // Copies [begin, end) of a worker log to stderr.  end -1 is the end of the log.
+  static void CopyLog(FILE* log, long begin, long end) {
+    char buffer[4096];
+    int fd = ::fileno(log);
+    if (end < 0) {
+      end = (long)::lseek(fd, 0, SEEK_END);
+    }
+    for (long at = begin; at < end;) {
+      ssize_t bytes = ::pread(fd, buffer, (size_t)EpMin(end - at, (long)sizeof buffer), (off_t)at);
+      if (bytes <= 0) {
+        return;
+      }
+      ssize_t written = ::write(2, buffer, (size_t)bytes); (void)written;
+      at += (long)bytes;
+    }
+  }
+#endif // EP_TEST_FORK
+
+  // Temporary allocations are released after each batch.
+  uint64_t RunBenchmarkBatch(BenchmarkBase& body, unsigned iterations, uint64_t* allocations, uint64_t* bytesPerIteration) {
+    EpAllocatorScope batchScope(EpMemoryAllocatorId_TemporaryStack);
+    EpBenchmarkState state(iterations, batchScope);
+    body.EpBenchmark_Execute(state);
+    EpReleaseAssertMsg(state.IsDone(), "BENCHMARK_F must loop until KeepRunning() returns false");
+    if (allocations) {
+      *allocations += state.GetAllocationsMade();
+      *bytesPerIteration = state.GetBytesPerIteration();
+    }
+    return state.GetNanoseconds();
+  }
+
+  // Reorders samples.
+  static double Median(double* samples, int count) {
+    for (int i = 1; i < count; ++i) {
+      for (int j = i; j > 0 && samples[j] < samples[j - 1]; --j) {
+        EpSwap(samples[j], samples[j - 1]);
+      }
+    }
+    return (count & 1) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) * 0.5;
+  }
+
+  void OpenBenchmarkFiles() {
+    mBaselineCount = 0;
+    if (mBenchmarkBaselinePath) {
+      FILE* baseline = ::fopen(mBenchmarkBaselinePath, "r");
+      EpReleaseWarning(baseline, "EpBenchmark: No baseline %s", mBenchmarkBaselinePath);
+      if (baseline) {
+        while (mBaselineCount < MAX_BASELINE_RESULTS) {
+          BenchmarkResult& result = mBaseline[mBaselineCount];
+          if (::fscanf(baseline, "%63s %lf %lf", result.name, &result.median, &result.mad) != 3) {
+            break;
+          }
+          ++mBaselineCount;
+        }
+        BenchmarkResult extra;
+        EpReleaseWarning(mBaselineCount < MAX_BASELINE_RESULTS || ::fscanf(baseline, "%63s %lf %lf", extra.name, &extra.median, &extra.mad) != 3,
+          "EpBenchmark: Using the first %d baseline results", mBaselineCount);
+        ::fclose(baseline);
+      }
+    }
+    if (mBenchmarkOutputPath) {
+      mBenchmarkOutput = ::fopen(mBenchmarkOutputPath, "w");
+      EpReleaseWarning(mBenchmarkOutput, "EpBenchmark: Cannot write %s", mBenchmarkOutputPath);
+    }
+  }
+
+  const BenchmarkResult* FindBaseline(const char* name) const {
+    for (int i = 0; i < mBaselineCount; ++i) {
+      if (::strcmp(mBaseline[i].name, name) == 0) {
+        return mBaseline + i;
+      }
+    }
+    return NULL;
+  }
+
+  FactoryBase* mFirstFactory;
+  FactoryBase* mLastFactory;
   TestState mTestState;
   int mPassCount;
   int mFailCount;
   FactoryBase* mCurrentTest;
-  const char* mFilterClassName;
+  const char* mFilter;
+  int mShardIndex;
+  int mShardCount; // 0 until set.
+  uint64_t mBenchmarkMinNanoseconds;
+  double mBenchmarkTolerance;
+  const char* mBenchmarkBaselinePath;
+  const char* mBenchmarkOutputPath;
+  FILE* mBenchmarkOutput;
+  int mBenchmarkRegressionCount;
+  int mBaselineCount;
+  BenchmarkResult mBaseline[MAX_BASELINE_RESULTS];
+  BenchmarkResult mBenchmarkResult; // Of the current test.
+  bool mHasBenchmarkResult;
+  bool mIsBenchmarkRegression;
+  int mWorkerCount; // -1 until set.
+  EpAllocationTracker* mTestTracker; // Of the current test.
+};
+
+// ----------------------------------------------------------------------------
+// EpExpectNoAllocations() and EpExpectNoHeapAllocations()
+//
+// Fail the current test when the rest of the enclosing scope allocates, and
+// log where.  EpExpectNoHeapAllocations() allows the other allocators,
+// including the temporary stack, but not overflow from them to the heap.
+
+#define EpExpectNoAllocations() EpAllocationExpectation EP_CONCATENATE(epAllocationExpectation_,__LINE__)(__FILE__, __LINE__, EpMemoryAllocatorId_UNSPECIFIED)
+#define EpExpectNoHeapAllocations() EpAllocationExpectation EP_CONCATENATE(epAllocationExpectation_,__LINE__)(__FILE__, __LINE__, EpMemoryAllocatorId_Heap)
+
+class EpAllocationExpectation {
+public:
+  EpAllocationExpectation(const char* file, int line, EpMemoryAllocatorId id) {
+    m_file = file;
+    m_line = line;
+    m_id = id;
+  }
+
+  ~EpAllocationExpectation() {
+    uintptr_t count = m_id == EpMemoryAllocatorId_UNSPECIFIED ? m_tracker.GetAllocationCount()
+      : m_tracker.GetAllocationCount(m_id);
+    EpTestRunner::Singleton().Assert(m_file, m_line, count == 0u, "%s: %d allocations",
+      m_id == EpMemoryAllocatorId_UNSPECIFIED ? "EpExpectNoAllocations" : "EpExpectNoHeapAllocations", (int)count);
+    if (count != 0u) {
+      m_tracker.LogCallSites();
+    }
+  }
+
+private:
+  EpAllocationExpectation(const EpAllocationExpectation&);
+  void operator=(const EpAllocationExpectation&);
+
+  EpAllocationTracker m_tracker;
+  const char* m_file;
+  int m_line;
+  EpMemoryAllocatorId m_id;
 };
 
 // ----------------------------------------------------------------------------
@@ -137,13 +753,43 @@ static EP_CONCATENATE(TestClassName, TestFunctionName) EP_CONCATENATE(s_epTest_,
 void EP_CONCATENATE(TestClassName, TestFunctionName)::TestExecutor::EpTest_Execute(void) // { Test code follows:
 
 // ----------------------------------------------------------------------------
+// BENCHMARK_F(TestClassName, BenchmarkName) { setup; while (state.KeepRunning()) { ... } }
+//
+// Registered and filtered with the tests.  The fixture is constructed once and
+// the body is called for each batch.
+
+#define BENCHMARK_F(TestClassName, BenchmarkName) \
+struct EP_CONCATENATE(TestClassName, BenchmarkName) : EpTestRunner::FactoryBase { \
+  struct BenchmarkExecutor : TestClassName, EpTestRunner::BenchmarkBase { \
+    virtual void EpTest_Execute() { } \
+    virtual void EpBenchmark_Execute(EpBenchmarkState& state); \
+  }; \
+  EP_CONCATENATE(TestClassName, BenchmarkName)(void) { EpTestRunner::Singleton().AddTest(#TestClassName, this);  } \
+  virtual void EpTest_ConstructAndExecute(void) { \
+    BenchmarkExecutor executor; \
+    EpTestRunner::Singleton().RunBenchmark(executor, #TestClassName "." #BenchmarkName); \
+  } \
+  virtual const char* EpTest_ClassName(void) { return #TestClassName; } \
+  virtual const char* EpTest_FunctionName(void) { return #BenchmarkName; } \
+  virtual const char* EpTest_File(void) { return __FILE__; } \
+  virtual int EpTest_Line(void) { return __LINE__; } \
+}; \
+static EP_CONCATENATE(TestClassName, BenchmarkName) EP_CONCATENATE(s_epBenchmark_, BenchmarkName); \
+void EP_CONCATENATE(TestClassName, BenchmarkName)::BenchmarkExecutor::EpBenchmark_Execute(EpBenchmarkState& state) // { Benchmark code follows:
+
+// ----------------------------------------------------------------------------
+
+// The expression text is an argument, not part of the format, so '%' in an
+// expression is printed as written.
+#define ASSERT_TRUE(a) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a), "%s : %d", #a, (int)a)
+#define ASSERT_FALSE(a) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, !(a), "!(%s) : %d", #a, (int)a)
+#define ASSERT_NEAR(a, b, c) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, EpAbs((a)-(b)) <= c, "abs(%s - %s) <= %s : %g %g %g", #a, #b, #c, (float)a,  (float)b,  (float)c)
+#define ASSERT_EQ(a, b) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a) == (b), "%s == %s : %g %g", #a, #b, (float)a, (float)b)
+#define ASSERT_LE(a, b) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a) <= (b), "%s <= %s : %g %g", #a, #b, (float)a, (float)b)
+#define ASSERT_GE(a, b) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a) >= (b), "%s >= %s : %g %g", #a, #b, (float)a, (float)b)
 
-#define ASSERT_TRUE(a) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a), #a" : %d", (int)a)
-#define ASSERT_FALSE(a) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, !(a), "!("#a") : %d", (int)a)
-#define ASSERT_NEAR(a, b, c) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, EpAbs((a)-(b)) <= c, "abs("#a" - "#b") <= "#c" : %g %g %g", (float)a,  (float)b,  (float)c)
-#define ASSERT_EQ(a, b) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a) == (b), #a" == "#b" : %g %g", (float)a, (float)b)
-#define ASSERT_LE(a, b) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a) <= (b), #a" <= "#b" : %g %g", (float)a, (float)b)
-#define ASSERT_GE(a, b) EpTestRunner::Singleton().Assert(__FILE__, __LINE__, (a) >= (b), #a" >= "#b" : %g %g", (float)a, (float)b)
+// At most n allocations totaling bytes since the test started, from any allocator.
+#define ASSERT_ALLOCATIONS_LE(n, bytes) EpTestRunner::Singleton().AssertAllocationsLE(__FILE__, __LINE__, (n), (bytes))
 
 #endif // EP_BUILD_SOFTWARE
 
@@ -2,26 +2,64 @@
 
 #include "EpAllocator.h"
 
+#include <new>
+
 // ----------------------------------------------------------------------------
-// EpUniquePtr
+// EpDefaultDelete, EpAllocatorDelete
 //
-// An implementation of std::unique_ptr.  Only for objects managed with new and delete.
+// Deleters for EpUniquePtr.  EpDefaultDelete uses EpDelete, which searches for
+// the allocator that owns the object.  EpAllocatorDelete is for objects from a
+// known allocator and frees directly to it.  The free always reaches the
+// allocator, so stack allocators still see it for their free checks and
+// allocation counts even though they only release memory when reset.
 
 template<class T>
-struct EpUniquePtr {
+struct EpDefaultDelete {
+  void operator()(T* t) const { EpDelete(t); }
+};
+
+template<class T, EpMemoryAllocatorId Id>
+struct EpAllocatorDelete {
+  void operator()(T* t) const {
+    if (t) {
+      t->~T();
+      EpFreeExtended(t, Id);
+    }
+  }
+};
+
+// ----------------------------------------------------------------------------
+// EpUniquePtr
+//
+// An implementation of std::unique_ptr.  The deleter is an empty base, so the
+// default and allocator deleters add no size.
+
+template<class T, class Deleter=EpDefaultDelete<T> >
+struct EpUniquePtr : private Deleter {
 public:
+  typedef Deleter deleter_type;
+
   EpUniquePtr() { m_ptr = 0; }
 
   explicit EpUniquePtr(T* t) { m_ptr = t; }
 
-  EpUniquePtr(EpUniquePtr& rhs) { m_ptr = rhs.release(); } // move semantics
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+  EpUniquePtr(EpUniquePtr&& rhs) : Deleter(rhs.get_deleter()) { m_ptr = rhs.release(); }
+
+  void operator=(EpUniquePtr&& rhs) { reset(rhs.release()); get_deleter() = rhs.get_deleter(); }
+
+  EpUniquePtr(const EpUniquePtr&) = delete;
+  void operator=(const EpUniquePtr&) = delete;
+#else
+  EpUniquePtr(EpUniquePtr& rhs) : Deleter(rhs.get_deleter()) { m_ptr = rhs.release(); } // move semantics
+
+  void operator=(EpUniquePtr& rhs) { reset(rhs.release()); get_deleter() = rhs.get_deleter(); } // move semantics
+#endif
 
   ~EpUniquePtr() {
     reset();
   }
 
-  void operator=(EpUniquePtr& rhs) { reset(rhs.release()); }
-
   T* release() {
     T* ptr = m_ptr;
     m_ptr = 0;
@@ -31,13 +69,16 @@ public:
   // Check for reassignment is non-standard.
   void reset(T* ptr=0) {
     if (m_ptr && m_ptr != ptr) {
-      EpDelete(m_ptr);
+      get_deleter()(m_ptr);
     }
     m_ptr = ptr;
   }
 
   T* get() const { return m_ptr; }
 
+  const Deleter& get_deleter() const { return *this; }
+  Deleter& get_deleter() { return *this; }
+
   T& operator*() const { return *m_ptr; }
   T* operator->() const { return m_ptr; }
   operator bool() const { return m_ptr != 0; }
@@ -55,3 +96,24 @@ public:
 private:
   T* m_ptr;
 };
+
+// ----------------------------------------------------------------------------
+// EpMakeUnique
+//
+// EpMakeUnique<T, Id>(args...) allocates from allocator Id and records it in
+// the deleter type.  EpMakeUnique<T>(id, args...) takes the allocator at run
+// time and uses EpDefaultDelete.  Requires C++11.
+
+#if !defined(EP_BUILD_SOME_EMBEDDED_COMPILER)
+template<class T, EpMemoryAllocatorId Id, class... Args>
+inline EpUniquePtr<T, EpAllocatorDelete<T, Id> > EpMakeUnique(Args&&... args) {
+  void* buf = EpMallocExtended(sizeof(T), EP_ALIGNMENT_MASK, Id);
+  return EpUniquePtr<T, EpAllocatorDelete<T, Id> >(::new(buf) T(EpForward<Args>(args)...));
+}
+
+template<class T, class... Args>
+inline EpUniquePtr<T> EpMakeUnique(int memoryAllocatorId, Args&&... args) {
+  void* buf = EpMallocExtended(sizeof(T), EP_ALIGNMENT_MASK, memoryAllocatorId);
+  return EpUniquePtr<T>(::new(buf) T(EpForward<Args>(args)...));
+}
+#endif